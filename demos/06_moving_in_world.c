@@ -1,7 +1,11 @@
 #include "objects.h"
 #include "renderer.h"
+#include "spatial.h"
+#include "scene.h"
+#include "arena.h"
 #include "arg_parser.h" // CFG_DIR
 #include "utils.h" // CFG_DIR
+#include "xtrig.h" // ftrig_init_lut
 #include <math.h> // sin, cos
 #include <unistd.h> // for usleep
 #include <stdbool.h> // bool
@@ -25,14 +29,19 @@ struct termios old_terminal_settings;
 struct termios new_terminal_settings;
 
 mesh_t** obj;
+// all meshes of the scene are allocated from it
+arena_t* scene_arena;
+spatial_t* scene_index;
+scene_node_t* scene;
 
 /* Callback that clears the screen and makes the cursor visible when the user hits Ctr+C */
 static void interrupt_handler(int int_num) {
     // restore the terminal settings to their prvious state
     if (tcsetattr(0, TCSANOW, &old_terminal_settings) < 0)
         perror("tcsetattr ICANON");
-    for (int i = 0; i < 5; ++i)
-        obj_mesh_free(obj[i]);
+    spatial_free(scene_index);
+    arena_free(scene_arena);
+    scene_node_free(scene);
     if (int_num == SIGINT) {
         render_end();
         exit(SIGINT);
@@ -68,10 +77,6 @@ static void set_terminal() {
         perror("tcsetattr ICANON");
 }
 
-static int sign(int x) {
-    return (x >= 0) - (x < 0);
-}
-
 int main(int argc, char** argv) {
     // width, height, depth of the four cubes
     const unsigned w =  100, h = 100, d = 100;
@@ -80,6 +85,8 @@ int main(int argc, char** argv) {
 
     // make sure we end gracefully if the user hits Ctr+C
     signal(SIGINT, interrupt_handler);
+    // the meshes are posed with the lookup table's sines and cosines
+    ftrig_init_lut();
 
     // path to directory where meshes are stored - stored in CFG_DIR prep. constant
     const char* mesh_dir = STRINGIFY(CFG_DIR);
@@ -118,100 +125,74 @@ int main(int argc, char** argv) {
     int coffinx = 0, coffiny = 0, coffinz = 900;
     unsigned dist = 120;
     obj = malloc(sizeof(mesh_t*) * 5);
+    scene_arena = arena_new(1 << 14);
     // coffin
-    obj[0] = obj_mesh_from_file(coffin_filepath, coffinx, coffiny+50, coffinz, w, 1.3*h, 0.8*d);
+    obj[0] = obj_mesh_from_file_in(scene_arena, coffin_filepath, coffinx, coffiny+50, coffinz, w, 1.3*h, 0.8*d);
     // cubes at 3, 6, 9, 12 o'clock cubes
-    obj[1] = obj_mesh_from_file(cube_filepath, dist,  0, coffinz,     w, h, d);
-    obj[2] = obj_mesh_from_file(cube_filepath, 0,     0, coffinz+200, w, h, d);
-    obj[3] = obj_mesh_from_file(cube_filepath, -dist, 0, coffinz,     w, h, d);
-    obj[4] = obj_mesh_from_file(cube_filepath, 0,     0, coffinz-200, w, h, d);
+    obj[1] = obj_mesh_from_file_in(scene_arena, cube_filepath, dist,  0, coffinz,     w, h, d);
+    obj[2] = obj_mesh_from_file_in(scene_arena, cube_filepath, 0,     0, coffinz+200, w, h, d);
+    obj[3] = obj_mesh_from_file_in(scene_arena, cube_filepath, -dist, 0, coffinz,     w, h, d);
+    obj[4] = obj_mesh_from_file_in(scene_arena, cube_filepath, 0,     0, coffinz-200, w, h, d);
+    // the cubes hang from a pivot at the coffin - rotating the pivot makes them orbit it
+    scene = scene_node_new(NULL);
+    scene_node_t* coffin = scene_node_new(obj[0]);
+    scene_node_t* pivot = scene_node_new(NULL);
+    scene_node_t* cubes[4];
+    const float cube_offsets[4][3] = {{dist, 0, 0}, {0, 0, 200}, {-(float)dist, 0, 0}, {0, 0, -200}};
+    scene_node_set_local(coffin, 0, 0, 0, coffinx, coffiny+50, coffinz);
+    scene_node_set_local(pivot, 0, 0, 0, coffinx, coffiny, coffinz);
+    scene_node_add_child(scene, coffin);
+    scene_node_add_child(scene, pivot);
+    for (int i = 0; i < 4; ++i) {
+        cubes[i] = scene_node_new(obj[i+1]);
+        scene_node_set_local(cubes[i], 0, 0, 0, cube_offsets[i][0], cube_offsets[i][1], cube_offsets[i][2]);
+        scene_node_add_child(pivot, cubes[i]);
+    }
+    scene_update(scene);
+    // index the objects so we only render those the camera can see
+    scene_index = spatial_new();
+    // the meshes update the index themselves as the scene graph moves them
+    mesh_t* visible[5];
+    for (int i = 0; i < 5; ++i)
+        spatial_insert(scene_index, obj[i]);
 
     // do the actual rendering
     render_use_perspective(0, 0, focal_length);
     render_init();
 
-    unsigned rad = 2*dist;
-    int sign_x = 1, sign_y = 1;
+    // position of the pivot, moved with the w, a, s, d keys
+    float pivotx = coffinx, pivotz = coffinz;
     for (size_t t = 0; t < UINT_MAX; ++t) {
-        int dx[4] = {0}, dy[4] = {0}, dz[4] = {0};
 		// Check if a key is pressed.  If it is, call getchar to fetch it.
 		if (is_key_pressed()) {
 			char ch = getchar();
 			if (ch == 'a')
-				dx[0] += 10;
+				pivotx += 10;
 			else if (ch == 's')
-				dz[0] += 10;
+				pivotz += 10;
 			else if (ch == 'd')
-				dx[0] -= 10;
+				pivotx -= 10;
 			else if (ch == 'w')
-				dz[0] -= 10;
-		}
-
-		sign_x = (t % rad == 0) ? -sign_x: sign_x;
-		sign_y = ((t + rad/2) % rad == 0) ? -sign_y: sign_y;
-        //      .
-		//  ^>    v>
-		//  ^<    v<
-		//      .
-		dx[0] += sign_x;
-		dz[0] += sign_y;
-		// 1st cube at 1st quarter
-		printf("%d, %d\n", sign_x, sign_y);
-		if ((sign_x <= 0) && (sign_y >= 0)) {
-			dx[1] = dx[0];
-			dz[1] = -dz[0];
-			dx[2] = -dx[0];
-			dz[2] = -dz[0];
-			dx[3] = -dx[0];
-			dz[3] = dz[0];
-		// 1st cube at 2nd quarter
-		} else if ((sign_x <= 0) && (sign_y < 0)) {
-			dx[1] = -dx[0];
-			dz[1] = dz[0];
-			dx[2] = -dx[0];
-			dz[2] = -dz[0];
-			dx[3] = dx[0];
-			dz[3] = -dz[0];
-		// 1st cube at 3rd quarter
-		} else if ((sign_x <= 0) && (sign_y >= 0)) {
-			dx[1] = dx[0];
-			dz[1] = -dz[0];
-			dx[2] = -dx[0];
-			dz[2] = -dz[0];
-			dx[3] = -dx[0];
-			dz[3] = dz[0];
-		} else {
-        //      .
-		//  ^>    v>
-		//  ^<    v<
-		//      .
-			dx[1] = -dx[0];
-			dz[1] = dz[0];
-			dx[2] = -dx[0];
-			dz[2] = -dz[0];
-			dx[3] = dx[0];
-			dz[3] = -dz[0];
+				pivotz -= 10;
 		}
-		for (int i = 0; i < 4; i++)
-			obj_mesh_translate_by(obj[i+1], dx[i], dy[i], dz[i]);
-		if ((obj[1]->center->x <= coffinx) && (obj[1]->center->z <= coffinz + rad))
-			printf("dz = %d, z = %d/%d\n", dz[0], obj[1]->center->z, coffinz);
-        for (int i = 0; i < 5; ++i) {
-            if (obj[i]->center->x != 0)
-                obj_mesh_rotate_to(obj[i], atan(obj[i]->center->y/obj[i]->center->x), 0, 0);
-        }
-
-        obj_mesh_rotate_to(obj[1], 1.0/10*t, 0*t, 1.0/15*t);
-        for (int i = 0; i < 5; ++i)
-            render_write_shape(obj[i]);
+        scene_node_set_local(pivot, 0, 1.0/60*t, 0, pivotx, coffiny, pivotz);
+        // the 1st cube also spins about itself while orbiting
+        scene_node_set_local(cubes[0], 1.0/10*t, 0, 1.0/15*t, cube_offsets[0][0], cube_offsets[0][1],
+                             cube_offsets[0][2]);
+        scene_update(scene);
+
+        const size_t n_visible = UT_MIN(spatial_query_frustum(scene_index, &g_renderer.frustum, visible, 5), 5);
+        for (size_t i = 0; i < n_visible; ++i)
+            render_write_shape(visible[i]);
         render_flush();
 #ifndef _WIN32
         // nanosleep does not work on Windows
         nanosleep((const struct timespec[]) {{0, (int)(1.0 / 60 * 1e9)}}, NULL);
 #endif
     }
-    for (int i = 0; i < 5; ++i)
-        obj_mesh_free(obj[i]);
+    spatial_free(scene_index);
+    arena_free(scene_arena);
+    scene_node_free(scene);
 
     render_end();
 }
@@ -0,0 +1,79 @@
+#include "shm.h"
+#include "sink.h"
+#include <stdio.h> // fprintf
+#include <stdlib.h> // realloc, free
+#include <string.h> // memcpy
+#include <stdbool.h> // bool
+#include <stdint.h> // uint64_t
+#include <signal.h> // signal, sig_atomic_t
+#include <time.h> // nanosleep
+
+/*
+ * Shows the frames another process publishes to shared memory, e.g.
+ *     ./cube -o shm:/retrocube -sr 40 -sc 120
+ *     ./07_shm_reader /retrocube
+ * Each frame is copied out of the shared memory and drawn only if the writer
+ * left it alone meanwhile. If the writer is restarted, e.g. after a crash,
+ * it reattaches to the new segment.
+ */
+
+static volatile sig_atomic_t is_interrupted = 0;
+
+static void interrupt_handler(int int_num) {
+    is_interrupted = 1;
+}
+
+/* waits for the writer's first frame, NULL if interrupted */
+static shm_reader_t* attach(const char* name) {
+    shm_reader_t* reader = NULL;
+    while (!is_interrupted && ((reader = shm_reader_open(name)) == NULL))
+        nanosleep((const struct timespec[]) {{0, 100*1000*1000}}, NULL);
+    return reader;
+}
+
+int main(int argc, char** argv) {
+    const char* name = (argc > 1) ? argv[1] : "/retrocube";
+    const unsigned fps = 30;
+    signal(SIGINT, interrupt_handler);
+    shm_reader_t* reader = attach(name);
+    if (reader == NULL)
+        return 0;
+    sink_t* tty = sink_tty_new();
+    color_t* frame = NULL;
+    // frames shown, frames the writer published while we weren't looking,
+    // frames it overwrote while we were copying them and writers we attached to
+    size_t n_shown = 0, n_skipped = 0, n_torn = 0, n_writers = 1;
+    uint64_t last_seq = 0;
+    while (!is_interrupted && !__atomic_load_n(&reader->header->is_closed, __ATOMIC_ACQUIRE)) {
+        const int rows = reader->header->rows, cols = reader->header->cols;
+        shm_read_t read;
+        if (shm_read_begin(reader, &read) && (read.seq != last_seq)) {
+            frame = realloc(frame, sizeof(color_t) * rows * cols);
+            memcpy(frame, read.frame, sizeof(color_t) * rows * cols);
+            if (shm_read_end(reader, &read)) {
+                sink_write(tty, frame, rows, cols);
+                fflush(stdout);
+                n_shown++;
+                if (last_seq != 0)
+                    n_skipped += read.seq - last_seq - 1;
+                last_seq = read.seq;
+            } else {
+                n_torn++;
+            }
+        } else if (shm_reader_is_replaced(reader)) {
+            shm_reader_close(reader);
+            if ((reader = attach(name)) == NULL)
+                break;
+            n_writers++;
+            last_seq = 0;
+        }
+        nanosleep((const struct timespec[]) {{0, (int)(1.0 / fps * 1e9)}}, NULL);
+    }
+    sink_free(tty);
+    if (reader != NULL)
+        shm_reader_close(reader);
+    free(frame);
+    fprintf(stderr, "frames shown: %zu, skipped: %zu, torn: %zu, writers: %zu\n",
+            n_shown, n_skipped, n_torn, n_writers);
+    return 0;
+}
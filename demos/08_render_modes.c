@@ -0,0 +1,124 @@
+#include "objects.h"
+#include "renderer.h"
+#include "screen.h"
+#include "sink.h" // sink_null_new
+#include "lod.h" // lod_build
+#include "arg_parser.h" // arg_parse, CFG_DIR
+#include "xtrig.h" // ftrig_init_lut
+#include "utils.h" // ut_secs_since
+#include <stdio.h> // printf, snprintf
+#include <stdlib.h> // malloc, free
+#include <limits.h> // UINT_MAX
+#include <time.h> // clock_gettime
+
+/*
+ * Times the depth buffer against the painter's algorithm (-pa) offscreen, on
+ * the shipped meshes and on generated ones, e.g.
+ *     ./08_render_modes -sr 40 -sc 120 -mi 300 -up
+ * The other options, e.g. -up, -r or -lod, apply to both. For each mesh it
+ * prints the milliseconds per frame of each and the share of the characters
+ * the painter's algorithm draws differently, where faces cross or overlap
+ * in an order their centroids don't tell.
+ */
+
+// frames rendered per mesh and mode unless -mi says otherwise
+#define BENCH_FRAMES 300
+
+static const char* shipped_meshes[] = {"cube.scl", "coffin.scl", "rhombus.scl"};
+static const char* generated_meshes[] = {"cube:600", "sphere:1000", "sphere:10000", "torus:10000",
+                                         "hull:10000", "heightfield:10000", "torus:100000"};
+
+static void pose(mesh_t* shape, size_t t) {
+    obj_mesh_rotate_to(shape, g_rot_speed_x/20*t, g_rot_speed_y/20*t, g_rot_speed_z/20*t);
+}
+
+/* renders `n_frames` frames of a shape to a screen and gives the seconds it took */
+static double time_mode(mesh_t* shape, bool use_painter, size_t n_frames, screen_t* screen) {
+    int* depth = malloc(sizeof(int) * screen->rows * screen->cols);
+    renderer_t renderer = g_renderer;
+    renderer.use_painter = use_painter;
+    render_init_offscreen_r(&renderer, screen, depth);
+    // the first frame sizes the renderer's buffers
+    pose(shape, 0);
+    render_write_shape_r(&renderer, shape);
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (size_t t = 1; t <= n_frames; ++t) {
+        render_clear_r(&renderer);
+        pose(shape, t);
+        render_write_shape_r(&renderer, shape);
+    }
+    const double seconds = ut_secs_since(&t0);
+    render_end_r(&renderer);
+    free(depth);
+    return seconds;
+}
+
+/* share of the characters two modes draw differently over the frames, in percent */
+static double diff_modes(mesh_t* shape, size_t n_frames, int rows, int cols, float screen_res) {
+    const size_t size = (size_t)rows*cols;
+    color_t* pixels[2] = {malloc(sizeof(color_t) * size), malloc(sizeof(color_t) * size)};
+    int* depths[2] = {malloc(sizeof(int) * size), malloc(sizeof(int) * size)};
+    screen_t screens[2];
+    renderer_t renderers[2] = {g_renderer, g_renderer};
+    for (int i = 0; i < 2; ++i) {
+        screen_init_offscreen_r(&screens[i], rows, cols, screen_res, pixels[i]);
+        renderers[i].use_painter = (i == 1);
+        render_init_offscreen_r(&renderers[i], &screens[i], depths[i]);
+    }
+    size_t n_drawn = 0, n_diff = 0;
+    for (size_t t = 1; t <= n_frames; ++t) {
+        pose(shape, t);
+        for (int i = 0; i < 2; ++i) {
+            render_clear_r(&renderers[i]);
+            render_write_shape_r(&renderers[i], shape);
+        }
+        for (size_t i = 0; i < size; ++i) {
+            n_drawn += (pixels[0][i] != ' ') || (pixels[1][i] != ' ');
+            n_diff += pixels[0][i] != pixels[1][i];
+        }
+    }
+    for (int i = 0; i < 2; ++i) {
+        render_end_r(&renderers[i]);
+        free(pixels[i]);
+        free(depths[i]);
+    }
+    return (n_drawn > 0) ? 100.0*n_diff/n_drawn : 0.0;
+}
+
+static void bench(const char* name, mesh_t* shape, size_t n_frames, screen_t* screen) {
+    lod_build(shape, g_lod_levels);
+    const double zbuffer = time_mode(shape, false, n_frames, screen);
+    const double painter = time_mode(shape, true, n_frames, screen);
+    const double diff = diff_modes(shape, n_frames, screen->rows, screen->cols, screen->screen_res);
+    printf("%-20s %8zu %10.3f %10.3f %8.2fx %9.2f%%\n", name, shape->n_faces,
+           1e3*zbuffer/n_frames, 1e3*painter/n_frames, zbuffer/painter, diff);
+    obj_mesh_free(shape);
+}
+
+int main(int argc, char** argv) {
+    arg_parse(argc, argv);
+    ftrig_init_lut();
+    const size_t n_frames = (g_max_iterations == UINT_MAX) ? BENCH_FRAMES : g_max_iterations;
+    // size the frames like the terminal's unless -sr and -sc say otherwise
+    screen_t sizes;
+    screen_init_sink_r(&sizes, g_screen_rows, g_screen_cols, sink_null_new());
+    color_t* pixels = malloc(sizeof(color_t) * sizes.rows * sizes.cols);
+    screen_t screen;
+    screen_init_offscreen_r(&screen, sizes.rows, sizes.cols, sizes.screen_res, pixels);
+    screen_end_r(&sizes);
+
+    printf("%d x %d, %zu frames\n", screen.rows, screen.cols, n_frames);
+    printf("%-20s %8s %10s %10s %9s %10s\n", "mesh", "faces", "zbuf ms", "paint ms", "speedup", "differ");
+    for (size_t i = 0; i < sizeof(shipped_meshes)/sizeof(shipped_meshes[0]); ++i) {
+        char fpath[512];
+        snprintf(fpath, sizeof(fpath), "%s/%s", STRINGIFY(CFG_DIR), shipped_meshes[i]);
+        bench(shipped_meshes[i], obj_mesh_from_file(fpath, g_cx, g_cy, g_cz, g_width, g_height, g_depth),
+              n_frames, &screen);
+    }
+    for (size_t i = 0; i < sizeof(generated_meshes)/sizeof(generated_meshes[0]); ++i)
+        bench(generated_meshes[i],
+              obj_mesh_generate(generated_meshes[i], g_cx, g_cy, g_cz, g_width, g_height, g_depth),
+              n_frames, &screen);
+    free(pixels);
+}
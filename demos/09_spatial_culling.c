@@ -0,0 +1,121 @@
+#include "objects.h"
+#include "spatial.h"
+#include "arena.h"
+#include "xtrig.h" // ftrig_init_lut
+#include "utils.h" // ut_secs_since
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, free, rand, srand, atoi
+#include <math.h> // sqrt
+#include <time.h> // clock_gettime
+
+/*
+ * Times finding the meshes the camera can see with the spatial index against
+ * testing the box of every mesh, from 10 to 100k meshes, e.g.
+ *     ./09_spatial_culling [frames]
+ * The meshes are spread over a slab in front of the camera that widens with
+ * their number, so about as many are in view at any count: the index should
+ * grow with the log of the number of meshes, testing them all linearly. Every
+ * mesh also moves a little each frame, which keeps the index up to date on
+ * its own - those moves are timed with and without the index.
+ */
+
+// frames timed per count of meshes unless given
+#define BENCH_FRAMES 100
+// mean distance between two meshes across the slab
+#define BENCH_SPACING 40
+#define BENCH_MESH_SIZE 20
+// depth of the slab
+#define BENCH_Z0 300
+#define BENCH_Z1 500
+// what a 120x40 screen sees
+#define BENCH_HALF_WIDTH 60
+#define BENCH_HALF_HEIGHT 40
+#define BENCH_FOCAL_LENGTH -200
+// like the renderer's
+#define BENCH_Z_NEAR 1.0
+
+static const size_t counts[] = {10, 100, 1000, 10000, 100000};
+
+static int random_in(int lo, int hi) {
+    return lo + rand() % (hi - lo + 1);
+}
+
+/* moves every mesh by a pixel or two - most stay in their fat box - and gives the seconds it took */
+static double move_all(mesh_t** meshes, size_t n_meshes) {
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (size_t i = 0; i < n_meshes; ++i)
+        obj_mesh_translate_by(meshes[i], random_in(-2, 2), random_in(-2, 2), random_in(-2, 2));
+    return ut_secs_since(&t0);
+}
+
+static size_t cull_all(frustum_t* frustum, mesh_t** meshes, size_t n_meshes, mesh_t** out) {
+    size_t n_found = 0;
+    for (size_t i = 0; i < n_meshes; ++i) {
+        const struct bounding_box* box = &meshes[i]->bounding_box;
+        if (!obj_frustum_culls_box(frustum, box->x0, box->y0, box->z0, box->x1, box->y1, box->z1))
+            out[n_found++] = meshes[i];
+    }
+    return n_found;
+}
+
+static void bench(frustum_t* frustum, size_t n_meshes, size_t n_frames) {
+    arena_t* arena = arena_new(1 << 20);
+    mesh_t** meshes = malloc(sizeof(mesh_t*) * n_meshes);
+    mesh_t** found = malloc(sizeof(mesh_t*) * n_meshes);
+    const int half_extent = BENCH_SPACING * sqrt(n_meshes) / 2;
+    srand(1);
+    for (size_t i = 0; i < n_meshes; ++i)
+        meshes[i] = obj_subdivided_cube_new_in(arena, random_in(-half_extent, half_extent),
+                                               random_in(-half_extent, half_extent),
+                                               random_in(BENCH_Z0, BENCH_Z1),
+                                               BENCH_MESH_SIZE, BENCH_MESH_SIZE, BENCH_MESH_SIZE, 6);
+    // testing every mesh, which needs no upkeep
+    double t_brute = 0, t_move = 0;
+    size_t n_visible = 0;
+    for (size_t t = 0; t < n_frames; ++t) {
+        t_move += move_all(meshes, n_meshes);
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        n_visible += cull_all(frustum, meshes, n_meshes, found);
+        t_brute += ut_secs_since(&t0);
+    }
+    // the index, whose leaves the moves update
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    spatial_t* index = spatial_new();
+    for (size_t i = 0; i < n_meshes; ++i)
+        spatial_insert(index, meshes[i]);
+    const double t_build = ut_secs_since(&t0);
+    double t_query = 0, t_move_indexed = 0;
+    size_t n_candidates = 0;
+    for (size_t t = 0; t < n_frames; ++t) {
+        t_move_indexed += move_all(meshes, n_meshes);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        n_candidates += spatial_query_frustum(index, frustum, found, n_meshes);
+        t_query += ut_secs_since(&t0);
+    }
+    printf("%8zu %8.1f %8.1f %12.2f %12.2f %8.1fx %12.2f %12.2f %10.2f\n", n_meshes,
+           (double)n_visible/n_frames, (double)n_candidates/n_frames, 1e6*t_brute/n_frames,
+           1e6*t_query/n_frames, t_brute/t_query, 1e6*t_move/n_frames, 1e6*t_move_indexed/n_frames,
+           1e3*t_build);
+    spatial_free(index);
+    arena_free(arena);
+    free(meshes);
+    free(found);
+}
+
+int main(int argc, char** argv) {
+    const size_t n_frames = (argc > 1) ? (size_t)atoi(argv[1]) : BENCH_FRAMES;
+    ftrig_init_lut();
+    camera_t camera;
+    frustum_t frustum;
+    obj_camera_set(&camera, 0, 0, BENCH_FOCAL_LENGTH);
+    obj_frustum_set(&frustum, &camera, BENCH_HALF_WIDTH, BENCH_HALF_HEIGHT, BENCH_Z_NEAR);
+
+    printf("%zu frames, times per frame in us, index build in ms\n", n_frames);
+    printf("%8s %8s %8s %12s %12s %9s %12s %12s %10s\n", "meshes", "visible", "found", "test all",
+           "index", "speedup", "move", "move+index", "build");
+    for (size_t i = 0; i < sizeof(counts)/sizeof(counts[0]); ++i)
+        bench(&frustum, counts[i], n_frames);
+}
@@ -0,0 +1,94 @@
+#include "objects.h"
+#include "scene.h"
+#include "arena.h"
+#include "xtrig.h" // ftrig_init_lut
+#include "utils.h" // ut_secs_since
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, free, atoi
+#include <time.h> // clock_gettime
+
+/*
+ * Times `scene_update` on deep, wide and bushy hierarchies of 1k to 100k
+ * nodes, e.g.
+ *     ./10_scene_update [updates]
+ * A full update moves the root, so every world transform is recomputed. A
+ * leaf update moves one of the deepest nodes, so only the path to it is
+ * visited. Each is timed with grouping nodes only and with a mesh at every
+ * node, which the update places as well.
+ */
+
+// updates timed per hierarchy unless given
+#define BENCH_UPDATES 20
+// children of each node of the bushy hierarchies
+#define BENCH_BRANCHING 4
+#define BENCH_MESH_SIZE 10
+
+typedef enum hierarchy {
+    // a chain, each node the child of the last
+    HIERARCHY_DEEP,
+    // every node a child of the root
+    HIERARCHY_WIDE,
+    // a balanced tree of BENCH_BRANCHING children per node
+    HIERARCHY_BUSHY
+} hierarchy_t;
+
+static const char* hierarchy_names[] = {"deep", "wide", "bushy"};
+static const size_t counts[] = {1000, 10000, 100000};
+
+/* builds a hierarchy of `n_nodes` nodes, in `nodes` with the root first and a deepest leaf last */
+static void build(scene_node_t** nodes, size_t n_nodes, hierarchy_t hierarchy, arena_t* arena) {
+    for (size_t i = 0; i < n_nodes; ++i) {
+        mesh_t* mesh = (arena != NULL) ?
+            obj_subdivided_cube_new_in(arena, 0, 0, 0, BENCH_MESH_SIZE, BENCH_MESH_SIZE, BENCH_MESH_SIZE, 6) :
+            NULL;
+        nodes[i] = scene_node_new(mesh);
+        scene_node_set_local(nodes[i], 0.001*i, 0, 0, 1, 0, 0);
+        if (i == 0)
+            continue;
+        const size_t parent = (hierarchy == HIERARCHY_DEEP) ? i - 1 :
+                              (hierarchy == HIERARCHY_WIDE) ? 0 : (i - 1)/BENCH_BRANCHING;
+        scene_node_add_child(nodes[parent], nodes[i]);
+    }
+    scene_update(nodes[0]);
+}
+
+/* moves a node and updates the scene `n_updates` times, gives the seconds per update */
+static double time_updates(scene_node_t* root, scene_node_t* moved, size_t n_updates, size_t* n_recomputed) {
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (size_t t = 0; t < n_updates; ++t) {
+        scene_node_set_local(moved, 0.01*t, 0.02*t, 0, 1, 0, 0);
+        *n_recomputed = scene_update(root);
+    }
+    return ut_secs_since(&t0)/n_updates;
+}
+
+static void bench(hierarchy_t hierarchy, size_t n_nodes, size_t n_updates) {
+    scene_node_t** nodes = malloc(sizeof(scene_node_t*) * n_nodes);
+    // grouping nodes only, then a mesh at every node
+    double t_full[2], t_leaf[2];
+    size_t n_full = 0, n_leaf = 0;
+    for (int with_meshes = 0; with_meshes < 2; ++with_meshes) {
+        arena_t* arena = with_meshes ? arena_new(1 << 20) : NULL;
+        build(nodes, n_nodes, hierarchy, arena);
+        t_full[with_meshes] = time_updates(nodes[0], nodes[0], n_updates, &n_full);
+        t_leaf[with_meshes] = time_updates(nodes[0], nodes[n_nodes - 1], n_updates, &n_leaf);
+        scene_node_free(nodes[0]);
+        if (arena != NULL)
+            arena_free(arena);
+    }
+    printf("%-6s %8zu %10zu %12.1f %10.1f %12.1f %10zu %10.2f %12.2f\n", hierarchy_names[hierarchy], n_nodes,
+           n_full, 1e6*t_full[0], 1e9*t_full[0]/n_full, 1e6*t_full[1], n_leaf, 1e6*t_leaf[0], 1e6*t_leaf[1]);
+    free(nodes);
+}
+
+int main(int argc, char** argv) {
+    const size_t n_updates = (argc > 1) ? (size_t)atoi(argv[1]) : BENCH_UPDATES;
+    ftrig_init_lut();
+    printf("%zu updates each, n transforms recomputed per update\n", n_updates);
+    printf("%-6s %8s %10s %12s %10s %12s %10s %10s %12s\n", "", "nodes", "full: n", "us", "ns/node",
+           "us meshes", "leaf: n", "us", "us meshes");
+    for (hierarchy_t hierarchy = HIERARCHY_DEEP; hierarchy <= HIERARCHY_BUSHY; ++hierarchy)
+        for (size_t i = 0; i < sizeof(counts)/sizeof(counts[0]); ++i)
+            bench(hierarchy, counts[i], n_updates);
+}
@@ -0,0 +1,93 @@
+#include "xtrig.h"
+#include "utils.h" // ut_secs_since
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, free, rand, srand, atoi
+#include <math.h> // sin, cos, sinf, cosf, fabs
+#include <time.h> // clock_gettime
+
+/*
+ * Times and checks the sines and cosines of xtrig against libm's, over angles
+ * of growing range, e.g.
+ *     ./11_trig [angles]
+ * For each way of computing both of an angle it prints the nanoseconds per
+ * angle and the largest absolute error against double precision sin and cos.
+ */
+
+// angles per range unless given
+#define BENCH_ANGLES (1 << 20)
+// times each way runs over the angles, the fastest run counts
+#define BENCH_RUNS 5
+
+typedef enum method {
+    METHOD_FSIN_FCOS,
+    METHOD_FSINCOS,
+    METHOD_FSINCOS_ARRAY,
+    METHOD_SINF_COSF,
+    N_METHODS
+} method_t;
+
+static const char* method_names[] = {"fsin+fcos", "fsincos", "fsincos_array", "sinf+cosf"};
+static const float ranges[] = {M_PI, 100, 1e4};
+
+static void run(method_t method, const float* angles, float* sines, float* cosines, size_t n) {
+    switch (method) {
+        case METHOD_FSIN_FCOS:
+            for (size_t i = 0; i < n; ++i) {
+                sines[i] = fsin(angles[i]);
+                cosines[i] = fcos(angles[i]);
+            }
+            break;
+        case METHOD_FSINCOS:
+            for (size_t i = 0; i < n; ++i)
+                fsincos(angles[i], &sines[i], &cosines[i]);
+            break;
+        case METHOD_FSINCOS_ARRAY:
+            fsincos_array(angles, sines, cosines, n);
+            break;
+        default:
+            for (size_t i = 0; i < n; ++i) {
+                sines[i] = sinf(angles[i]);
+                cosines[i] = cosf(angles[i]);
+            }
+    }
+}
+
+int main(int argc, char** argv) {
+    const size_t n = (argc > 1) ? (size_t)atoi(argv[1]) : BENCH_ANGLES;
+    ftrig_init_lut();
+    float* angles = malloc(sizeof(float) * n);
+    float* sines = malloc(sizeof(float) * n);
+    float* cosines = malloc(sizeof(float) * n);
+
+    printf("%zu angles, ns per sine and cosine, max absolute error\n", n);
+    printf("%-14s", "");
+    for (size_t r = 0; r < sizeof(ranges)/sizeof(ranges[0]); ++r)
+        printf("   +-%-8g  %9s", ranges[r], "error");
+    printf("\n");
+    for (method_t method = 0; method < N_METHODS; ++method) {
+        printf("%-14s", method_names[method]);
+        for (size_t r = 0; r < sizeof(ranges)/sizeof(ranges[0]); ++r) {
+            srand(1);
+            for (size_t i = 0; i < n; ++i)
+                angles[i] = ranges[r] * (2.0f*rand()/RAND_MAX - 1.0f);
+            double best = 1e30;
+            for (int k = 0; k < BENCH_RUNS; ++k) {
+                struct timespec t0;
+                clock_gettime(CLOCK_MONOTONIC, &t0);
+                run(method, angles, sines, cosines, n);
+                const double seconds = ut_secs_since(&t0);
+                best = (seconds < best) ? seconds : best;
+            }
+            double error = 0;
+            for (size_t i = 0; i < n; ++i) {
+                error = fmax(error, fabs(sines[i] - sin(angles[i])));
+                error = fmax(error, fabs(cosines[i] - cos(angles[i])));
+            }
+            printf("   %10.2f  %9.1e", 1e9*best/n, error);
+        }
+        printf("\n");
+    }
+    free(angles);
+    free(sines);
+    free(cosines);
+}
@@ -0,0 +1,208 @@
+#include "vector.h"
+#include "utils.h" // UT_MIN, UT_MAX
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, free, rand, srand
+#include <math.h> // isnan, INFINITY
+
+/*
+ * Checks the batch operations of vector.c against plain loops doing the same
+ * operations in the same order, on random and edge inputs of every length up
+ * to a few vectors' worth, e.g.
+ *     ./12_vector_check
+ * The library runs them with SSE2 by default and with AVX2 if it's built with
+ * make AVX2=1, so build both it and the demos with the same options. Prints
+ * every mismatch and exits with 1 if there is any.
+ */
+
+// lengths checked one by one, covering the remainder loops of 4 and 8 lanes
+#define CHECK_MAX_SHORT 40
+// then a long one
+#define CHECK_LONG 1000
+// random inputs per length
+#define CHECK_ROUNDS 20
+// random coordinates are within +-CHECK_RANGE
+#define CHECK_RANGE 1000.0f
+
+// inputs whose rounding, sign or lack of a value the SIMD paths must keep
+static const float edge_values[] = {0.0f, -0.0f, 1.0f, -1.0f, 1e-30f, -1e-30f, 1e30f, -1e30f,
+                                    1e-40f, 3.4e38f, -3.4e38f, INFINITY, -INFINITY};
+
+static size_t n_checked = 0, n_failed = 0;
+
+static float random_coord() {
+    return CHECK_RANGE * (2.0f*rand()/RAND_MAX - 1.0f);
+}
+
+/* fills the points randomly, sprinkled with edge values unless `plain` */
+static void fill(vec3_soa_t* soa, bool plain) {
+    coord_t* coords[3] = {soa->x, soa->y, soa->z};
+    for (int c = 0; c < 3; ++c)
+        for (size_t i = 0; i < soa->n; ++i) {
+            const bool edge = !plain && rand() % 4 == 0;
+            const float value = edge ? edge_values[rand() % (sizeof(edge_values)/sizeof(edge_values[0]))] :
+                                       random_coord();
+            coords[c][i] = COORD_FROM_FLOAT(value);
+        }
+}
+
+/* same value, any NaN being the same as any other */
+static bool same(coord_t a, coord_t b) {
+#ifdef VEC_FIXED_POINT
+    return a == b;
+#else
+    return a == b || (isnan(a) && isnan(b));
+#endif
+}
+
+static void check(const char* op, size_t n, size_t i, coord_t got, coord_t expected) {
+    ++n_checked;
+    if (same(got, expected))
+        return;
+    ++n_failed;
+    printf("%-14s n=%-5zu [%zu] %.9g instead of %.9g\n", op, n, i, COORD_TO_FLOAT(got),
+           COORD_TO_FLOAT(expected));
+}
+
+static void check_soa(const char* op, vec3_soa_t* got, vec3_soa_t* expected) {
+    for (size_t i = 0; i < got->n; ++i) {
+        check(op, got->n, i, got->x[i], expected->x[i]);
+        check(op, got->n, i, got->y[i], expected->y[i]);
+        check(op, got->n, i, got->z[i], expected->z[i]);
+    }
+}
+
+//-----------------------------------------------------------------------------------
+// The reference, the scalar loops of vector.c
+//-----------------------------------------------------------------------------------
+static void ref_transform(vec3_soa_t* dest, mat34_t* mat, vec3_soa_t* src) {
+    coord_t m[3][4];
+    for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 4; ++c)
+            m[r][c] = COORD_FROM_FLOAT(mat->m[r][c]);
+    for (size_t i = 0; i < src->n; ++i) {
+        const coord_t x = src->x[i], y = src->y[i], z = src->z[i];
+        dest->x[i] = COORD_MUL(m[0][0], x) + COORD_MUL(m[0][1], y) + COORD_MUL(m[0][2], z) + m[0][3];
+        dest->y[i] = COORD_MUL(m[1][0], x) + COORD_MUL(m[1][1], y) + COORD_MUL(m[1][2], z) + m[1][3];
+        dest->z[i] = COORD_MUL(m[2][0], x) + COORD_MUL(m[2][1], y) + COORD_MUL(m[2][2], z) + m[2][3];
+    }
+}
+
+static void ref_dotprod(coord_t* dest, vec3_soa_t* src1, vec3_soa_t* src2) {
+    for (size_t i = 0; i < src1->n; ++i)
+        dest[i] = COORD_MUL(src1->x[i], src2->x[i]) + COORD_MUL(src1->y[i], src2->y[i]) +
+                  COORD_MUL(src1->z[i], src2->z[i]);
+}
+
+static void ref_crossprod(vec3_soa_t* dest, vec3_soa_t* src1, vec3_soa_t* src2) {
+    for (size_t i = 0; i < src1->n; ++i) {
+        const coord_t x1 = src1->x[i], y1 = src1->y[i], z1 = src1->z[i];
+        const coord_t x2 = src2->x[i], y2 = src2->y[i], z2 = src2->z[i];
+        dest->x[i] = COORD_MUL(y1, z2) - COORD_MUL(z1, y2);
+        dest->y[i] = COORD_MUL(z1, x2) - COORD_MUL(x1, z2);
+        dest->z[i] = COORD_MUL(x1, y2) - COORD_MUL(y1, x2);
+    }
+}
+
+static void ref_bounds(vec3c_t* min, vec3c_t* max, vec3_soa_t* src) {
+    *min = *max = (vec3c_t) {src->x[0], src->y[0], src->z[0]};
+    for (size_t i = 1; i < src->n; ++i) {
+        min->x = UT_MIN(min->x, src->x[i]); min->y = UT_MIN(min->y, src->y[i]); min->z = UT_MIN(min->z, src->z[i]);
+        max->x = UT_MAX(max->x, src->x[i]); max->y = UT_MAX(max->y, src->y[i]); max->z = UT_MAX(max->z, src->z[i]);
+    }
+}
+
+static void ref_persp_divide(vec3_soa_t* dest, vec3_soa_t* src, float scale) {
+    const coord_t s = COORD_FROM_FLOAT(scale);
+    for (size_t i = 0; i < src->n; ++i) {
+        const coord_t z = src->z[i];
+#ifdef VEC_FIXED_POINT
+        if (z == 0) {
+            dest->x[i] = dest->y[i] = dest->z[i] = 0;
+            continue;
+        }
+#endif
+        dest->x[i] = COORD_DIV(COORD_MUL(s, src->x[i]), z);
+        dest->y[i] = COORD_DIV(COORD_MUL(s, src->y[i]), z);
+        dest->z[i] = z;
+    }
+}
+
+//-----------------------------------------------------------------------------------
+// The checks
+//-----------------------------------------------------------------------------------
+static void check_length(size_t n, bool plain) {
+    vec3_soa_t* src1 = vec_soa_new(n);
+    vec3_soa_t* src2 = vec_soa_new(n);
+    vec3_soa_t* got = vec_soa_new(n);
+    vec3_soa_t* expected = vec_soa_new(n);
+    coord_t* dots_got = malloc(sizeof(coord_t) * n);
+    coord_t* dots_expected = malloc(sizeof(coord_t) * n);
+    fill(src1, plain);
+    fill(src2, plain);
+
+    mat34_t mat;
+    vec_mat34_from_euler(&mat, random_coord(), random_coord(), random_coord(),
+                         random_coord(), random_coord(), random_coord());
+    vec_batch_transform(got, &mat, src1);
+    ref_transform(expected, &mat, src1);
+    check_soa("transform", got, expected);
+
+    vec_batch_dotprod(dots_got, src1, src2);
+    ref_dotprod(dots_expected, src1, src2);
+    for (size_t i = 0; i < n; ++i)
+        check("dotprod", n, i, dots_got[i], dots_expected[i]);
+
+    vec_batch_crossprod(got, src1, src2);
+    ref_crossprod(expected, src1, src2);
+    check_soa("crossprod", got, expected);
+
+    // with some points at z = 0 on top of the edge values
+    for (size_t i = 0; i < n; ++i)
+        if (rand() % 8 == 0)
+            src1->z[i] = 0;
+    const float scale = random_coord();
+    vec_batch_persp_divide(got, src1, scale);
+    ref_persp_divide(expected, src1, scale);
+    check_soa("persp_divide", got, expected);
+
+    // the edge values hold no NaN, which has no order and so no bounds
+    vec3c_t min_got, max_got, min_expected, max_expected;
+    vec_batch_bounds(&min_got, &max_got, src2);
+    ref_bounds(&min_expected, &max_expected, src2);
+    check("bounds min.x", n, 0, min_got.x, min_expected.x);
+    check("bounds min.y", n, 0, min_got.y, min_expected.y);
+    check("bounds min.z", n, 0, min_got.z, min_expected.z);
+    check("bounds max.x", n, 0, max_got.x, max_expected.x);
+    check("bounds max.y", n, 0, max_got.y, max_expected.y);
+    check("bounds max.z", n, 0, max_got.z, max_expected.z);
+
+    vec_soa_free(src1);
+    vec_soa_free(src2);
+    vec_soa_free(got);
+    vec_soa_free(expected);
+    free(dots_got);
+    free(dots_expected);
+}
+
+int main() {
+#if defined(VEC_FIXED_POINT) || defined(VEC_SCALAR)
+    const char* path = "scalar";
+#elif defined(__AVX2__)
+    const char* path = "AVX2";
+#elif defined(__SSE2__)
+    const char* path = "SSE2";
+#else
+    const char* path = "scalar";
+#endif
+    srand(1);
+    for (int round = 0; round < CHECK_ROUNDS; ++round) {
+        for (size_t n = 1; n <= CHECK_MAX_SHORT; ++n) {
+            check_length(n, true);
+            check_length(n, false);
+        }
+        check_length(CHECK_LONG, true);
+        check_length(CHECK_LONG, false);
+    }
+    printf("%s against scalar: %zu of %zu values differ\n", path, n_failed, n_checked);
+    return n_failed > 0;
+}
@@ -0,0 +1,152 @@
+#include "objects.h"
+#include "arena.h"
+#include "arg_parser.h" // CFG_DIR, STRINGIFY
+#include "xtrig.h" // ftrig_init_lut
+#include "utils.h" // ut_secs_since
+#include <stdio.h> // printf, snprintf
+#include <stdlib.h> // malloc, free, atoi
+#include <time.h> // clock_gettime
+
+/*
+ * Times loading and freeing many meshes with arenas - one per mesh, as
+ * `obj_mesh_from_file` gives them, or one shared by all - against the
+ * malloc per vertex and per face meshes used to take, e.g.
+ *     ./13_arena [meshes]
+ * Loading is mostly parsing the file or generating the mesh, so the malloc
+ * per element columns give what the allocations cost on their own: they make
+ * and free the same allocations the meshes did before arenas, for as many
+ * vertices and faces, without building anything in them.
+ */
+
+// meshes loaded per run unless given
+#define BENCH_MESHES 10000
+// times each way runs, the fastest run counts
+#define BENCH_RUNS 5
+#define BENCH_SIZE 100
+#define BENCH_SPHERE_FACES 100
+
+typedef enum way {
+    // a mesh a time, each with its own arena
+    WAY_OWN_ARENA,
+    // every mesh from the same arena
+    WAY_SHARED_ARENA
+} way_t;
+
+// what a mesh allocated before arenas
+typedef struct mallocd_mesh {
+    vec3i_t* center;
+    vec3i_t** vertices;
+    int** connections;
+    vec3_soa_t* vertices_local;
+    vec3_soa_t* vertices_world;
+    size_t n_vertices, n_faces;
+} mallocd_mesh_t;
+
+/* loads the coffin, or generates a sphere if `fpath` is NULL */
+static mesh_t* load(arena_t* arena, const char* fpath) {
+    return (fpath != NULL) ?
+        obj_mesh_from_file_in(arena, fpath, 0, 0, 0, BENCH_SIZE, BENCH_SIZE, BENCH_SIZE) :
+        obj_sphere_new_in(arena, 0, 0, 0, BENCH_SIZE, BENCH_SIZE, BENCH_SIZE, BENCH_SPHERE_FACES);
+}
+
+/* loads and frees `n_meshes` meshes one way, gives the best seconds of each */
+static void time_way(way_t way, const char* fpath, mesh_t** meshes, size_t n_meshes,
+                     double* t_load, double* t_free) {
+    *t_load = *t_free = 1e30;
+    for (int k = 0; k < BENCH_RUNS; ++k) {
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        arena_t* arena = (way == WAY_SHARED_ARENA) ? arena_new(1 << 20) : NULL;
+        for (size_t i = 0; i < n_meshes; ++i)
+            meshes[i] = load(arena, fpath);
+        const double seconds_load = ut_secs_since(&t0);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (arena != NULL)
+            arena_free(arena);
+        else
+            for (size_t i = 0; i < n_meshes; ++i)
+                obj_mesh_free(meshes[i]);
+        const double seconds_free = ut_secs_since(&t0);
+        *t_load = (seconds_load < *t_load) ? seconds_load : *t_load;
+        *t_free = (seconds_free < *t_free) ? seconds_free : *t_free;
+    }
+}
+
+static void mallocd_mesh_alloc(mallocd_mesh_t* mesh, size_t n_vertices, size_t n_faces) {
+    mesh->center = malloc(sizeof(vec3i_t));
+    mesh->vertices = malloc(sizeof(vec3i_t*) * n_vertices);
+    for (size_t i = 0; i < n_vertices; ++i) {
+        mesh->vertices[i] = malloc(sizeof(vec3i_t));
+        *mesh->vertices[i] = (vec3i_t) {0, 0, 0};
+    }
+    mesh->connections = malloc(sizeof(int*) * n_faces);
+    for (size_t i = 0; i < n_faces; ++i) {
+        mesh->connections[i] = malloc(sizeof(int) * 6);
+        mesh->connections[i][0] = 0;
+    }
+    mesh->vertices_local = vec_soa_new(n_vertices);
+    mesh->vertices_world = vec_soa_new(n_vertices);
+    mesh->n_vertices = n_vertices;
+    mesh->n_faces = n_faces;
+}
+
+static void mallocd_mesh_free(mallocd_mesh_t* mesh) {
+    for (size_t i = 0; i < mesh->n_vertices; ++i)
+        free(mesh->vertices[i]);
+    free(mesh->vertices);
+    vec_soa_free(mesh->vertices_local);
+    vec_soa_free(mesh->vertices_world);
+    for (size_t i = 0; i < mesh->n_faces; ++i)
+        free(mesh->connections[i]);
+    free(mesh->connections);
+    free(mesh->center);
+}
+
+/* makes and frees the allocations of `n_meshes` meshes of malloc per vertex and per face */
+static void time_mallocs(size_t n_vertices, size_t n_faces, size_t n_meshes, double* t_alloc, double* t_free) {
+    mallocd_mesh_t* meshes = malloc(sizeof(mallocd_mesh_t) * n_meshes);
+    *t_alloc = *t_free = 1e30;
+    for (int k = 0; k < BENCH_RUNS; ++k) {
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (size_t i = 0; i < n_meshes; ++i)
+            mallocd_mesh_alloc(&meshes[i], n_vertices, n_faces);
+        const double seconds_alloc = ut_secs_since(&t0);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (size_t i = 0; i < n_meshes; ++i)
+            mallocd_mesh_free(&meshes[i]);
+        const double seconds_free = ut_secs_since(&t0);
+        *t_alloc = (seconds_alloc < *t_alloc) ? seconds_alloc : *t_alloc;
+        *t_free = (seconds_free < *t_free) ? seconds_free : *t_free;
+    }
+    free(meshes);
+}
+
+static void bench(const char* name, const char* fpath, size_t n_meshes) {
+    mesh_t** meshes = malloc(sizeof(mesh_t*) * n_meshes);
+    mesh_t* sample = load(NULL, fpath);
+    const size_t n_vertices = sample->n_vertices, n_faces = sample->n_faces;
+    obj_mesh_free(sample);
+    double t_load_own, t_free_own, t_load_shared, t_free_shared, t_alloc_mallocs, t_free_mallocs;
+    time_way(WAY_OWN_ARENA, fpath, meshes, n_meshes, &t_load_own, &t_free_own);
+    time_way(WAY_SHARED_ARENA, fpath, meshes, n_meshes, &t_load_shared, &t_free_shared);
+    time_mallocs(n_vertices, n_faces, n_meshes, &t_alloc_mallocs, &t_free_mallocs);
+    printf("%-12s %6zu %6zu %10.1f %10.2f %10.1f %10.2f %10.1f %10.2f\n", name, n_vertices, n_faces,
+           1e3*t_load_own, 1e3*t_free_own, 1e3*t_load_shared, 1e3*t_free_shared,
+           1e3*t_alloc_mallocs, 1e3*t_free_mallocs);
+    free(meshes);
+}
+
+int main(int argc, char** argv) {
+    const size_t n_meshes = (argc > 1) ? (size_t)atoi(argv[1]) : BENCH_MESHES;
+    ftrig_init_lut();
+    char fpath[512];
+    snprintf(fpath, sizeof(fpath), "%s/%s", STRINGIFY(CFG_DIR), "coffin.scl");
+
+    printf("%zu meshes, best of %d, in ms\n", n_meshes, BENCH_RUNS);
+    printf("%-12s %6s %6s %21s %21s %21s\n", "", "", "", "own arena", "shared arena", "malloc per element");
+    printf("%-12s %6s %6s %10s %10s %10s %10s %10s %10s\n", "mesh", "verts", "faces",
+           "load", "free", "load", "free", "alloc", "free");
+    bench("coffin.scl", fpath, n_meshes);
+    bench("sphere:100", NULL, n_meshes);
+}
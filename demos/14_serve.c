@@ -0,0 +1,132 @@
+#include "objects.h"
+#include "renderer.h"
+#include "screen.h"
+#include "sink.h" // sink_from_spec, sink_write
+#include "arg_parser.h" // CFG_DIR, STRINGIFY
+#include "xtrig.h" // ftrig_init_lut
+#include "utils.h" // ut_secs_since
+#include <sys/socket.h> // socket, connect, recv
+#include <sys/un.h> // sockaddr_un
+#include <sys/resource.h> // getrlimit, setrlimit
+#include <unistd.h> // close, getpid
+#include <stdio.h> // printf, snprintf
+#include <stdlib.h> // malloc, free, atoi
+#include <string.h> // strcpy
+#include <time.h> // clock_gettime
+
+/*
+ * Times serving frames to a growing number of local subscribers against
+ * rendering them, e.g.
+ *     ./14_serve [frames]
+ * The frames of a spinning cube are rendered once, then written to a serve
+ * sink with 0 to 1000 clients connected over a Unix domain socket. Only the
+ * writes are timed - the clients are drained between them, so none falls
+ * behind and resyncs. It prints the microseconds per frame of serving them
+ * and what each client adds, next to those of rendering a frame, i.e. of a
+ * renderer per terminal.
+ */
+
+// frames served per number of clients unless given
+#define BENCH_FRAMES 1000
+#define BENCH_ROWS 40
+#define BENCH_COLS 120
+
+static const size_t client_counts[] = {0, 1, 10, 100, 1000};
+
+/* renders the frames of a spinning cube, gives the seconds per frame */
+static double render_frames(color_t* frames, size_t n_frames) {
+    color_t* pixels = malloc(sizeof(color_t) * BENCH_ROWS * BENCH_COLS);
+    int* depth = malloc(sizeof(int) * BENCH_ROWS * BENCH_COLS);
+    screen_t screen;
+    renderer_t renderer = {0};
+    screen_init_offscreen_r(&screen, BENCH_ROWS, BENCH_COLS, 16.0/9.0, pixels);
+    render_init_offscreen_r(&renderer, &screen, depth);
+    char fpath[512];
+    snprintf(fpath, sizeof(fpath), "%s/%s", STRINGIFY(CFG_DIR), "cube.scl");
+    mesh_t* cube = obj_mesh_from_file(fpath, 0, 0, 0, 50, 50, 50);
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (size_t t = 0; t < n_frames; ++t) {
+        render_clear_r(&renderer);
+        obj_mesh_rotate_to(cube, 0.035*t, 0.02*t, 0.03*t);
+        render_write_shape_r(&renderer, cube);
+        memcpy(&frames[t * BENCH_ROWS * BENCH_COLS], pixels, sizeof(color_t) * BENCH_ROWS * BENCH_COLS);
+    }
+    const double seconds = ut_secs_since(&t0);
+    obj_mesh_free(cube);
+    render_end_r(&renderer);
+    free(pixels);
+    free(depth);
+    return seconds/n_frames;
+}
+
+/* reads whatever the clients were sent, so that their sockets never fill */
+static void drain(const int* clients, size_t n_clients) {
+    char discard[1 << 14];
+    for (size_t i = 0; i < n_clients; ++i)
+        while (recv(clients[i], discard, sizeof(discard), MSG_DONTWAIT) > 0);
+}
+
+/* serves the frames to `n_clients` clients, gives the seconds per frame */
+static double serve_frames(const color_t* frames, size_t n_frames, size_t n_clients) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/retrocube_bench_%d.sock", (int)getpid());
+    char spec[80];
+    snprintf(spec, sizeof(spec), "serve:%s", path);
+    sink_t* server = sink_from_spec(spec);
+    if (server == NULL)
+        return -1;
+    int* clients = malloc(sizeof(int) * (n_clients + 1));
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strcpy(addr.sun_path, path);
+    for (size_t i = 0; i < n_clients; ++i) {
+        clients[i] = socket(AF_UNIX, SOCK_STREAM, 0);
+        connect(clients[i], (struct sockaddr*) &addr, sizeof(addr));
+    }
+    // the first frame accepts everyone and sends them a keyframe
+    sink_write(server, frames, BENCH_ROWS, BENCH_COLS);
+    drain(clients, n_clients);
+    double seconds = 0;
+    for (size_t t = 1; t < n_frames; ++t) {
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        sink_write(server, &frames[t * BENCH_ROWS * BENCH_COLS], BENCH_ROWS, BENCH_COLS);
+        seconds += ut_secs_since(&t0);
+        drain(clients, n_clients);
+    }
+    for (size_t i = 0; i < n_clients; ++i)
+        close(clients[i]);
+    free(clients);
+    sink_free(server);
+    return seconds/(n_frames - 1);
+}
+
+int main(int argc, char** argv) {
+    const size_t n_frames = (argc > 1) ? (size_t)atoi(argv[1]) : BENCH_FRAMES;
+    ftrig_init_lut();
+    // a client takes a socket at each end
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    color_t* frames = malloc(sizeof(color_t) * n_frames * BENCH_ROWS * BENCH_COLS);
+    const double render = render_frames(frames, n_frames);
+    printf("%d x %d, %zu frames, us per frame\n", BENCH_ROWS, BENCH_COLS, n_frames);
+    printf("render %.1f\n", 1e6*render);
+    printf("%8s %10s %12s\n", "clients", "serve", "per client");
+    const double serve_alone = serve_frames(frames, n_frames, 0);
+    for (size_t i = 0; i < sizeof(client_counts)/sizeof(client_counts[0]); ++i) {
+        const size_t n_clients = client_counts[i];
+        if (2*n_clients + 16 > limit.rlim_cur) {
+            printf("%8zu %10s\n", n_clients, "too few file descriptors");
+            continue;
+        }
+        const double serve = (n_clients == 0) ? serve_alone : serve_frames(frames, n_frames, n_clients);
+        if (n_clients == 0)
+            printf("%8zu %10.1f %12s\n", n_clients, 1e6*serve, "");
+        else
+            printf("%8zu %10.1f %12.2f\n", n_clients, 1e6*serve, 1e6*(serve - serve_alone)/n_clients);
+    }
+    free(frames);
+}
@@ -0,0 +1,84 @@
+#include "objects.h"
+#include "renderer.h"
+#include "export.h"
+#include "xtrig.h" // ftrig_init_lut
+#include "utils.h" // ut_secs_since
+#include <unistd.h> // sysconf
+#include <stdio.h> // printf
+#include <stdlib.h> // atoi
+#include <time.h> // clock_gettime
+
+/*
+ * Times exporting frames with 1, 2, 4 and one thread per core, e.g.
+ *     ./15_export_scaling [frames]
+ * Frames are rendered, encoded and written to /dev/null, as raw characters
+ * and as PPM images, whose encoding takes longer than rendering small
+ * meshes. It prints the frames per second of each thread count and how much
+ * faster than one thread it is. Each job reports its own run to stderr too.
+ */
+
+// frames exported per run unless given
+#define BENCH_FRAMES 300
+#define BENCH_ROWS 40
+#define BENCH_COLS 120
+#define BENCH_SIZE 50
+
+static const char* meshes[] = {"cube:600", "sphere:1000"};
+
+static void pose(mesh_t* mesh, size_t t, void* user) {
+    obj_mesh_rotate_to(mesh, 0.035*t, 0.02*t, 0.03*t);
+}
+
+/* exports the frames with `n_threads` threads, gives the frames per second */
+static double frames_per_sec(export_job_t* job, unsigned n_threads) {
+    job->n_threads = n_threads;
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (!export_run(job, "/dev/null"))
+        return 0;
+    return job->n_frames/ut_secs_since(&t0);
+}
+
+int main(int argc, char** argv) {
+    const size_t n_frames = (argc > 1) ? (size_t)atoi(argv[1]) : BENCH_FRAMES;
+    const long n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    ftrig_init_lut();
+    unsigned thread_counts[] = {1, 2, 4, (n_cores > 0) ? n_cores : 1};
+    // one per core only if it's more than 4
+    const size_t n_counts = (thread_counts[3] > 4) ? 4 : 3;
+
+    printf("%d x %d, %zu frames, %ld cores, frames/s and speedup over 1 thread\n",
+           BENCH_ROWS, BENCH_COLS, n_frames, n_cores);
+    printf("%-14s %-6s", "mesh", "format");
+    for (size_t i = 0; i < n_counts; ++i)
+        printf(" %7s%-2u %6s", "-j ", thread_counts[i], "");
+    printf("\n");
+    for (size_t m = 0; m < sizeof(meshes)/sizeof(meshes[0]); ++m) {
+        mesh_t* mesh = obj_mesh_generate(meshes[m], 0, 0, 0, BENCH_SIZE, BENCH_SIZE, BENCH_SIZE);
+        const export_format_t formats[] = {EXPORT_RAW, EXPORT_PPM};
+        const char* format_names[] = {"raw", "ppm"};
+        for (size_t f = 0; f < sizeof(formats)/sizeof(formats[0]); ++f) {
+            export_job_t job = {
+                .mesh = mesh,
+                .pose = pose,
+                .t_first = 0,
+                .n_frames = n_frames,
+                .rows = BENCH_ROWS,
+                .cols = BENCH_COLS,
+                .screen_res = 16.0/9.0,
+                .format = formats[f]
+            };
+            printf("%-14s %-6s", meshes[m], format_names[f]);
+            fflush(stdout);
+            double single = 0;
+            for (size_t i = 0; i < n_counts; ++i) {
+                const double fps = frames_per_sec(&job, thread_counts[i]);
+                single = (i == 0) ? fps : single;
+                printf(" %9.0f %5.2fx", fps, fps/single);
+                fflush(stdout);
+            }
+            printf("\n");
+        }
+        obj_mesh_free(mesh);
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h> // size_t
+
+// alignment of every allocation, enough for any type the project stores
+#define ARENA_ALIGNMENT 16
+
+/* block of memory that allocations are carved from, in order */
+typedef struct arena_block {
+    struct arena_block* next;
+    size_t size;
+    size_t used;
+} arena_block_t;
+
+/*
+ * Region allocator. Allocating bumps a pointer in the current block and
+ * starts a new block when it's full. Nothing is freed individually, the
+ * whole arena is released at once. Meshes allocate everything they own from
+ * one, so a mesh - or a whole scene sharing an arena - is freed in one go.
+ */
+typedef struct arena {
+    // most recent block, allocations come from it
+    arena_block_t* head;
+    // size of new blocks, unless an allocation needs more
+    size_t block_size;
+} arena_t;
+
+/**
+ * @brief Allocates an arena
+ *
+ * @param block_size Size in bytes of its blocks. If everything that will be
+ *                   allocated fits in one, the arena makes a single malloc.
+ *
+ * @return A pointer to the newly constructed arena
+ */
+arena_t*    arena_new       (size_t block_size);
+/**
+ * @brief Allocates `size` bytes aligned to ARENA_ALIGNMENT from an arena
+ */
+void*       arena_alloc     (arena_t* arena, size_t size);
+/**
+ * @brief Frees every allocation of the arena and the arena itself
+ */
+void        arena_free      (arena_t* arena);
+/**
+ * @brief Rounds a size up to the alignment of the arena's allocations - sum
+ *        it over the allocations to find a block size that fits them all
+ */
+size_t      arena_aligned_size (size_t size);
+
+#endif /* ARENA_H */
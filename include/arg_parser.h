@@ -27,6 +27,8 @@ extern unsigned g_depth;
 // how many frames to run the program for
 extern unsigned g_max_iterations;
 extern char g_mesh_file[256];
+// shape to generate instead of reading `g_mesh_file`, see `obj_mesh_generate()` - empty if not
+extern char g_generate[256];
 // defines the max and min values of random rotation bias
 extern float rand_min;
 // random rotation biases - the higher, the faster the rotation around x, y,
@@ -41,5 +43,27 @@ extern unsigned g_bounce_every;
 extern int g_move_x;
 extern int g_move_y;
 extern int g_move_z;
+// where frames go, see `sink_from_spec()` - "tty", "raw:<path>", "ring:<n_frames>", "rec:<path>",
+// "shm:<name>[:<n_slots>]", "serve:<path>", "serve:tcp:<port>" or "null"
+extern char g_output[256];
+// render frames offline to "<format>:<path>" instead, see `export_parse_spec()` - empty if not
+extern char g_export[256];
+// first frame to export, the last one is before `g_max_iterations`
+extern unsigned g_export_from;
+// threads that render exported frames, 0 for one per core
+extern unsigned g_jobs;
+// MiB of rendered frames to keep and reuse when the pose repeats, 0 for none
+extern float g_cache_mib;
+// whether to lower the detail when frames take longer than 1/`g_fps`
+extern bool g_use_adaptive_quality;
+// levels of detail to simplify large meshes into, 0 for none
+extern unsigned g_lod_levels;
+// asciicast file to play back instead of rendering, empty if none
+extern char g_play_file[256];
+// how many times faster than recorded to play it back, 0 for as fast as possible
+extern float g_play_speed;
+// size of the frames in characters, 0 for the terminal's
+extern int g_screen_rows;
+extern int g_screen_cols;
 
 void arg_parse(int argc, char** argv);
@@ -0,0 +1,124 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "objects.h" // mesh_t, color_t
+#include <stdbool.h> // bool
+#include <stddef.h> // size_t
+#include <stdio.h> // FILE
+
+// bytes of budget per bucket of the hash table, i.e. the smallest frame expected
+#define CACHE_BYTES_PER_BUCKET 512
+
+// largest ratio of the fastest speed of a spin to their common one, see `cache_spin_init`
+#define CACHE_MAX_SPIN_RATIO 100
+
+/*
+ * Frames stored by the state they were rendered for, so a periodic animation
+ * is only rendered until its cycle has been seen. The state is where a
+ * spinning mesh is in its cycle and where it is. Frames are run-length
+ * encoded - mostly they're background - and the least recently used are
+ * evicted to stay under a memory budget. After the hash table, allocated
+ * upfront, each frame stored is a single allocation.
+ */
+typedef struct cache_key {
+    // bin of the spin's phase, in [0, ratio*LUT_SIZE), see `cache_spin_t`
+    long phase;
+    // center of the mesh
+    int x, y, z;
+    // sampling step of the renderer, see `renderer_t::sample_step`
+    unsigned sample_step;
+} cache_key_t;
+
+/*
+ * Spinning around x, y and z at constant speeds, which repeats only if they're
+ * multiples of a common speed: each angle is then its multiple of a phase that
+ * turns at the common speed, and the pose repeats whenever the phase does. The
+ * phase is binned `ratio` times finer than the sine LUT, so that within a bin
+ * no angle moves by more than a bin of the LUT - the precision `fsincos`
+ * samples it at.
+ */
+typedef struct cache_spin {
+    // speed all speeds are multiples of, in radians per frame
+    double speed;
+    // multiple of it the fastest speed is
+    int ratio;
+} cache_spin_t;
+
+typedef struct cache_stats {
+    size_t n_hits;
+    size_t n_misses;
+    size_t n_stored;
+    size_t n_evicted;
+    size_t n_entries;
+    // of the encoded frames and their entries, and what they'd take unencoded
+    size_t bytes;
+    size_t bytes_peak;
+    size_t bytes_raw;
+} cache_stats_t;
+
+struct cache_entry;
+
+typedef struct cache {
+    // chains of entries by hash, a power of 2 of them
+    struct cache_entry** buckets;
+    size_t n_buckets;
+    // most and least recently used entries
+    struct cache_entry* newest;
+    struct cache_entry* oldest;
+    size_t budget;
+    cache_stats_t stats;
+    // scratch for encoding a frame, sized for the worst case
+    unsigned char* scratch;
+    size_t scratch_size;
+} cache_t;
+
+/**
+ * @brief Creates a cache
+ *
+ * @param budget Bytes the frames and their entries may take at most
+ *
+ * @return A pointer to the cache
+ */
+cache_t*        cache_new           (size_t budget);
+/**
+ * @brief Finds the common speed of a spin, if the fastest speed is at most
+ *        CACHE_MAX_SPIN_RATIO times it - otherwise the cycle is too long to
+ *        ever repeat, or there is none
+ *
+ * @param[out] spin    Spin to set
+ * @param      speed_x Speed around x in radians per frame
+ * @param      speed_y Speed around y in radians per frame
+ * @param      speed_z Speed around z in radians per frame
+ *
+ * @return false if the spin doesn't repeat
+ */
+bool            cache_spin_init     (cache_spin_t* spin, float speed_x, float speed_y, float speed_z);
+/**
+ * @brief The state of a spinning mesh a frame is cached by - only where it is
+ *        in its cycle at frame `t`, where it is and the detail it's rendered
+ *        at are considered, the mesh itself and the camera must not change
+ */
+cache_key_t     cache_key_of_spin   (const cache_spin_t* spin, size_t t, const mesh_t* mesh,
+                                     unsigned sample_step);
+/**
+ * @brief Looks up a frame and decodes it if it's there
+ *
+ * @param cache Cache to look in
+ * @param key   State of the frame
+ * @param frame Where to decode the `rows*cols` characters of the frame
+ *
+ * @return true if the frame was found, false if it has to be rendered
+ */
+bool            cache_get           (cache_t* cache, cache_key_t key, color_t* frame, int rows, int cols);
+/**
+ * @brief Stores a frame, evicting the least recently used ones if needed.
+ *        Frames larger than the whole budget aren't stored.
+ */
+void            cache_put           (cache_t* cache, cache_key_t key, const color_t* frame, int rows, int cols);
+/**
+ * @brief Prints the hit rate and the memory used
+ */
+void            cache_report        (cache_t* cache, FILE* stream);
+void            cache_free          (cache_t* cache);
+
+#endif /* CACHE_H */
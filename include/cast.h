@@ -0,0 +1,38 @@
+#ifndef CAST_H
+#define CAST_H
+
+#include "sink.h"
+#include <stdbool.h> // bool
+
+/*
+ * Recording and playback of asciicast v2 files, the format of asciinema:
+ * a JSON header line followed by one line per output event,
+ *     {"version": 2, "width": 120, "height": 40, "timestamp": 1700000000}
+ *     [0.000000, "o", "\u001b[H\u001b[J\u001b[1;1H...."]
+ *     [0.025013, "o", "\u001b[12;40H#O\u001b[13;39H&&&"]
+ * Each event is delta-encoded - it only rewrites the runs of characters that
+ * changed since the previous frame. Both directions stream, so their memory
+ * depends on the frame size, not on the length of the session.
+ */
+
+/**
+ * @brief Creates a sink that records frames to an asciicast v2 file. When
+ *        it's freed, it reports to stderr how long encoding took per frame.
+ *
+ * @param path File to write to
+ *
+ * @return A pointer to the sink or NULL if the file can't be opened
+ */
+sink_t*     cast_sink_new       (const char* path);
+/**
+ * @brief Plays an asciicast v2 file back on stdout. Ctrl+C stops it.
+ *
+ * @param path  File to play
+ * @param speed How many times faster than recorded to play it, 0 for as
+ *              fast as possible
+ *
+ * @return false if the file can't be opened or isn't asciicast v2
+ */
+bool        cast_play           (const char* path, float speed);
+
+#endif /* CAST_H */
@@ -0,0 +1,80 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "objects.h" // mesh_t
+#include "renderer.h" // renderer_t
+#include <stdbool.h> // bool
+#include <stddef.h> // size_t
+
+// width and height in pixels of a character in PPM and Y4M frames - glyphs
+// are 8x8 with each row drawn twice, since terminal cells are about 1:2
+#define EXPORT_CELL_WIDTH 8
+#define EXPORT_CELL_HEIGHT 16
+// frames that can wait to be written per worker, e.g. behind a slow one
+#define EXPORT_SLOTS_PER_THREAD 2
+
+/*
+ * Offline rendering of a range of frames. Each frame must be a function of
+ * its number alone, so frames are rendered in parallel, by as many workers
+ * as there are cores, each with its own copy of the mesh, screen and
+ * renderer. Workers also encode the frames, then a reorder buffer of
+ * EXPORT_SLOTS_PER_THREAD slots per worker hands them to the writer in order.
+ */
+typedef enum export_format {
+    // rows*cols characters per frame, like the raw sink
+    EXPORT_RAW = 0,
+    // binary PPM images back to back, white glyphs on black, e.g. for
+    // `ffmpeg -f image2pipe -c:v ppm -i frames.ppm out.mp4`
+    EXPORT_PPM,
+    // YUV4MPEG2 video, the same images in grayscale
+    EXPORT_Y4M
+} export_format_t;
+
+typedef struct export_job {
+    // copied by each worker, only read
+    const mesh_t* mesh;
+    // places a mesh the way it is in frame `t`
+    void (*pose)(mesh_t* mesh, size_t t, void* user);
+    void* user;
+    // frames `t_first` to `t_first + n_frames - 1`
+    size_t t_first;
+    size_t n_frames;
+    int rows;
+    int cols;
+    // screen resolution (width over height) the frames are drawn for
+    float screen_res;
+    // configured with the `_use_` functions but not initialised - each worker
+    // starts from a copy of it
+    renderer_t settings;
+    export_format_t format;
+    // frame rate in the Y4M header
+    unsigned fps;
+    // 0 for one per online core - there are never more than frames
+    unsigned n_threads;
+} export_job_t;
+
+/**
+ * @brief Parses an export description, as given on the command line:
+ *        "raw:<path>", "ppm:<path>" or "y4m:<path>", where the path is a file,
+ *        a named pipe or "-" for stdout
+ *
+ * @param spec   Description to parse
+ * @param format Set to the format
+ * @param path   Set to the path in `spec`
+ *
+ * @return false if the description is invalid
+ */
+bool        export_parse_spec   (const char* spec, export_format_t* format, const char** path);
+/**
+ * @brief Renders and writes the frames of a job. When it's done, it reports to
+ *        stderr how long it took.
+ *
+ * @param job  What to render
+ * @param path File or named pipe to write to, or "-" for stdout
+ *
+ * @return false if the file can't be opened or written, or a worker can't
+ *         be started
+ */
+bool        export_run          (const export_job_t* job, const char* path);
+
+#endif /* EXPORT_H */
@@ -0,0 +1,64 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include "objects.h" // mesh_t
+#include <stddef.h> // size_t
+
+// meshes with fewer faces aren't simplified, they cost about what a cube does
+#define LOD_MIN_FACES 64
+// most levels built below the mesh itself
+#define LOD_MAX_LEVELS 8
+// each level has about this many times fewer triangles than the one above
+#define LOD_RATIO 4
+// coarsest level built, in triangles
+#define LOD_COARSEST_FACES 16
+// samples the renderer shades per face of the level it picks, at least
+#define LOD_SAMPLES_PER_FACE 16
+// weight of the planes that keep open borders, e.g. of a heightfield, in place
+#define LOD_BORDER_WEIGHT 1000.0
+
+/*
+ * Levels of detail of a mesh, built by quadric error edge collapse (Garland &
+ * Heckbert). Each vertex carries the sum of the squared distances to the
+ * planes of the faces around it, as a quadric, and the edge whose collapse
+ * into one vertex adds the least error is collapsed first, into the point
+ * that minimises it. Quads are split into triangles. One pass over the mesh
+ * takes a snapshot each time the triangles drop to the next level's target,
+ * and the renderer draws the coarsest level that still has a face every
+ * LOD_SAMPLES_PER_FACE samples on the screen, so the cost of a mesh follows
+ * its size on the screen rather than its number of faces.
+ */
+
+/**
+ * @brief Simplifies a mesh into a new one with its own arena, in the mesh's
+ *        rest pose, center and orientation
+ *
+ * @param mesh    Mesh to simplify - only read
+ * @param n_faces Triangles to collapse edges down to - there may be more if
+ *                no edge can be collapsed without flipping a face
+ *
+ * @return A pointer to the simplified mesh, to be freed with `obj_mesh_free`
+ */
+mesh_t*     lod_simplify        (const mesh_t* mesh, size_t n_faces);
+/**
+ * @brief Builds the levels of detail of a mesh into `mesh_t::lods`, each with
+ *        LOD_RATIO times fewer triangles than the last, down to
+ *        LOD_COARSEST_FACES. Does nothing for meshes with fewer than
+ *        LOD_MIN_FACES faces or that already have levels.
+ *
+ * @param mesh     Mesh to build the levels of
+ * @param n_levels Levels to build at most, up to LOD_MAX_LEVELS
+ */
+void        lod_build           (mesh_t* mesh, size_t n_levels);
+/**
+ * @brief Picks the level of detail to draw a mesh with and gives it the
+ *        mesh's pose
+ *
+ * @param mesh      Mesh to draw
+ * @param n_samples Samples the renderer shades across the mesh's bounding box
+ *
+ * @return The mesh itself or one of its levels
+ */
+mesh_t*     lod_select          (mesh_t* mesh, float n_samples);
+
+#endif /* LOD_H */
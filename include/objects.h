@@ -2,6 +2,7 @@
 #define OBJECTS_H 
 
 #include "vector.h"
+#include "arena.h"
 #include <stdbool.h> // true/false
 #include <math.h> // round
 #include <stddef.h> // size_t
@@ -14,10 +15,71 @@ enum connection_t {
 
 typedef char color_t;
 
+// meshes loaded from files with at least this many faces get a face BVH
+#define OBJ_BVH_MIN_FACES  64
+// maximum number of faces in a leaf of the face BVH
+#define OBJ_BVH_LEAF_SIZE  4
+
+typedef struct face_bvh_node {
+    // bounds of the faces under this node on the xy plane, where rays are shot
+    int x0, y0;
+    int x1, y1;
+    // leaves: index of their first face in `faces`, else index of the left child
+    // (the right child follows it)
+    unsigned start;
+    // number of faces in a leaf, 0 for internal nodes
+    unsigned count;
+} face_bvh_node_t;
+
+/*
+ * Bounding volume hierarchy over the faces of a mesh. It's built once from
+ * the 3D positions of the faces so that nearby faces share nodes no matter
+ * how the mesh is rotated later. When the mesh moves, only the bounds of the
+ * nodes are recomputed (refit).
+ */
+typedef struct face_bvh {
+    face_bvh_node_t* nodes;
+    size_t n_nodes;
+    // face indexes, each leaf references a contiguous range of it in ascending order
+    unsigned* faces;
+    // faces whose bounds contain the last queried point, in ascending order
+    unsigned* hits;
+    // as large as `hits`, what the query merges the hits of each leaf into
+    unsigned* hits_tmp;
+    // whether the vertices moved since the last refit
+    bool is_stale;
+} face_bvh_t;
+
+/*
+ * Position and orientation of a mesh. The renderer maps the rest pose of the
+ * mesh to world space with it once per change, in `obj_mesh_apply_transform`.
+ */
+typedef struct transform {
+    // rotation around the x axis, then y, then z about the mesh's center
+    float angle_x_rad;
+    float angle_y_rad;
+    float angle_z_rad;
+    // whether the world space vertices are out of date
+    bool is_dirty;
+    // whether they're out of date although the pose was drawn, because a level
+    // of detail was drawn in place of the mesh, see `lod_select`
+    bool is_stale;
+} transform_t;
+
 typedef struct mesh {
+    // vertices in world space - computed from `vertices_local` and `transform`
     vec3i_t** vertices;
-    vec3i_t** vertices_backup;
+    // rest pose of the vertices relative to `center`, never modified after construction
+    vec3_soa_t* vertices_local;
+    // `vertices` before they're rounded - scratch for the batch transform
+    vec3_soa_t* vertices_world;
+    // tight bounds of `vertices`, valid after `obj_mesh_apply_transform`
+    vec3i_t vertices_min, vertices_max;
+    // longest distance between two vertices of the same face - doesn't change with the pose
+    float max_face_diameter;
+    // position of the mesh in world space
     vec3i_t* center;
+    transform_t transform;
     // number of vertices
     size_t n_vertices;
     // number of surfaces
@@ -44,6 +106,25 @@ typedef struct mesh {
      * and painted with the 'o' character.
      */
     int** connections;
+    // optional, accelerates finding the faces a ray can hit - NULL if not used
+    face_bvh_t* face_bvh;
+    // optional, the edges of the faces as pairs of vertex indices back to
+    // back, each edge shared by several faces once - NULL if not found, see
+    // `obj_mesh_build_edges`
+    int* edges;
+    size_t n_edges;
+    // optional, simplified versions of the mesh from finest to coarsest, each
+    // with its own arena - NULL if it has none, see `lod_build`
+    struct mesh** lods;
+    size_t n_lods;
+    // spatial index the mesh is in and its proxy there, updated whenever the
+    // mesh moves - NULL if it's in none, see `spatial_insert`
+    struct spatial* index;
+    int proxy;
+    // where all of the above is allocated from
+    arena_t* arena;
+    // whether the arena is the mesh's own, otherwise it's shared, e.g. by a scene
+    bool owns_arena;
 } mesh_t;
 
 typedef struct ray {
@@ -61,6 +142,26 @@ typedef struct camera {
     float focal_length;
 } camera_t;
 
+enum frustum_plane_t {
+    FRUSTUM_NEAR=0,
+    FRUSTUM_LEFT,
+    FRUSTUM_RIGHT,
+    FRUSTUM_BOTTOM,
+    FRUSTUM_TOP,
+    NUM_FRUSTUM_PLANES
+};
+
+/*
+ * View frustum of the pinhole camera. Its apex is the center of projection
+ * and each plane is stored as n.X + d = 0 with its normal n pointing inwards,
+ * i.e. point X is inside the frustum if n.X + d >= 0 for every plane.
+ * There is no far plane.
+ */
+typedef struct frustum {
+    vec3_t normals[NUM_FRUSTUM_PLANES];
+    float offsets[NUM_FRUSTUM_PLANES];
+} frustum_t;
+
 /* 
  * plane in 3D assuming its equation is:
  * n_x*x + n_y*y + n_z*z + d = 0 (1)
@@ -91,6 +192,29 @@ typedef struct plane {
 */
 mesh_t*     obj_triangle_new           (vec3i_t* p0, vec3i_t* p1, vec3i_t* p2, color_t color);
 /**
+* @brief Like `obj_triangle_new` but allocates the triangle from an arena
+*
+* @param arena Arena to allocate from, e.g. one shared by a scene, or NULL for
+*              the mesh to get its own
+*/
+mesh_t*     obj_triangle_new_in        (arena_t* arena, vec3i_t* p0, vec3i_t* p1, vec3i_t* p2, color_t color);
+/**
+* @brief Creates a mesh from vertices and faces that are already in memory,
+*        e.g. generated or simplified ones
+*
+* @param arena    Arena to allocate from, or NULL for the mesh to get its own
+* @param vertices `n_verts` vertices relative to the center of the mesh
+* @param faces    `n_faces` rows of 6 like those of `mesh_t::connections`,
+*                 back to back
+* @param cx       x-coordinate of the center of the mesh to be created
+* @param cy       y-coordinate of the center of the mesh to be created
+* @param cz       z-coordinate of the center of the mesh to be created
+*
+* @returns A pointer to the mesh, with a face BVH if it has enough faces
+*/
+mesh_t*     obj_mesh_new_in            (arena_t* arena, const vec3i_t* vertices, size_t n_verts,
+                                        const int* faces, size_t n_faces, int cx, int cy, int cz);
+/**
 * @brief
 *
 * @param fpath File path to read vertex and connection info from 
@@ -105,9 +229,147 @@ mesh_t*     obj_triangle_new           (vec3i_t* p0, vec3i_t* p1, vec3i_t* p2, c
 */
 mesh_t*     obj_mesh_from_file         (const char* fpath, int cx, int cy, int cz,
                                         unsigned width, unsigned height, unsigned depth);
+/**
+* @brief Like `obj_mesh_from_file` but allocates the mesh from an arena
+*
+* @param arena Arena to allocate from, e.g. one shared by a scene, or NULL for
+*              the mesh to get its own, sized to take a single allocation
+*/
+mesh_t*     obj_mesh_from_file_in      (arena_t* arena, const char* fpath, int cx, int cy, int cz,
+                                        unsigned width, unsigned height, unsigned depth);
+/**
+* @brief Generates a UV sphere of about `n_faces` faces - bands of quads
+*        between the poles, triangles around them
+*
+* @param arena   Arena to allocate from, or NULL for the mesh to get its own
+* @param cx      x-coordinate of the center of the mesh to be created
+* @param cy      y-coordinate of the center of the mesh to be created
+* @param cz      z-coordinate of the center of the mesh to be created
+* @param width   Width of the mesh
+* @param height  Height of the mesh
+* @param depth   Depth of the mesh
+* @param n_faces Faces to generate, rounded to the nearest the shape allows
+*
+* @returns A pointer to the mesh that has been constructed
+*/
+mesh_t*     obj_sphere_new_in          (arena_t* arena, int cx, int cy, int cz,
+                                        unsigned width, unsigned height, unsigned depth, size_t n_faces);
+/**
+* @brief Generates a torus of quads around the z axis, its tube a third of its
+*        size across, like `obj_sphere_new_in`
+*/
+mesh_t*     obj_torus_new_in           (arena_t* arena, int cx, int cy, int cz,
+                                        unsigned width, unsigned height, unsigned depth, size_t n_faces);
+/**
+* @brief Generates a cube whose sides are each split into a grid of quads,
+*        colored like cube.scl, like `obj_sphere_new_in`
+*/
+mesh_t*     obj_subdivided_cube_new_in (arena_t* arena, int cx, int cy, int cz,
+                                        unsigned width, unsigned height, unsigned depth, size_t n_faces);
+/**
+* @brief Generates a rolling heightfield over a square grid of triangles in
+*        the xz plane, open at its borders, like `obj_sphere_new_in`
+*/
+mesh_t*     obj_heightfield_new_in     (arena_t* arena, int cx, int cy, int cz,
+                                        unsigned width, unsigned height, unsigned depth, size_t n_faces);
+/**
+* @brief Generates the convex hull of random points on a sphere, triangles of
+*        all sizes and orientations, like `obj_sphere_new_in`
+*
+* @param seed Seed of the points, the same seed gives the same hull
+*/
+mesh_t*     obj_convex_hull_new_in     (arena_t* arena, int cx, int cy, int cz, unsigned width,
+                                        unsigned height, unsigned depth, size_t n_faces, unsigned seed);
+/**
+* @brief Generates a mesh from a spec "<shape>:<faces>", where the shape is
+*        one of sphere, torus, cube, hull or heightfield, e.g. "torus:10000".
+*        Hulls are always from the same points. The mesh gets its own arena.
+*
+* @returns A pointer to the mesh, or NULL if the spec isn't valid
+*/
+mesh_t*     obj_mesh_generate          (const char* spec, int cx, int cy, int cz,
+                                        unsigned width, unsigned height, unsigned depth);
+/**
+ * @brief Sets the orientation of a mesh. It's O(1) - the vertices are only
+ *        updated when `obj_mesh_apply_transform` is called. Setting the same
+ *        orientation again leaves the mesh clean, so it isn't transformed again.
+ */
 void        obj_mesh_rotate_to            (mesh_t* mesh, float angle_x_rad, float angle_y_rad, float angle_z_rad);
+/**
+ * @brief Moves the center of a mesh. It's O(1) - the vertices are only updated
+ *        when `obj_mesh_apply_transform` is called.
+ */
 void        obj_mesh_translate_by         (mesh_t* mesh, float dx, float dy, float dz);
+/**
+ * @brief Places the center of a mesh at a point. It's O(1) like the above and
+ *        leaves the mesh clean if it's already there.
+ */
+void        obj_mesh_translate_to         (mesh_t* mesh, float x, float y, float z);
+/**
+ * @brief Sets both the orientation and the position of a mesh from an affine
+ *        transform, e.g. one computed by a scene graph. It's O(1) like the above.
+ *
+ * @param mesh  Pointer to the mesh to place
+ * @param model Pointer to a rigid transform mapping the rest pose to world space
+ */
+void        obj_mesh_set_transform        (mesh_t* mesh, mat34_t* model);
+/**
+ * @brief Recomputes the world space vertices from the rest pose if the mesh was
+ *        rotated or moved since the last call. The renderer calls it for every
+ *        mesh it draws.
+ *
+ * @param[in/out] mesh Pointer to the mesh to transform
+ */
+void        obj_mesh_apply_transform      (mesh_t* mesh);
+/**
+ * @brief Copies a mesh, with its pose, BVH, edges and levels of detail, into a new mesh with its own
+ *        arena. Rendering writes to a mesh, e.g. its BVH's query results, so
+ *        threads that render the same mesh each need a copy.
+ *
+ * @param mesh Pointer to the mesh to copy - only read
+ *
+ * @return A pointer to the copy, to be freed with `obj_mesh_free`
+ */
+mesh_t*     obj_mesh_copy              (const mesh_t* mesh);
+/**
+ * @brief Frees a mesh that has its own arena, and its levels of detail, and
+ *        removes it from its spatial index. Meshes allocated from a shared
+ *        arena are released all at once by `arena_free` instead.
+ */
 void        obj_mesh_free              (mesh_t* mesh);
+/**
+ * @brief Builds a bounding volume hierarchy over the faces of a mesh so that the
+ *        renderer only tests the faces whose bounds contain each pixel.
+ *        It's kept up to date by the rotation and translation functions.
+ *
+ * @param[in/out] mesh Pointer to the mesh to build the hierarchy for
+ */
+void        obj_mesh_build_bvh         (mesh_t* mesh);
+/**
+ * @brief Finds the edges of the faces of a mesh and of its levels of detail
+ *        for wireframes, each edge shared by several faces once. Does nothing
+ *        for the meshes whose edges were found already.
+ *
+ * @param[in/out] mesh Pointer to the mesh to find the edges of
+ */
+void        obj_mesh_build_edges       (mesh_t* mesh);
+/**
+ * @brief Recomputes the bounds of every node of a face BVH after the mesh moved
+ *
+ * @param[in/out] mesh Pointer to the mesh whose BVH to refit
+ */
+void        obj_face_bvh_refit         (mesh_t* mesh);
+/**
+ * @brief Finds the faces whose xy bounds contain a point. Writes them to the
+ *        `hits` member of the BVH in ascending order.
+ *
+ * @param bvh Pointer to the BVH to query
+ * @param x   x-coordinate of the point
+ * @param y   y-coordinate of the point
+ *
+ * @return The number of faces found
+ */
+size_t      obj_face_bvh_query         (face_bvh_t* bvh, int x, int y);
 
 //-------------------------------------------------------------------------------------------------------------
 // Ray
@@ -147,6 +409,37 @@ void        obj_ray_free                (ray_t* ray);
 //-------------------------------------------------------------------------------------------------------------
 camera_t*   obj_camera_new              ();
 void        obj_camera_set              (camera_t* camera, int cam_x0, int cam_y0, float focal_length);
+/**
+ * @brief Computes the view frustum of a camera given the visible screen extent
+ *
+ * @param[out] frustum     Pointer to the frustum to write to
+ * @param      camera      Pointer to the camera the frustum belongs to
+ * @param      half_width  Half the width of the visible screen in pixels
+ * @param      half_height Half the height of the visible screen in pixels
+ * @param      z_near      Depth of the near plane, must be positive
+ */
+void        obj_frustum_set             (frustum_t* frustum, camera_t* camera, int half_width, int half_height,
+                                         float z_near);
+/**
+ * @brief Checks whether an axis aligned box lies entirely outside the frustum.
+ *        The test is conservative, i.e. some boxes outside the frustum near its
+ *        edges may not be culled.
+ *
+ * @return true if the box (x0, y0, z0) - (x1, y1, z1) can be culled
+ */
+bool        obj_frustum_culls_box       (frustum_t* frustum, int x0, int y0, int z0, int x1, int y1, int z1);
+/**
+ * @brief Clips a convex polygon against every plane of the frustum
+ *        (Sutherland-Hodgman algorithm)
+ *
+ * @param      frustum Pointer to the frustum to clip against
+ * @param      in      Vertices of the polygon to clip
+ * @param      n_in    Number of vertices of the input polygon
+ * @param[out] out     Vertices of the clipped polygon - must fit `n_in + NUM_FRUSTUM_PLANES`
+ *
+ * @return The number of vertices of the clipped polygon, 0 if it's entirely outside
+ */
+size_t      obj_frustum_clip_polygon    (frustum_t* frustum, vec3_t* in, size_t n_in, vec3_t* out);
 
 //-------------------------------------------------------------------------------------------------------------
 // Plane
@@ -163,11 +456,12 @@ void        obj_camera_set              (camera_t* camera, int cam_x0, int cam_y
 plane_t*    obj_plane_new                  ();
 /* recompute plane's normal and offset given 3 points */
 void        obj_plane_set                  (plane_t* plane, vec3i_t* p0, vec3i_t* p1, vec3i_t* p2);
-bool        obj_is_point_in_triangle       (vec3i_t* m, vec3i_t* a, vec3i_t* b, vec3i_t* c);
-bool        obj_is_point_in_rect           (vec3i_t* m, vec3i_t* a, vec3i_t* b, vec3i_t* c, vec3i_t* d);
-vec3i_t     render__ray_plane_intersection (plane_t* plane, ray_t* ray);
-bool        obj_ray_hits_rectangle         (ray_t* ray, vec3i_t** points);
-bool        obj_ray_hits_triangle          (ray_t* ray, vec3i_t** points);
+bool        obj_is_point_in_triangle       (vec3c_t* m, vec3i_t* a, vec3i_t* b, vec3i_t* c);
+bool        obj_is_point_in_rect           (vec3c_t* m, vec3i_t* a, vec3i_t* b, vec3i_t* c, vec3i_t* d);
+vec3c_t     render__ray_plane_intersection (plane_t* plane, ray_t* ray);
+/* whether a ray hits a face - `plane` is scratch space the face's plane is written to */
+bool        obj_ray_hits_rectangle         (ray_t* ray, vec3i_t** points, plane_t* plane);
+bool        obj_ray_hits_triangle          (ray_t* ray, vec3i_t** points, plane_t* plane);
 void        obj_plane_free                 (plane_t* plane);
 
 /*
@@ -0,0 +1,67 @@
+#ifndef QUALITY_H
+#define QUALITY_H
+
+#include <stddef.h> // size_t
+#include <stdio.h> // FILE
+
+// coarsest sampling step it goes to, i.e. 1 shaded pixel in 16
+#define QUALITY_MAX_STEP 4
+// coarser once smoothed frames take this fraction of the budget
+#define QUALITY_DEGRADE_AT 0.85
+// finer once the next finer step is predicted to take this fraction of it
+#define QUALITY_IMPROVE_AT 0.6
+// weight of the latest frame in the smoothed frame time
+#define QUALITY_SMOOTHING 0.1
+// frames to wait after a change before the next one, twice that to get finer
+#define QUALITY_DWELL 8
+
+/*
+ * Controller that holds a frame rate by trading detail for time. It measures
+ * how long frames take to render against the budget of 1/fps and picks the
+ * sampling step of the renderer, see `renderer_t::sample_step`. Frame time
+ * falls with the square of the step, so a finer step is predicted from the
+ * current one, and the gap between the two thresholds, together with a
+ * minimum dwell time, keeps it from oscillating between two steps.
+ */
+typedef struct quality_stats {
+    size_t n_frames;
+    size_t n_over_budget;
+    size_t n_coarser;
+    size_t n_finer;
+    // frames rendered with each step, index 0 unused
+    size_t n_frames_at[QUALITY_MAX_STEP + 1];
+    double secs_total;
+} quality_stats_t;
+
+typedef struct quality {
+    double budget_secs;
+    // smoothed frame time
+    double secs;
+    unsigned step;
+    size_t n_since_change;
+    quality_stats_t stats;
+} quality_t;
+
+/**
+ * @brief Starts a controller at full detail
+ *
+ * @param quality Controller to initialise
+ * @param fps     Frame rate to hold
+ */
+void        quality_init        (quality_t* quality, unsigned fps);
+/**
+ * @brief Accounts for a frame and picks the step of the next one
+ *
+ * @param quality    Controller to update
+ * @param frame_secs Time it took to render and output the frame, without
+ *                   waiting for the next one
+ *
+ * @return The sampling step to render the next frame with
+ */
+unsigned    quality_update      (quality_t* quality, double frame_secs);
+/**
+ * @brief Prints the frames over budget, the changes and the time at each step
+ */
+void        quality_report      (const quality_t* quality, FILE* stream);
+
+#endif /* QUALITY_H */
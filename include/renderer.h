@@ -4,63 +4,175 @@
 #include "screen.h"
 #include <stdbool.h>
 
-extern int* g_z_buffer;
-// checks whether the ray hits each pixel
-extern plane_t* g_plane_test;
-// the 4 points that define the surface to render
-extern vec3i_t** g_surf_points;
-// checks whether the ray hits each pixel
-extern ray_t* g_ray_test;
-// camera where rays are shot from 
-extern camera_t g_camera;
-extern color_t g_colors_refl[32];
-extern bool g_use_perspective;
-extern bool g_use_reflectance;
+// stores the colors of a surfaces after it reflects light - from brightest to darkest
+extern const color_t g_colors_refl[32];
+
+/*
+ * Renderer context. It holds everything needed to render a view, so several
+ * renderers can draw different views, e.g. a main view and a minimap, or run
+ * in different threads. Zero-initialise it, configure it with the `_use_`
+ * functions and then call `render_init_r()`.
+ *
+ * The functions without the `_r` suffix use the default renderer, which draws
+ * on the terminal's screen `g_screen`.
+ */
+typedef struct renderer {
+    // where the pixels are written - not owned by the renderer
+    screen_t* screen;
+    // records the depth of each pixel of the screen
+    int* z_buffer;
+    // whether the z buffer was allocated by the renderer or given by the caller
+    bool owns_z_buffer;
+    // where depths were written since the z buffer was last reset
+    sink_rect_t z_drawn;
+    // checks whether the ray hits each pixel
+    plane_t* plane_test;
+    // the 4 points that define the surface to render
+    vec3i_t* surf_points[4];
+    // checks whether the ray hits each pixel
+    ray_t* ray_test;
+    // camera where rays are shot from
+    camera_t camera;
+    // what the camera sees in perspective mode - set by `render_init_r()`
+    frustum_t frustum;
+    bool use_perspective;
+    bool use_reflectance;
+    // draw the edges of the faces instead of filling them, and hide those
+    // behind faces if `use_hidden_lines`, which fills the faces blank first
+    bool use_wireframe;
+    bool use_hidden_lines;
+    // fill the faces of each shape from the farthest to the closest, without
+    // the depth buffer, see `render_use_painter_r()`
+    bool use_painter;
+    // shade every `sample_step`-th pixel along x and y and paint each sample
+    // as a block that size, to trade detail for time - 0 or 1 for every pixel
+    unsigned sample_step;
+    // visible bounds of each face of the shape being rendered - grows with the largest shape
+    struct face_bounds* face_bounds;
+    size_t face_bounds_size;
+    // faces of the shape being painted by depth and scratch for sorting them,
+    // as many as `face_bounds`
+    struct face_depth* face_depths;
+    struct face_depth* face_depths_tmp;
+    // (x, -y, z) where the pixels of the current row hit each face in perspective
+    // mode, and their projections - grow with the widest row
+    vec3_soa_t* row_samples;
+    vec3_soa_t* row_projected;
+} renderer_t;
+
+// the default renderer
+extern renderer_t g_renderer;
 
 
 /**
  * @brief Use perspective transform (pinhole camera model) when rendering shapes. 
- *        After calling this function, call `render_init()` for the changes to
+ *        After calling this function, call `render_init_r()` for the changes to
  *        take place.
  *
+ * @param renderer     Renderer to configure
  * @param center_x0    x-coordinate of the perspective center - aka the point
  *                     where rays are shot from
  * @param center_y0    y-coordinate of the perspective center - aka the point
  *                     where rays are shot from
  * @param focal_length Focal length of pinhole camera
  */
-void render_use_perspective(int center_x0, int center_y0, float focal_length);
+void render_use_perspective_r(renderer_t* renderer, int center_x0, int center_y0, float focal_length);
 
 /**
  * @brief Sets flag to change the surface color based on the hit angle 
  */
-void render_use_reflectance();
+void render_use_reflectance_r(renderer_t* renderer);
 
 /**
- * @brief Initializes renderer by setting the point of persperctive and focal length
- *        if projection is to be used
+ * @brief Draws shapes as the edges of their faces instead of filling them,
+ *        each edge once, as a line of characters that follow its slope. It's
+ *        much cheaper, as no face is tested against the pixels.
+ *
+ * @param renderer   Renderer to configure
+ * @param hide_lines Whether to hide the edges behind faces, by filling the
+ *                   faces blank into the depth buffer first - about the cost
+ *                   of filling them
  */
-void render_init();
+void render_use_wireframe_r(renderer_t* renderer, bool hide_lines);
 
 /**
- * @brief Writes shape to screen buffer before it's rendered.
- *        Once shapes have been written, they can be displayed with `screen_flush()`
- *        (the latter is defined in screen.h)
+ * @brief Fills the faces of each shape with the painter's algorithm instead of
+ *        the depth buffer: they're sorted from the farthest to the closest by
+ *        the depth of their centroids each frame and filled in that order, each
+ *        over its own bounds, overwriting the pixels. It's cheaper for simple
+ *        shapes, but faces that cross or overlap cyclically may be drawn in
+ *        the wrong order, and shapes overlap in the order they're written.
+ *        Hidden lines of wireframes still use the depth buffer.
+ */
+void render_use_painter_r(renderer_t* renderer);
+
+/**
+ * @brief Initializes a renderer by allocating its buffers for a screen and
+ *        setting its frustum if perspective is used
  *
- * @param shape Pointer to the shape to write to the renderer. Note that it must be
- *              initialised 
+ * @param renderer Renderer to initialise
+ * @param screen   Initialised screen to render to. Renderers that render to
+ *                 the same screen must be flushed one after the other.
  */
-void render_write_shape(mesh_t* shape);
+void render_init_r(renderer_t* renderer, screen_t* screen);
+
+/**
+ * @brief Like `render_init_r()` but the depth buffer is owned by the caller, e.g.
+ *        to render offscreen into caller-owned character and depth buffers
+ *
+ * @param renderer Renderer to initialise
+ * @param screen   Initialised screen to render to, see `screen_init_offscreen_r()`
+ * @param z_buffer Buffer of `screen->buffer_size` depths, one for each pixel
+ *                 of the screen - once a frame is written, the closer a pixel
+ *                 the smaller its value and INT_MAX where nothing was drawn
+ */
+void render_init_offscreen_r(renderer_t* renderer, screen_t* screen, int* z_buffer);
+
+/**
+ * @brief Writes shape to the screen buffer of a renderer before it's rendered.
+ *        Once shapes have been written, they can be displayed with `render_flush_r()`
+ *
+ * @param renderer Renderer to use
+ * @param shape    Pointer to the shape to write to the renderer. Note that it must be
+ *                 initialised
+ */
+void render_write_shape_r(renderer_t* renderer, mesh_t* shape);
+
+/**
+ * @brief Starts a new frame by emptying the screen buffer and setting the
+ *        depth (z) buffer to INT_MAX, without drawing anything. Offscreen
+ *        renderers call it after reading the finished frame from the buffers.
+ */
+void render_clear_r(renderer_t* renderer);
 
 /**
  * @brief Sets the depth (z) buffer to INT_MAX and flushes the screen,
  *        drawing the pixels 
  */
-void render_flush();
+void render_flush_r(renderer_t* renderer);
 
 /**
- * @brief Closes the renderer and deallocates its structures 
+ * @brief Deallocates the structures of a renderer, but not its screen or a
+ *        caller-owned depth buffer
  */
+void render_end_r(renderer_t* renderer);
+
+/**
+ * The same with the default renderer. `render_init()` also initialises the
+ * terminal's screen and `render_end()` closes it.
+ */
+void render_use_perspective(int center_x0, int center_y0, float focal_length);
+void render_use_reflectance();
+void render_use_wireframe(bool hide_lines);
+void render_use_painter();
+void render_init();
+/**
+ * @brief Like `render_init()` but flushed frames go to a sink, see
+ *        `screen_init_sink_r()` for the arguments
+ */
+void render_init_sink(sink_t* sink, int rows, int cols);
+void render_write_shape(mesh_t* shape);
+void render_flush();
 void render_end();
 
 #endif /* RENDERER_H */
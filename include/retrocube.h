@@ -0,0 +1,53 @@
+#ifndef RETROCUBE_H
+#define RETROCUBE_H
+
+/*
+ * Public API of libretrocube. Link with -lretrocube -lm -lrt -lpthread.
+ *
+ * The minor version grows when functions are added and the major when
+ * existing ones change. libretrocube.so is named for the major version
+ * (its SONAME is libretrocube.so.<major>). Since 1.0, 1.1 added the sinks,
+ * recording, shared memory, serving, exporting, the frame cache, adaptive
+ * quality, levels of detail, generated meshes, wireframes and the painter's
+ * algorithm. Rendering offscreen, into caller-owned buffers and
+ * without touching the terminal, goes like this:
+ *
+ *     color_t pixels[ROWS*COLS];
+ *     int depth[ROWS*COLS];
+ *     screen_t screen;
+ *     renderer_t renderer = {0};
+ *     screen_init_offscreen_r(&screen, ROWS, COLS, 16.0/9.0, pixels);
+ *     render_use_perspective_r(&renderer, 0, 0, -200); // optional
+ *     render_init_offscreen_r(&renderer, &screen, depth);
+ *     ftrig_init_lut();
+ *     mesh_t* cube = obj_mesh_from_file("cube.scl", 0, 0, 300, 40, 40, 40);
+ *     for (int t = 0; ; ++t) {
+ *         obj_mesh_rotate_to(cube, 0.05*t, 0.01*t, 0.025*t);
+ *         render_write_shape_r(&renderer, cube);
+ *         // the frame is in `pixels` and `depth` - read them in place
+ *         render_clear_r(&renderer);
+ *     }
+ *     obj_mesh_free(cube);
+ *     render_end_r(&renderer);
+ */
+#define RETROCUBE_VERSION_MAJOR 1
+#define RETROCUBE_VERSION_MINOR 1
+
+#include "objects.h"
+#include "renderer.h"
+#include "screen.h"
+#include "sink.h"
+#include "cast.h"
+#include "shm.h"
+#include "serve.h"
+#include "export.h"
+#include "cache.h"
+#include "quality.h"
+#include "lod.h"
+#include "scene.h"
+#include "spatial.h"
+#include "arena.h"
+#include "vector.h"
+#include "xtrig.h"
+
+#endif /* RETROCUBE_H */
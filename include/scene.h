@@ -0,0 +1,83 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "objects.h"
+#include "vector.h"
+#include <stdbool.h> // bool
+#include <stddef.h> // size_t
+
+/*
+ * Node of a scene graph. Each node is placed relative to its parent and
+ * optionally carries a mesh. Nodes without a mesh group their children so
+ * they can be moved together, e.g. a pivot that several objects orbit.
+ *
+ *                   root
+ *                  /    \
+ *             coffin    pivot (rotates)
+ *                      /  |  \
+ *                  cube cube cube (orbit the pivot)
+ *
+ * Setting a node's local transform marks it dirty and queues it, and each of
+ * its ancestors, in its parent's list of children to visit. `scene_update`
+ * then only follows those lists and recomputes the world transforms of the
+ * dirty subtrees, so moving one node costs the length of its path however
+ * many siblings the nodes on the path have. Neither updating nor freeing
+ * recurses, so a hierarchy of any depth fits on any thread's stack.
+ */
+typedef struct scene_node {
+    // transform relative to the parent
+    mat34_t local;
+    // cached transform relative to the world - parent's world * local
+    mat34_t world;
+    // whether `local` changed since the last update - or, during one, `world`
+    bool is_dirty;
+    // whether the node is in its parent's `dirty_children`
+    bool is_queued;
+    struct scene_node* parent;
+    struct scene_node** children;
+    // children that are dirty or have a dirty descendant, as many as `children` at most
+    struct scene_node** dirty_children;
+    size_t n_children;
+    size_t n_dirty_children;
+    // children visited so far by the update going on, 0 outside of it
+    size_t n_visited;
+    // of both `children` and `dirty_children`
+    size_t capacity;
+    // mesh placed at the node's world transform, NULL if none
+    mesh_t* mesh;
+} scene_node_t;
+
+/**
+ * @brief Allocates a node with an identity local transform
+ *
+ * @param mesh Mesh to place at the node or NULL for a grouping node. The node
+ *             does not own the mesh.
+ *
+ * @return A pointer to the newly constructed node
+ */
+scene_node_t*   scene_node_new          (mesh_t* mesh);
+/**
+ * @brief Attaches a node (and its subtree) under a parent
+ */
+void            scene_node_add_child    (scene_node_t* parent, scene_node_t* child);
+/**
+ * @brief Sets the transform of a node relative to its parent - it rotates about
+ *        the x axis, then y, then z and then translates
+ */
+void            scene_node_set_local    (scene_node_t* node, float angle_x_rad, float angle_y_rad, float angle_z_rad,
+                                         float tx, float ty, float tz);
+/**
+ * @brief Recomputes the world transforms of the dirty subtrees and places
+ *        their meshes accordingly
+ *
+ * @param root Root of the scene graph
+ *
+ * @return The number of world transforms recomputed
+ */
+size_t          scene_update            (scene_node_t* root);
+/**
+ * @brief Frees a node and its subtree, but not their meshes
+ */
+void            scene_node_free         (scene_node_t* node);
+
+#endif /* SCENE_H */
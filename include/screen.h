@@ -3,48 +3,138 @@
 
 #include "vector.h"
 #include "objects.h"
+#include "sink.h"
 #include <stddef.h> // size_t
+#include <stdbool.h> // bool
 
-extern int g_rows;
-extern int g_cols;
-// stores the pixels to be drawn on the screen
-extern color_t* g_screen_buffer;
-extern size_t g_buffer_size;
+/*
+ * Character grid that shapes are rendered into. Each renderer draws into its
+ * own, so several views can be rendered independently.
+ */
+typedef struct screen {
+    // rows, columns of the terminal
+    int rows;
+    int cols;
+    // columns over rows for the terminal
+    float cols_over_rows;
+    // screen resolution (pixels over pixels)
+    float screen_res;
+    // stores the pixels to be drawn on the screen
+    color_t* buffer;
+    size_t buffer_size;
+    // the frame flushed last, kept to repeat it - NULL for an offscreen screen
+    color_t* prev;
+    // where pixels were written since the buffer was last emptied, and where
+    // they were in the frame flushed last - the rest of both is blank
+    sink_rect_t drawn;
+    sink_rect_t drawn_prev;
+    // the same per row, within `drawn` and `drawn_prev`, and the part of each
+    // row the frame being flushed may differ in - NULL for an offscreen screen
+    sink_span_t* drawn_rows;
+    sink_span_t* drawn_rows_prev;
+    sink_span_t* damage_rows;
+    // where flushed frames go, owned by the screen - NULL if they go nowhere
+    sink_t* sink;
+    // whether it renders to a caller-owned buffer instead of the terminal
+    bool is_offscreen;
+} screen_t;
+
+// the terminal's screen, used by the functions without the `_r` suffix
+extern screen_t g_screen;
 
 /**
  * @brief Conver some pixel coordinates from (x, y) to an 1D index given
  *        the rows and columns of the screen. This is done to index the
  *        pixel and depth (z) buffers. 
  *
- * @param x x-coordinate of pixel to index 
- * @param y y-coordinate of pixel to index 
+ * @param screen Screen whose buffer to index
+ * @param x      x-coordinate of pixel to index
+ * @param y      y-coordinate of pixel to index
  *
  * @retun the 1D buffer index corrsponding to coordinates (x,y)
  */
-size_t screen_xy2ind(int x, int y);
-
+size_t screen_xy2ind_r(screen_t* screen, int x, int y);
 /**
- * @brief Initialises the screen buffer and prepares terminal for writing
+ * @brief Like `screen_xy2ind_r()` but gives the row and column of the
+ *        character pixel (x, y) falls in, which may be off the screen
  */
-void screen_init();
+void screen_xy2cell_r(screen_t* screen, int x, int y, int* row, int* col);
+/**
+ * @brief Initialises the screen buffer to the size of the terminal and
+ *        prepares the terminal for writing
+ */
+void screen_init_r(screen_t* screen);
 /**
- * @brief Write pixel with coordinates (x, y) on the screen into the screen
- *        buffer `g_screen_buffer`. Note that the origin (0, 0) is at the 
- *        center of the screen.
+ * @brief Initialises a screen whose frames go to a sink instead of the terminal
  *
- * @param x x-coordinate of pixel to write
- * @param y y-coordinate of pixel to write
- * @param c "color" of the pixel as an ASCII character
+ * @param screen Screen to initialise
+ * @param rows   Rows of the screen or 0 for those of the terminal
+ * @param cols   Columns of the screen or 0 for those of the terminal
+ * @param sink   Where flushed frames are written - the screen takes ownership
  */
-void screen_write_pixel(int x, int y, color_t c);
+void screen_init_sink_r(screen_t* screen, int rows, int cols, sink_t* sink);
 /**
- * @brief Draws whatever is stored in the screen buffer `g_screen_buffer` on 
- *        the screen. Then moves the cursor top left and empties the buffer.
+ * @brief Initialises an offscreen screen, which renders into a caller-owned
+ *        buffer and never touches the terminal
+ *
+ * @param screen     Screen to initialise
+ * @param rows       Rows of the buffer
+ * @param cols       Columns of the buffer
+ * @param screen_res Width over height in pixels of the display the frame is
+ *                   meant for, e.g. 16/9 - characters are about twice as tall
+ *                   as they are wide
+ * @param buffer     Buffer of `rows*cols` characters, row by row. It holds the
+ *                   frame as it's rendered and is emptied by `screen_clear_r()`.
  */
-void screen_flush();
+void screen_init_offscreen_r(screen_t* screen, int rows, int cols, float screen_res, color_t* buffer);
+/**
+ * @brief Write pixel with coordinates (x, y) on the screen into its buffer.
+ *        Note that the origin (0, 0) is at the center of the screen.
+ *
+ * @param screen Screen to write to
+ * @param x      x-coordinate of pixel to write
+ * @param y      y-coordinate of pixel to write
+ * @param c      "color" of the pixel as an ASCII character
+ */
+void screen_write_pixel_r(screen_t* screen, int x, int y, color_t c);
+/**
+ * @brief Writes the character at a row and column of the screen, e.g. one a
+ *        line passes through. The cell must be on the screen.
+ */
+void screen_write_cell_r(screen_t* screen, int row, int col, color_t c);
+/**
+ * @brief Marks the whole buffer as drawn, after writing to it directly rather
+ *        than with `screen_write_pixel_r()`
+ */
+void screen_mark_drawn_r(screen_t* screen);
+/**
+ * @brief Empties the screen buffer, filling the part that was drawn with spaces
+ */
+void screen_clear_r(screen_t* screen);
+/**
+ * @brief Writes whatever is stored in the screen buffer to the screen's sink,
+ *        e.g. draws it on the terminal. Only what was drawn in this frame or
+ *        the previous one is damaged, row by row, so the tty sink rewrites just
+ *        that. Then empties the buffer. An offscreen screen is only emptied.
+ */
+void screen_flush_r(screen_t* screen);
 /**
- * @brief Clears the screen and restores the cursor.
+ * @brief Writes the frame flushed last to the sink again, without rendering
+ *        it, for when nothing moved since. The tty sink then writes nothing.
  */
+void screen_repeat_r(screen_t* screen);
+/**
+ * @brief Frees the screen buffer and closes its sink, e.g. clears the terminal
+ *        and restores the cursor. An offscreen screen leaves its buffer alone.
+ */
+void screen_end_r(screen_t* screen);
+
+/* The same on the terminal's screen `g_screen` */
+size_t screen_xy2ind(int x, int y);
+void screen_init();
+void screen_write_pixel(int x, int y, color_t c);
+void screen_flush();
+void screen_repeat();
 void screen_end();
 
 
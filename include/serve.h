@@ -0,0 +1,36 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "sink.h"
+
+// frames a client can fall behind before its backlog is dropped for a keyframe
+#define SERVE_QUEUE_LEN 16
+#define SERVE_MAX_EVENTS 64
+
+/*
+ * Frames served to any number of local clients over a socket. Each frame is
+ * encoded once, as the terminal escape codes that draw it, and the same
+ * buffer is queued for every client - so any terminal can watch, e.g.
+ *     ./cube -o serve:/tmp/retrocube.sock
+ *     nc -U /tmp/retrocube.sock
+ * A delta only rewrites the runs of characters that changed since the
+ * previous frame. A keyframe clears the terminal and draws everything; it's
+ * only encoded when a client needs one. Clients get a keyframe when they
+ * connect and whenever they're SERVE_QUEUE_LEN frames behind, in which case
+ * the deltas they haven't started reading are dropped. Sockets are
+ * non-blocking and polled with epoll each time a frame is written, so a slow
+ * client never stalls the renderer or the other clients.
+ */
+
+/**
+ * @brief Creates a sink that serves frames over a socket. When it's freed,
+ *        it reports to stderr what it sent and how long it took per frame.
+ *
+ * @param address Path of a Unix domain socket to create, or "tcp:<port>" to
+ *                listen on the loopback interface
+ *
+ * @return A pointer to the sink or NULL if the socket can't be created
+ */
+sink_t*     serve_sink_new      (const char* address);
+
+#endif /* SERVE_H */
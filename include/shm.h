@@ -0,0 +1,130 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include "sink.h"
+#include "objects.h" // color_t
+#include <stdint.h> // uint32_t, uint64_t
+#include <stdbool.h> // bool
+#include <stddef.h> // size_t
+#include <sys/types.h> // dev_t, ino_t
+
+#define SHM_MAGIC 0x48534352 // "RCSH"
+#define SHM_VERSION 1
+// header and slot headers are padded to a cache line
+#define SHM_ALIGNMENT 64
+#define SHM_DEFAULT_SLOTS 4
+
+/*
+ * Frames published to POSIX shared memory for other processes to read.
+ * The segment is a header followed by `n_slots` slots, each a slot header and
+ * a frame of `rows*cols` characters, row by row:
+ *
+ *     +--------+--------------+--------------+-----+
+ *     | header | slot 0       | slot 1       | ... |
+ *     +--------+--------------+--------------+-----+
+ *
+ * Frame `seq` (1, 2, ...) is written to slot `seq % n_slots`. Each slot is
+ * guarded by a seqlock: its `lock` is odd while the writer is copying a frame
+ * into it. The writer never waits for readers. Readers never write to the
+ * segment, so there can be any number of them. They read a frame in place
+ * and check that its slot's lock didn't change meanwhile, otherwise the
+ * writer overwrote it and the frame has to be dropped.
+ *
+ * A writer never resizes or reuses a segment that may be mapped. If one dies
+ * without removing its segment, the next writer of that name unlinks it and
+ * creates a new one: readers keep a valid mapping of the old segment, whose
+ * frames stop coming, and `shm_reader_is_replaced` tells them to open the
+ * new one.
+ */
+typedef struct shm_header {
+    // SHM_MAGIC once the header is complete
+    uint32_t magic;
+    uint32_t version;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t n_slots;
+    // bytes from one slot to the next
+    uint32_t slot_size;
+    // number of the latest complete frame, 0 before the first one
+    uint64_t seq;
+    // set when the writer goes away
+    uint32_t is_closed;
+} __attribute__((aligned(SHM_ALIGNMENT))) shm_header_t;
+
+typedef struct shm_slot {
+    // seqlock - odd while the frame is being written
+    uint64_t lock;
+    // number of the frame it holds
+    uint64_t seq;
+} __attribute__((aligned(SHM_ALIGNMENT))) shm_slot_t;
+
+/* read-only view of a segment in a reader process */
+typedef struct shm_reader {
+    char* name;
+    int fd;
+    size_t size;
+    // which segment it mapped, to tell when the name is given to another
+    dev_t dev;
+    ino_t ino;
+    const shm_header_t* header;
+} shm_reader_t;
+
+/* a frame being read in place - valid until `shm_read_end` says otherwise */
+typedef struct shm_read {
+    const color_t* frame;
+    uint64_t seq;
+    // what the slot's lock was when reading began
+    uint64_t lock;
+    const shm_slot_t* slot;
+} shm_read_t;
+
+/**
+ * @brief Creates a sink that publishes frames to a shared memory segment. The
+ *        first frame sets its size and frames of another size are dropped.
+ *        The segment is removed when the sink is freed. One left behind
+ *        by a writer that didn't exit cleanly is replaced, not reused.
+ *
+ * @param name    Name of the segment, e.g. "/retrocube"
+ * @param n_slots Number of frames it holds
+ *
+ * @return A pointer to the sink or NULL if the segment can't be created
+ */
+sink_t*         shm_sink_new        (const char* name, size_t n_slots);
+/**
+ * @brief Maps a segment for reading
+ *
+ * @return A pointer to the reader or NULL if the segment doesn't exist or has
+ *         no frame yet
+ */
+shm_reader_t*   shm_reader_open     (const char* name);
+/**
+ * @brief Starts reading the latest frame in place
+ *
+ * @param reader Reader of the segment
+ * @param read   Set to the frame and what's needed to validate it
+ *
+ * @return false if no frame is available, e.g. the writer is in the middle
+ *         of the only one
+ */
+bool            shm_read_begin      (shm_reader_t* reader, shm_read_t* read);
+/**
+ * @brief Checks whether the writer left a frame alone while it was read
+ *
+ * @return true if everything read from the frame since `shm_read_begin` is
+ *         consistent, false if it must be dropped
+ */
+bool            shm_read_end        (shm_reader_t* reader, const shm_read_t* read);
+/**
+ * @brief Checks whether a new writer replaced the segment a reader mapped,
+ *        e.g. after the old one crashed - it takes a few system calls, so
+ *        it's meant for when frames stop coming
+ *
+ * @return true if the reader should be closed and the name opened again
+ */
+bool            shm_reader_is_replaced(shm_reader_t* reader);
+/**
+ * @brief Unmaps a segment and frees the reader
+ */
+void            shm_reader_close    (shm_reader_t* reader);
+
+#endif /* SHM_H */
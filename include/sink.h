@@ -0,0 +1,166 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include "objects.h" // color_t
+#include <stddef.h> // size_t
+#include <limits.h> // INT_MAX, INT_MIN
+
+/*
+ * Where finished frames go. A screen hands each frame to its sink when it's
+ * flushed. Implementations:
+ *     tty  - draws on the terminal with escape codes (default), only the
+ *            damaged part of a frame and nothing if it already shows it
+ *     raw  - writes fixed-size frames of rows*cols characters back to back,
+ *            without escapes or newlines, to a file or a pipe
+ *     ring - keeps the last N frames in memory
+ *     null - drops them, e.g. to time rendering without any output
+ *     rec  - records them to an asciicast v2 file, see cast.h
+ *     shm  - publishes them to a shared memory ring for other processes, see shm.h
+ *     serve - streams them to any number of clients over a socket, see serve.h
+ */
+// unchanged characters between two changed ones that delta encoders rewrite
+// rather than skip with a cursor move, which takes about as many bytes
+#define SINK_MERGE_GAP 8
+
+/*
+ * Rows `row0` to `row1` and columns `col0` to `col1` of a frame, inclusive.
+ * It's empty if `row0 > row1`.
+ */
+typedef struct sink_rect {
+    int row0, col0;
+    int row1, col1;
+} sink_rect_t;
+
+static inline sink_rect_t sink_rect_empty() {
+    return (sink_rect_t) {INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+}
+
+/* smallest rectangle that holds both */
+static inline sink_rect_t sink_rect_union(sink_rect_t a, sink_rect_t b) {
+    return (sink_rect_t) {(a.row0 < b.row0) ? a.row0 : b.row0, (a.col0 < b.col0) ? a.col0 : b.col0,
+                          (a.row1 > b.row1) ? a.row1 : b.row1, (a.col1 > b.col1) ? a.col1 : b.col1};
+}
+
+/*
+ * Columns `col0` to `col1` of a row, inclusive. It's empty if `col0 > col1`.
+ */
+typedef struct sink_span {
+    int col0, col1;
+} sink_span_t;
+
+static inline sink_span_t sink_span_empty() {
+    return (sink_span_t) {INT_MAX, INT_MIN};
+}
+
+/* smallest span that holds both */
+static inline sink_span_t sink_span_union(sink_span_t a, sink_span_t b) {
+    return (sink_span_t) {(a.col0 < b.col0) ? a.col0 : b.col0, (a.col1 > b.col1) ? a.col1 : b.col1};
+}
+
+typedef struct sink {
+    // writes a frame of `rows*cols` characters, row by row
+    void (*write)(struct sink* sink, const color_t* frame, int rows, int cols);
+    // part of the frame being written that may differ from the one written
+    // before it, set for each write - sinks that redraw incrementally use it
+    sink_rect_t damage;
+    // the part of each row that may differ, within `damage` - NULL if all of
+    // `damage` may. It tells apart shapes drawn at either end of the frame.
+    const sink_span_t* damage_rows;
+    // releases what the implementation holds, but not the sink itself
+    void (*close)(struct sink* sink);
+    // implementation specific
+    void* state;
+} sink_t;
+
+/**
+ * @brief Creates a sink of another implementation, e.g. those of cast.h,
+ *        shm.h and serve.h
+ *
+ * @param write Writes a frame, see `sink_t`
+ * @param close Releases `state`, called by `sink_free()`
+ * @param state Implementation specific, given back as `sink->state`
+ *
+ * @return A pointer to the sink
+ */
+sink_t*         sink_new            (void (*write)(sink_t*, const color_t*, int, int),
+                                     void (*close)(sink_t*), void* state);
+/**
+ * @brief Creates a sink that draws on the terminal. It hides the cursor and
+ *        clears the terminal now and restores it when freed.
+ */
+sink_t*         sink_tty_new        ();
+/**
+ * @brief Creates a sink that streams raw frames
+ *
+ * @param path File or named pipe to write to, or "-" for stdout
+ *
+ * @return A pointer to the sink or NULL if the file can't be opened
+ */
+sink_t*         sink_raw_new        (const char* path);
+/**
+ * @brief Creates a sink that keeps the last `n_frames` frames in memory. Its
+ *        storage is allocated by the first write.
+ */
+sink_t*         sink_ring_new       (size_t n_frames);
+/**
+ * @brief Creates a sink that drops every frame
+ */
+sink_t*         sink_null_new       ();
+/**
+ * @brief Creates a sink from a description, as given on the command line:
+ *        "tty", "raw:<path>", "ring:<n_frames>", "rec:<path>",
+ *        "shm:<name>[:<n_slots>]", "serve:<path>", "serve:tcp:<port>" or "null"
+ *
+ * @return A pointer to the sink or NULL if the description is invalid
+ */
+sink_t*         sink_from_spec      (const char* spec);
+/**
+ * @brief Hands a frame of `rows*cols` characters to a sink
+ */
+void            sink_write          (sink_t* sink, const color_t* frame, int rows, int cols);
+/**
+ * @brief Like `sink_write()` when only a part of the frame may differ from the
+ *        one written before it, outside of which it's the same
+ */
+void            sink_write_damaged  (sink_t* sink, const color_t* frame, int rows, int cols,
+                                     sink_rect_t damage);
+/**
+ * @brief Like `sink_write_damaged()` with the damaged part of each row rather
+ *        than a rectangle, which would hold the space between shapes too
+ *
+ * @param damage_rows Columns of each of the `rows` rows that may differ
+ */
+void            sink_write_damaged_rows(sink_t* sink, const color_t* frame, int rows, int cols,
+                                        const sink_span_t* damage_rows);
+/**
+ * @brief Finds the next run of characters of a row that differ from the
+ *        previous frame, merged over gaps of up to SINK_MERGE_GAP unchanged
+ *        ones - how sinks that send deltas, e.g. rec and serve, encode a row
+ *
+ * @param curr Row of the frame being written
+ * @param prev Same row of the previous frame, or NULL to take the whole row
+ * @param cols Characters in the row
+ * @param col  Where to start looking, set to the end of the run (exclusive)
+ *
+ * @return Column the run starts at, or `cols` if nothing is left
+ */
+int             sink_next_run       (const color_t* curr, const color_t* prev, int cols, int* col);
+/**
+ * @brief Frames a ring sink holds - at most its capacity
+ */
+size_t          sink_ring_count     (sink_t* sink);
+/**
+ * @brief Returns a frame from a ring sink
+ *
+ * @param sink Ring sink
+ * @param age  0 for the latest frame, 1 for the one before it, etc.
+ *
+ * @return A pointer to the frame or NULL if the ring doesn't hold it
+ */
+const color_t*  sink_ring_frame     (sink_t* sink, size_t age);
+/**
+ * @brief Closes a sink and frees it
+ */
+void            sink_free           (sink_t* sink);
+
+#endif /* SINK_H */
@@ -0,0 +1,117 @@
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include "objects.h"
+#include <stdbool.h> // bool
+#include <stddef.h> // size_t
+
+// how much a mesh's box is enlarged when stored so it can move a bit without
+// touching the tree - in pixels and as a fraction of its size
+#define SPATIAL_FAT_MARGIN      4
+#define SPATIAL_FAT_MARGIN_FRAC 0.1
+#define SPATIAL_NULL_NODE       -1
+
+typedef struct aabb {
+    // min corner
+    int x0, y0, z0;
+    // max corner
+    int x1, y1, z1;
+} aabb_t;
+
+typedef struct spatial_node {
+    aabb_t box;
+    // SPATIAL_NULL_NODE for the root, else the parent if allocated or the next
+    // free node if not
+    int parent;
+    int left;
+    int right;
+    // 0 for leaves, -1 for free nodes
+    int height;
+    // the mesh the leaf refers to, NULL for internal nodes
+    mesh_t* mesh;
+} spatial_node_t;
+
+/*
+ * Dynamic bounding volume hierarchy over the bounding boxes of meshes.
+ * Each leaf stores a "fat" copy of a mesh's bounding box so meshes that move
+ * a little don't modify the tree at all. Otherwise a leaf is removed and
+ * re-inserted at the position that increases the volume of the tree the
+ * least and the tree is re-balanced by rotations (like an AVL tree).
+ * Leaves are identified by their index, called a proxy.
+ *
+ * A mesh knows the index it's in, so moving it, e.g. with
+ * `obj_mesh_translate_by` or a scene graph, updates its leaf right away -
+ * there's no need to call `spatial_update`. Hence a mesh is in one index at
+ * most, and freeing a mesh removes it from its index.
+ */
+typedef struct spatial {
+    spatial_node_t* nodes;
+    size_t n_nodes;
+    size_t capacity;
+    int root;
+    // head of the list of free nodes
+    int free_list;
+    // traversal stack, kept across queries to avoid allocating
+    int* stack;
+    size_t stack_size;
+} spatial_t;
+
+/**
+ * @brief Allocates an empty spatial index
+ *
+ * @return A pointer to the newly constructed index
+ */
+spatial_t*  spatial_new             ();
+/**
+ * @brief Inserts a mesh in the index, which it then keeps up to date as it moves
+ *
+ * @param index Pointer to the index to insert to
+ * @param mesh  Mesh to insert - it mustn't be in an index already
+ *
+ * @return The proxy of the mesh, used to update or remove it later
+ */
+int         spatial_insert          (spatial_t* index, mesh_t* mesh);
+/**
+ * @brief Re-reads the bounding box of a mesh after it moved. Meshes call it
+ *        themselves whenever they move. It's O(1) if the mesh stays within its
+ *        fat box.
+ *
+ * @param index Pointer to the index to update
+ * @param proxy Proxy of the mesh as returned by `spatial_insert`
+ *
+ * @return true if the tree had to be modified
+ */
+bool        spatial_update          (spatial_t* index, int proxy);
+void        spatial_remove          (spatial_t* index, int proxy);
+/**
+ * @brief Finds the meshes whose bounding box may be inside the frustum
+ *
+ * @param      index   Pointer to the index to query
+ * @param      frustum Pointer to the frustum to test against
+ * @param[out] out     Array to write the meshes to
+ * @param      max_out Capacity of `out`
+ *
+ * @return The number of meshes found, might be larger than `max_out`
+ */
+size_t      spatial_query_frustum   (spatial_t* index, frustum_t* frustum, mesh_t** out, size_t max_out);
+/**
+ * @brief Finds the meshes whose bounding box overlaps a box
+ *
+ * @return The number of meshes found, might be larger than `max_out`
+ */
+size_t      spatial_query_box       (spatial_t* index, aabb_t* box, mesh_t** out, size_t max_out);
+/**
+ * @brief Finds the meshes whose bounding box is crossed by a ray, from its
+ *        origin towards its end and beyond
+ *
+ * @return The number of meshes found, might be larger than `max_out`
+ */
+size_t      spatial_query_ray       (spatial_t* index, ray_t* ray, mesh_t** out, size_t max_out);
+/**
+ * @brief Frees the index - the meshes in it stay, and are in no index any more.
+ *        Free it before the meshes it holds if they're released all at once
+ *        with `arena_free`.
+ */
+void        spatial_free            (spatial_t* index);
+
+#endif /* SPATIAL_H */
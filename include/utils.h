@@ -2,6 +2,7 @@
 #define UTILS_H 
 
 #include <stdbool.h>
+#include <time.h> // struct timespec
 
 // TODO:
 // #define INLINE inline __attribute__((always_inline))
@@ -53,4 +54,45 @@ inline bool ut_float_equal(float a, float b) {
  */
 bool ut_is_decimal(char* string);
 
+/**
+ * @brief Seconds elapsed since a time taken with
+ *        `clock_gettime(CLOCK_MONOTONIC, ...)`
+ *
+ * @param t0 The start time
+ * @return The seconds since `t0`
+ */
+double ut_secs_since(const struct timespec* t0);
+
+#ifdef UT_ALLOC_STATS
+/*
+ * Allocation instrumentation, enabled with `make ALLOC_STATS=1`, which also
+ * includes this header first in every source file. All heap allocations of
+ * the project then go through the wrappers below, which count calls and bytes
+ * per subsystem, i.e. per source file.
+ */
+#include <stdlib.h> // declare the real functions before they're redefined
+#include <stdio.h> // FILE
+
+void*  ut_malloc        (size_t size, const char* subsystem);
+void*  ut_calloc        (size_t n, size_t size, const char* subsystem);
+void*  ut_realloc       (void* ptr, size_t size, const char* subsystem);
+void   ut_free          (void* ptr);
+/**
+ * @brief Number of allocations (malloc, calloc and realloc calls) made so far
+ */
+size_t ut_alloc_count   ();
+/**
+ * @brief Prints the calls and bytes of each subsystem
+ *
+ * @param stream Where to print, e.g. stderr
+ * @param title  Printed in the header, e.g. "init"
+ */
+void   ut_alloc_report  (FILE* stream, const char* title);
+
+#define malloc(size)       ut_malloc(size, __FILE__)
+#define calloc(n, size)    ut_calloc(n, size, __FILE__)
+#define realloc(ptr, size) ut_realloc(ptr, size, __FILE__)
+#define free(ptr)          ut_free(ptr)
+#endif /* UT_ALLOC_STATS */
+
 #endif /* UTILS_H */
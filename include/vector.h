@@ -2,6 +2,9 @@
 #define VECTOR_H 
 
 #include <stdbool.h> // bool 
+#include <stddef.h> // size_t
+#include <stdint.h> // int32_t, int64_t
+#include <math.h> // lrintf
 
 typedef struct vec3i {
     int x, y, z;
@@ -14,6 +17,71 @@ typedef struct vec3f {
 // alias for floating vector type
 typedef vec3f_t vec3_t;
 
+/*
+ * Affine transform stored as a 3x4 matrix [R | t], where R is the 3x3
+ * rotation and t the translation. It maps X to R*X + t.
+ */
+typedef struct mat34 {
+    float m[3][4];
+} mat34_t;
+
+/*
+ * Numeric type of the world space pipeline - rest pose, transformed vertices,
+ * ray-plane intersections and projections. It's float by default. Define
+ * VEC_FIXED_POINT (make FIXED_POINT=1) to use 16.16 fixed point instead.
+ * Either way, coordinates become integers only when they're rasterized.
+ */
+#ifdef VEC_FIXED_POINT
+typedef int32_t coord_t;
+// product of two coordinates before it's scaled back
+typedef int64_t coord_wide_t;
+#define COORD_FRAC_BITS 16
+#define COORD_ONE (1 << COORD_FRAC_BITS)
+#define COORD_FROM_INT(i)          ((coord_t) ((i) * COORD_ONE))
+#define COORD_FROM_FLOAT(f)        ((coord_t) lrintf((f) * COORD_ONE))
+#define COORD_FROM_RATIO(num, den) ((coord_t) ((coord_wide_t) (num) * COORD_ONE / (den)))
+#define COORD_TO_FLOAT(c)          ((float) (c) / COORD_ONE)
+// to the nearest integer
+#define COORD_TO_INT(c)            ((int) (((c) + COORD_ONE/2) >> COORD_FRAC_BITS))
+// towards zero
+#define COORD_TRUNC(c)             ((int) ((c) / COORD_ONE))
+#define COORD_MUL(a, b)            ((coord_t) ((coord_wide_t) (a) * (b) >> COORD_FRAC_BITS))
+#define COORD_DIV(a, b)            ((coord_t) ((coord_wide_t) (a) * COORD_ONE / (b)))
+#else
+typedef float coord_t;
+typedef float coord_wide_t;
+#define COORD_FROM_INT(i)          ((coord_t) (i))
+#define COORD_FROM_FLOAT(f)        ((coord_t) (f))
+#define COORD_FROM_RATIO(num, den) ((coord_t) (num) / (den))
+#define COORD_TO_FLOAT(c)          (c)
+#define COORD_TO_INT(c)            ((int) lrintf(c))
+#define COORD_TRUNC(c)             ((int) (c))
+#define COORD_MUL(a, b)            ((a) * (b))
+#define COORD_DIV(a, b)            ((a) / (b))
+#endif
+
+typedef struct vec3c {
+    coord_t x, y, z;
+} vec3c_t;
+
+/*
+ * Structure of arrays (SoA) of 3D points. The x, y and z of all points are
+ * stored contiguously so the batch operations below process several points
+ * per instruction. They use AVX2 or SSE2 if the compiler targets them (e.g.
+ * with -mavx2) and plain loops otherwise, if VEC_SCALAR is defined or with
+ * fixed point coordinates. Every path performs the same operations in the
+ * same order.
+ */
+typedef struct vec3_soa {
+    coord_t* x;
+    coord_t* y;
+    coord_t* z;
+    // number of points
+    size_t n;
+    // number of points allocated
+    size_t capacity;
+} vec3_soa_t;
+
 // basic operations between floating vectors
 vec3_t*  vec_vec3_new           ();
 void     vec_vec3_set           (vec3_t* vec, float x, float y, float z);
@@ -69,4 +137,66 @@ vec3i_t  vec_vec3i_crossprod    (vec3i_t* src1, vec3i_t* src2);
 void     vec_vec3i_rotate       (vec3i_t* src, float angle_x_rad, float angle_y_rad, float angle_z_rad,
                                  int x0, int y0, int z0);
 
+// affine transforms
+void     vec_mat34_identity     (mat34_t* mat);
+/**
+ * @brief Sets a transform that rotates about the x axis, then y, then z
+ *        (like `vec_vec3i_rotate`) and then translates
+ *
+ * @param[out] mat         Pointer to the transform to write to
+ * @param      angle_x_rad Angle to rotate about x axis in radians
+ * @param      angle_y_rad Angle to rotate about y axis in radians
+ * @param      angle_z_rad Angle to rotate about z axis in radians
+ * @param      tx          Translation along x
+ * @param      ty          Translation along y
+ * @param      tz          Translation along z
+ */
+void     vec_mat34_from_euler   (mat34_t* mat, float angle_x_rad, float angle_y_rad, float angle_z_rad,
+                                 float tx, float ty, float tz);
+/**
+ * @brief Finds the angles `vec_mat34_from_euler` would need to produce the
+ *        rotation of a transform
+ */
+void     vec_mat34_to_euler     (mat34_t* mat, float* angle_x_rad, float* angle_y_rad, float* angle_z_rad);
+/**
+ * @brief Composes two transforms - the result applies `src2` first, then `src1`
+ *
+ * @param[out] dest Pointer to the product src1*src2, must not alias the sources
+ * @param      src1 Pointer to the outer transform
+ * @param      src2 Pointer to the inner transform
+ */
+void     vec_mat34_mul          (mat34_t* dest, mat34_t* src1, mat34_t* src2);
+
+// batch operations over SoA arrays - the destination must hold as many points as the sources
+vec3_soa_t* vec_soa_new         (size_t n);
+/**
+ * @brief Sets the number of points, reallocating only if it grows past the capacity
+ */
+void     vec_soa_resize         (vec3_soa_t* soa, size_t n);
+/**
+ * @brief Makes room for at least `capacity` points without changing their number
+ */
+void     vec_soa_reserve        (vec3_soa_t* soa, size_t capacity);
+void     vec_soa_free           (vec3_soa_t* soa);
+/**
+ * @brief Transforms each point by an affine transform, dest[i] = mat*src[i]
+ */
+void     vec_batch_transform    (vec3_soa_t* dest, mat34_t* mat, vec3_soa_t* src);
+void     vec_batch_dotprod      (coord_t* dest, vec3_soa_t* src1, vec3_soa_t* src2);
+void     vec_batch_crossprod    (vec3_soa_t* dest, vec3_soa_t* src1, vec3_soa_t* src2);
+/**
+ * @brief Finds the smallest box that contains all points
+ *
+ * @param[out] min Pointer to the minimum x, y, z of the points
+ * @param[out] max Pointer to the maximum x, y, z of the points
+ * @param      src Pointer to the points, at least one
+ */
+void     vec_batch_bounds       (vec3c_t* min, vec3c_t* max, vec3_soa_t* src);
+/**
+ * @brief Projects each point on the plane z = 1, scaled - dest[i] is
+ *        (scale*x/z, scale*y/z, z). Points with z = 0 have no projection,
+ *        their x and y are meaningless.
+ */
+void     vec_batch_persp_divide (vec3_soa_t* dest, vec3_soa_t* src, float scale);
+
 #endif /* VECTOR_H */
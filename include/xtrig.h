@@ -2,20 +2,40 @@
 #define XTRIG_H
 
 #include <stdio.h>
+#include <stddef.h> // size_t
 #include <math.h>
 
-#define LUT_BIN_SIZE 0.00174533 // in radians
+#define LUT_SIZE 1024 // power of 2 so indices wrap with a mask
+#define LUT_BIN_SIZE (2.0 * M_PI / LUT_SIZE) // in radians
 #define HALF_PI (M_PI / 2.0)
-#define LUT_SIZE 901 // (int)(HALF_PI/ LUT_BIN_SIZE + 1)
 
-/** sine lookup table (LUT) with sampled values from 0 to pi/2 */
-extern double sine_lut[LUT_SIZE];
+/**
+ * sine lookup table (LUT) with sampled values over a full period [0, 2pi].
+ * The extra entry repeats the first one so interpolation never wraps.
+ */
+extern float sine_lut[LUT_SIZE + 1];
 
-/** Initialize lookup tables - must be called before fsin or fcos */
+/** Initialize lookup tables - must be called before any of the functions below */
 void ftrig_init_lut();
 /** fast sine */
 double fsin(double angle);
 /** fast cosine */
 double fcos(double angle);
+/**
+ * @brief Fast sine and cosine of the same angle with a single range reduction.
+ *        Linearly interpolates the LUT, with an absolute error below 5e-6.
+ */
+void fsincos(double angle, float* sine, float* cosine);
+/**
+ * @brief Fast sine and cosine of `n` angles at once, with an absolute error
+ *        below 1e-6 for angles within +-1e4 rad. Instead of the LUT, whose
+ *        lookups would need a gather per lane, each angle is reduced to
+ *        [-pi/4, pi/4] around the nearest multiple of pi/2 and evaluated with
+ *        a polynomial, all in float lanes, so the compiler vectorises the
+ *        loop with SSE2 or AVX2. Larger angles lose precision like any float
+ *        reduction does and angles beyond 2^22 quarter turns (6.5e6 rad)
+ *        give meaningless values, so prefer `fsincos` for them.
+ */
+void fsincos_array(const float* angles, float* sines, float* cosines, size_t n);
 
 #endif // XTRIG_H
@@ -2,62 +2,261 @@
 #include "renderer.h"
 #include "arg_parser.h"
 #include "xtrig.h"
-#include "utils.h" // UT_MAX
+#include "sink.h"
+#include "cast.h"
+#include "export.h"
+#include "cache.h"
+#include "quality.h"
+#include "lod.h"
+#include "utils.h" // UT_MAX, ut_secs_since
 #include <math.h> // sin, cos
 #include <unistd.h> // for usleep
 #include <stdlib.h> // exit
 #include <time.h> // time
 #include <signal.h> // signal
+#include <stdio.h> // fprintf
+#include <limits.h> // UINT_MAX
+
+// spinning parameters in case random rotation was selected
+#ifndef _WIN32
+static const float random_rot_speed_x = 0.002, random_rot_speed_y = 0.002, random_rot_speed_z = 0.002;
+static const float amplitude_x = 4.25, amplitude_y = 4.25, amplitude_z = 4.25;
+#else
+// make it spin faster on Windows because terminal refresh functions are sluggish there
+static const float random_rot_speed_x = 0.01, random_rot_speed_y = 0.01, random_rot_speed_z = 0.01;
+static const float amplitude_x = 6.0, amplitude_y = 6.0, amplitude_z = 6.0;
+#endif
+
+/*
+ * Steps the shape has moved by frame `t` when bouncing. Frame `s` takes a step
+ * back if (s % 2N) < N, otherwise forward, so whole periods cancel out.
+ */
+static long bounce_steps(size_t t) {
+    const long n = g_bounce_every;
+    const long rest = (t + 1) % (2*n);
+    return -UT_MIN(rest, n) + UT_MAX(rest - n, 0);
+}
+
+/*
+ * Places the shape the way it is in frame `t`. It only depends on `t`, so frames
+ * can be rendered in any order - `start` is where the shape was created.
+ */
+static void pose_shape(mesh_t* shape, size_t t, void* start) {
+    if (g_use_random_rotation)
+        obj_mesh_rotate_to(shape, amplitude_x*fsin(random_rot_speed_x*fsin(random_rot_speed_x*t) + 2*random_bias_x),
+                                  amplitude_y*fsin(random_rot_speed_y*random_bias_y*t            + 2*random_bias_y),
+                                  amplitude_z*fsin(random_rot_speed_z*random_bias_z*t            + 2*random_bias_z));
+    else
+        obj_mesh_rotate_to(shape, g_rot_speed_x/20*t, g_rot_speed_y/20*t, g_rot_speed_z/20*t);
+    if (g_bounce_every != 0) {
+        const vec3i_t* center = start;
+        const long steps = bounce_steps(t);
+        obj_mesh_translate_to(shape, center->x + steps*g_move_x, center->y + steps*g_move_y,
+                                     center->z + steps*g_move_z);
+    }
+}
+
+/* Reads the shape from `g_mesh_file` or generates it if `g_generate` says so, NULL if it can't */
+static mesh_t* load_shape() {
+    mesh_t* shape;
+    if (g_generate[0] != '\0') {
+        shape = obj_mesh_generate(g_generate, g_cx, g_cy, g_cz, g_width, g_height, g_depth);
+        if (shape == NULL) {
+            fprintf(stderr, "Invalid shape to generate: %s\n", g_generate);
+            return NULL;
+        }
+    } else {
+        shape = obj_mesh_from_file(g_mesh_file, g_cx, g_cy, g_cz, g_width, g_height, g_depth);
+    }
+    lod_build(shape, g_lod_levels);
+    // shared edges are drawn once, so they're found once
+    if (g_renderer.use_wireframe)
+        obj_mesh_build_edges(shape);
+    return shape;
+}
+
+/* Renders frames [g_export_from, g_max_iterations) offline to `g_export` */
+static int export_frames() {
+    export_format_t format;
+    const char* path;
+    if (!export_parse_spec(g_export, &format, &path)) {
+        fprintf(stderr, "Invalid export: %s\n", g_export);
+        return 1;
+    }
+    if ((g_max_iterations == UINT_MAX) || (g_export_from >= g_max_iterations)) {
+        fprintf(stderr, "Exporting needs a last frame, e.g. -mi 1000\n");
+        return 1;
+    }
+    // size the frames like the terminal's unless -sr and -sc say otherwise
+    mesh_t* shape = load_shape();
+    if (shape == NULL)
+        return 1;
+    screen_t screen;
+    screen_init_sink_r(&screen, g_screen_rows, g_screen_cols, sink_null_new());
+    vec3i_t start = *shape->center;
+    export_job_t job = {
+        .mesh = shape,
+        .pose = pose_shape,
+        .user = &start,
+        .t_first = g_export_from,
+        .n_frames = g_max_iterations - g_export_from,
+        .rows = screen.rows,
+        .cols = screen.cols,
+        .screen_res = screen.screen_res,
+        .settings = g_renderer,
+        .format = format,
+        .fps = g_fps,
+        .n_threads = g_jobs
+    };
+    screen_end_r(&screen);
+    const bool is_ok = export_run(&job, path);
+    obj_mesh_free(shape);
+    if (!is_ok) {
+        fprintf(stderr, "Can't write %s\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+// frames seen before, NULL unless -ca is given and the pose repeats
+static cache_t* g_cache = NULL;
+// picks the detail that holds the frame rate, NULL unless -aq is given
+static quality_t* g_quality = NULL;
+
+/* Prints how the cache did, or why there was none although -ca asked for one */
+static void report_cache() {
+    if (g_cache != NULL)
+        cache_report(g_cache, stderr);
+    else if (g_cache_mib > 0)
+        fprintf(stderr, "cache: off, the pose never repeats - random rotation does not, spinning does "
+                        "if -sx, -sy and -sz are small multiples of a common speed\n");
+}
 
 /* Callback that clears the screen and makes the cursor visible when the user hits Ctr+C */
 static void interrupt_handler(int int_num) {
     if (int_num == SIGINT) {
         render_end();
+        report_cache();
+        if (g_quality != NULL)
+            quality_report(g_quality, stderr);
         exit(SIGINT);
     }
 }
 
 int main(int argc, char** argv) {
     arg_parse(argc, argv);
+    // replay a recording instead of rendering
+    if (g_play_file[0] != '\0') {
+        if (!cast_play(g_play_file, g_play_speed)) {
+            fprintf(stderr, "Can't play %s - not an asciicast v2 file\n", g_play_file);
+            return 1;
+        }
+        return 0;
+    }
+    if (g_export[0] != '\0') {
+        ftrig_init_lut();
+        return export_frames();
+    }
 
     // make sure we end gracefully if the user hits Ctr+C
     signal(SIGINT, interrupt_handler);
 
-    render_init();
+    // the mesh's pose is computed with the LUT
     ftrig_init_lut();
+    // before the terminal is taken over, so errors can be read
+    mesh_t* shape = load_shape();
+    if (shape == NULL)
+        return 1;
+    sink_t* sink = sink_from_spec(g_output);
+    if (sink == NULL) {
+        fprintf(stderr, "Invalid output: %s\n", g_output);
+        obj_mesh_free(shape);
+        return 1;
+    }
+    render_init_sink(sink, g_screen_rows, g_screen_cols);
 
-    mesh_t* shape = obj_mesh_from_file(g_mesh_file, g_cx, g_cy, g_cz, g_width, g_height, g_depth);
-    // spinning parameters in case random rotation was selected
-#ifndef _WIN32
-    const float random_rot_speed_x = 0.002, random_rot_speed_y = 0.002, random_rot_speed_z = 0.002;
-    const float amplitude_x = 4.25, amplitude_y = 4.25, amplitude_z = 4.25;
-#else
-    // make it spin faster on Windows because terminal refresh functions are sluggish there
-    const float random_rot_speed_x = 0.01, random_rot_speed_y = 0.01, random_rot_speed_z = 0.01;
-    const float amplitude_x = 6.0, amplitude_y = 6.0, amplitude_z = 6.0;
+    vec3i_t start = *shape->center;
+    // frames repeat only if the pose does, so spinning is keyed by its cycle
+    cache_spin_t spin;
+    if ((g_cache_mib > 0) && !g_use_random_rotation &&
+        cache_spin_init(&spin, g_rot_speed_x/20, g_rot_speed_y/20, g_rot_speed_z/20))
+        g_cache = cache_new(g_cache_mib * 1024 * 1024);
+    // without a frame rate there is no budget to hold
+    quality_t quality;
+    if (g_use_adaptive_quality && (g_fps != 0)) {
+        quality_init(&quality, g_fps);
+        g_quality = &quality;
+    }
+    // sampling step of the frame on the screen
+    unsigned drawn_step = g_renderer.sample_step;
+#ifdef UT_ALLOC_STATS
+    ut_alloc_report(stderr, "init");
+    // allocations made before the steady state, i.e. by init and the first frame
+    size_t n_allocs_warmup = 0;
+    // the cache allocates once per frame it stores, those are expected
+    size_t n_cached_warmup = 0;
 #endif
     for (size_t t = 0; t < g_max_iterations; ++t) {
-        if (g_use_random_rotation)
-            obj_mesh_rotate_to(shape, amplitude_x*fsin(random_rot_speed_x*fsin(random_rot_speed_x*t) + 2*random_bias_x),
-                                      amplitude_y*fsin(random_rot_speed_y*random_bias_y*t            + 2*random_bias_y),
-                                      amplitude_z*fsin(random_rot_speed_z*random_bias_z*t            + 2*random_bias_z));
-        else
-            obj_mesh_rotate_to(shape, g_rot_speed_x/20*t, g_rot_speed_y/20*t, g_rot_speed_z/20*t);
-		if (g_bounce_every != 0) {
-			if ((t % (2*g_bounce_every)) >= g_bounce_every)
-				obj_mesh_translate_by(shape, g_move_x, g_move_y, g_move_z);
-			else
-				obj_mesh_translate_by(shape, -g_move_x, -g_move_y, -g_move_z);
-		}
-        render_write_shape(shape);
-        render_flush();
+        struct timespec t_frame;
+        clock_gettime(CLOCK_MONOTONIC, &t_frame);
+        pose_shape(shape, t, &start);
+        // the camera never moves, so if the shape didn't either, neither did the frame
+        if ((t > 0) && !shape->transform.is_dirty && (g_renderer.sample_step == drawn_step)) {
+            screen_repeat();
+        } else if (g_cache == NULL) {
+            render_write_shape(shape);
+            render_flush();
+        } else {
+            // the pose is all that changes, so it tells frames apart
+            const cache_key_t key = cache_key_of_spin(&spin, t, shape, g_renderer.sample_step);
+            if (cache_get(g_cache, key, g_screen.buffer, g_screen.rows, g_screen.cols)) {
+                screen_mark_drawn_r(&g_screen);
+            } else {
+                render_write_shape(shape);
+                cache_put(g_cache, key, g_screen.buffer, g_screen.rows, g_screen.cols);
+            }
+            render_flush();
+        }
+        drawn_step = g_renderer.sample_step;
+        // the time the frame took counts against the budget, and sets the next one's detail
+        double sleep_secs = (g_fps != 0) ? 1.0 / g_fps : 0;
+        if (g_quality != NULL) {
+            const double frame_secs = ut_secs_since(&t_frame);
+            g_renderer.sample_step = quality_update(g_quality, frame_secs);
+            sleep_secs = UT_MAX(sleep_secs - frame_secs, 0.0);
+        }
 #ifndef _WIN32
-        // nanosleep does not work on Windows
-        nanosleep((const struct timespec[]) {{0, (int)(1.0 / g_fps * 1e9)}}, NULL);
+        // nanosleep does not work on Windows - 0 fps runs unthrottled
+        if (sleep_secs > 0)
+            nanosleep((const struct timespec[]) {{0, (int)(sleep_secs * 1e9)}}, NULL);
+#endif
+#ifdef UT_ALLOC_STATS
+        // the first frame sizes the renderer's scratch buffers, the rest must not allocate
+        if (t == 0) {
+            n_allocs_warmup = ut_alloc_count();
+            n_cached_warmup = (g_cache != NULL) ? g_cache->stats.n_stored : 0;
+        }
 #endif
     }
+#ifdef UT_ALLOC_STATS
+    const size_t n_cached = (g_cache != NULL) ? g_cache->stats.n_stored - n_cached_warmup : 0;
+    const size_t n_allocs_steady = (g_max_iterations > 0) ? ut_alloc_count() - n_allocs_warmup - n_cached : 0;
+#endif
     obj_mesh_free(shape);
     render_end();
+    // after the terminal is cleared so it stays visible
+    report_cache();
+    if (g_cache != NULL)
+        cache_free(g_cache);
+    if (g_quality != NULL)
+        quality_report(g_quality, stderr);
+#ifdef UT_ALLOC_STATS
+    ut_alloc_report(stderr, "teardown");
+    fprintf(stderr, "allocations in the steady state frame loop: %zu\n", n_allocs_steady);
+    // fail loudly so scripts can check it
+    if (n_allocs_steady != 0)
+        return 1;
+#endif
 
     return 0;
 }
@@ -25,8 +25,10 @@ stdenv.mkDerivation rec {
 	# build and install retrocube
 	installPhase = ''
 		make PREFIX=$out
-		mkdir $out/bin
+		mkdir $out/bin $out/lib $out/include
 		cp cube $out/bin
+		cp -P libretrocube.a libretrocube.so* $out/lib
+		cp include/*.h $out/include
 	'';
 
 	meta = with lib; {
@@ -0,0 +1,58 @@
+#include "arena.h"
+#include "utils.h" // UT_MAX
+#include <stdlib.h> // malloc, free
+#include <stddef.h> // size_t
+
+//----------------------------------------------------------------------------------------------------------
+// Static functions
+//----------------------------------------------------------------------------------------------------------
+/* the data of a block starts right after its aligned header */
+static inline unsigned char* arena__block_data(arena_block_t* block) {
+    return (unsigned char*) block + arena_aligned_size(sizeof(arena_block_t));
+}
+
+static arena_block_t* arena__block_new(size_t size, arena_block_t* next) {
+    arena_block_t* block = malloc(arena_aligned_size(sizeof(arena_block_t)) + size);
+    block->next = next;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// External functions
+//----------------------------------------------------------------------------------------------------------
+size_t arena_aligned_size(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+}
+
+arena_t* arena_new(size_t block_size) {
+    // the arena itself lives at the start of its first block
+    const size_t header_size = arena_aligned_size(sizeof(arena_t));
+    block_size = arena_aligned_size(block_size);
+    arena_block_t* first = arena__block_new(header_size + block_size, NULL);
+    arena_t* new = (arena_t*) arena__block_data(first);
+    first->used = header_size;
+    new->block_size = block_size;
+    new->head = first;
+    return new;
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+    size = arena_aligned_size(size);
+    if (arena->head->used + size > arena->head->size)
+        arena->head = arena__block_new(UT_MAX(arena->block_size, size), arena->head);
+    void* ptr = arena__block_data(arena->head) + arena->head->used;
+    arena->head->used += size;
+    return ptr;
+}
+
+void arena_free(arena_t* arena) {
+    arena_block_t* block = arena->head;
+    while (block != NULL) {
+        arena_block_t* next = block->next;
+        // the first block, freed last, holds the arena
+        free(block);
+        block = next;
+    }
+}
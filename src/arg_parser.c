@@ -29,6 +29,7 @@ unsigned g_depth = 60;
 // how many frames to run the program for
 unsigned g_max_iterations = UINT_MAX;
 char g_mesh_file[256] = {'\0'};
+char g_generate[256] = {'\0'};
 // defines the max and min values of random rotation bias
 float rand_min = 0.75, rand_max = 2.25;
 // random rotation biases - the higher, the faster the rotation around x, y,
@@ -42,6 +43,17 @@ unsigned g_bounce_every = 0;
 int g_move_x = 2;
 int g_move_y = 1;
 int g_move_z = 1;
+char g_output[256] = "tty";
+char g_export[256] = {'\0'};
+unsigned g_export_from = 0;
+unsigned g_jobs = 0;
+float g_cache_mib = 0;
+bool g_use_adaptive_quality = false;
+unsigned g_lod_levels = 6;
+char g_play_file[256] = {'\0'};
+float g_play_speed = 1.0;
+int g_screen_rows = 0;
+int g_screen_cols = 0;
 
 
 void arg_parse(int argc, char** argv) {
@@ -86,10 +98,19 @@ void arg_parse(int argc, char** argv) {
             render_use_perspective(0, 0, -200);
         } else if ((strcmp(argv[i], "--use-reflection") == 0) || (strcmp(argv[i], "-ur") == 0)) {
             render_use_reflectance();
+        } else if ((strcmp(argv[i], "--wireframe") == 0) || (strcmp(argv[i], "-wf") == 0)) {
+            render_use_wireframe(false);
+        } else if ((strcmp(argv[i], "--hidden-lines") == 0) || (strcmp(argv[i], "-hl") == 0)) {
+            render_use_wireframe(true);
+        } else if ((strcmp(argv[i], "--painter") == 0) || (strcmp(argv[i], "-pa") == 0)) {
+            render_use_painter();
         } else if ((strcmp(argv[i], "--from-file") == 0) || (strcmp(argv[i], "-ff") == 0)) {
             i++;
             strcpy(g_mesh_file, argv[i]);
             render_from_file = true;
+        } else if ((strcmp(argv[i], "--generate") == 0) || (strcmp(argv[i], "-g") == 0)) {
+            i++;
+            strncpy(g_generate, argv[i], sizeof(g_generate) - 1);
         } else if ((strcmp(argv[i], "--bounce") == 0) || (strcmp(argv[i], "-b") == 0)) {
             g_bounce_every = atoi(argv[++i]);
         } else if ((strcmp(argv[i], "--movex") == 0) || (strcmp(argv[i], "-mx") == 0)) {
@@ -98,6 +119,31 @@ void arg_parse(int argc, char** argv) {
             g_move_y = atoi(argv[++i]);
         } else if ((strcmp(argv[i], "--movez") == 0) || (strcmp(argv[i], "-mz") == 0)) {
             g_move_z = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--output") == 0) || (strcmp(argv[i], "-o") == 0)) {
+            i++;
+            strncpy(g_output, argv[i], sizeof(g_output) - 1);
+        } else if ((strcmp(argv[i], "--export") == 0) || (strcmp(argv[i], "-e") == 0)) {
+            i++;
+            strncpy(g_export, argv[i], sizeof(g_export) - 1);
+        } else if ((strcmp(argv[i], "--export-from") == 0) || (strcmp(argv[i], "-ef") == 0)) {
+            g_export_from = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--jobs") == 0) || (strcmp(argv[i], "-j") == 0)) {
+            g_jobs = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--cache") == 0) || (strcmp(argv[i], "-ca") == 0)) {
+            g_cache_mib = atof(argv[++i]);
+        } else if ((strcmp(argv[i], "--adaptive-quality") == 0) || (strcmp(argv[i], "-aq") == 0)) {
+            g_use_adaptive_quality = true;
+        } else if ((strcmp(argv[i], "--lod") == 0) || (strcmp(argv[i], "-lod") == 0)) {
+            g_lod_levels = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--play") == 0) || (strcmp(argv[i], "-p") == 0)) {
+            i++;
+            strncpy(g_play_file, argv[i], sizeof(g_play_file) - 1);
+        } else if ((strcmp(argv[i], "--play-speed") == 0) || (strcmp(argv[i], "-ps") == 0)) {
+            g_play_speed = atof(argv[++i]);
+        } else if ((strcmp(argv[i], "--screen-rows") == 0) || (strcmp(argv[i], "-sr") == 0)) {
+            g_screen_rows = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--screen-cols") == 0) || (strcmp(argv[i], "-sc") == 0)) {
+            g_screen_cols = atoi(argv[++i]);
         } else {
             printf("Uknown option: %s\n", argv[i++]);
         }
@@ -0,0 +1,230 @@
+#include "cache.h"
+#include "xtrig.h" // LUT_SIZE, LUT_BIN_SIZE
+#include "utils.h" // UT_MAX
+#include <stdlib.h> // malloc, calloc, realloc, free
+#include <string.h> // memset, memcpy
+#include <math.h> // floor, fmod, fabs, round, M_PI
+#include <stdint.h> // uint64_t
+
+// longest run of a character an encoded pair holds
+#define CACHE_MAX_RUN 256
+
+typedef struct cache_entry {
+    // next in the same bucket
+    struct cache_entry* next;
+    // neighbours in the LRU list
+    struct cache_entry* newer;
+    struct cache_entry* older;
+    cache_key_t key;
+    int rows;
+    int cols;
+    size_t size;
+    // `size` bytes of (run length - 1, character) pairs
+    unsigned char data[];
+} cache_entry_t;
+
+//----------------------------------------------------------------------------------
+// Static functions
+//----------------------------------------------------------------------------------
+static inline bool cache__key_equal(const cache_key_t* a, const cache_key_t* b) {
+    return (a->phase == b->phase) && (a->x == b->x) && (a->y == b->y) && (a->z == b->z) &&
+           (a->sample_step == b->sample_step);
+}
+
+static inline size_t cache__hash(const cache_key_t* key) {
+    const int fields[] = {(int) key->phase, key->x, key->y, key->z, key->sample_step};
+    uint64_t hash = 0;
+    for (size_t i = 0; i < sizeof(fields)/sizeof(fields[0]); ++i) {
+        hash = (hash ^ (uint32_t) fields[i]) * 0x9e3779b97f4a7c15ull;
+        hash ^= hash >> 29;
+    }
+    return (size_t) hash;
+}
+
+static inline size_t cache__entry_bytes(const cache_entry_t* entry) {
+    return sizeof(cache_entry_t) + entry->size;
+}
+
+static cache_entry_t** cache__find(cache_t* cache, const cache_key_t* key) {
+    cache_entry_t** link = &cache->buckets[cache__hash(key) & (cache->n_buckets - 1)];
+    while ((*link != NULL) && !cache__key_equal(&(*link)->key, key))
+        link = &(*link)->next;
+    return link;
+}
+
+static void cache__lru_unlink(cache_t* cache, cache_entry_t* entry) {
+    if (entry->newer != NULL)
+        entry->newer->older = entry->older;
+    else
+        cache->newest = entry->older;
+    if (entry->older != NULL)
+        entry->older->newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+}
+
+static void cache__lru_push(cache_t* cache, cache_entry_t* entry) {
+    entry->newer = NULL;
+    entry->older = cache->newest;
+    if (cache->newest != NULL)
+        cache->newest->newer = entry;
+    else
+        cache->oldest = entry;
+    cache->newest = entry;
+}
+
+/* removes the entry `link` points to from its bucket and the LRU list */
+static void cache__remove(cache_t* cache, cache_entry_t** link) {
+    cache_entry_t* entry = *link;
+    *link = entry->next;
+    cache__lru_unlink(cache, entry);
+    cache->stats.bytes -= cache__entry_bytes(entry);
+    cache->stats.bytes_raw -= (size_t)entry->rows*entry->cols*sizeof(color_t);
+    cache->stats.n_entries--;
+    free(entry);
+}
+
+static void cache__evict_oldest(cache_t* cache) {
+    cache__remove(cache, cache__find(cache, &cache->oldest->key));
+    cache->stats.n_evicted++;
+}
+
+/* run-length encodes a frame into `dest`, which holds at least 2 bytes per character */
+static size_t cache__encode(unsigned char* dest, const color_t* frame, size_t n_chars) {
+    size_t size = 0;
+    for (size_t i = 0; i < n_chars;) {
+        size_t run = 1;
+        while ((i + run < n_chars) && (run < CACHE_MAX_RUN) && (frame[i + run] == frame[i]))
+            ++run;
+        dest[size++] = (unsigned char) (run - 1);
+        dest[size++] = (unsigned char) frame[i];
+        i += run;
+    }
+    return size;
+}
+
+static void cache__decode(color_t* frame, const unsigned char* data, size_t size) {
+    for (size_t i = 0; i < size; i += 2) {
+        const size_t run = (size_t)data[i] + 1;
+        memset(frame, (color_t) data[i + 1], run);
+        frame += run;
+    }
+}
+
+//----------------------------------------------------------------------------------
+// External functions
+//----------------------------------------------------------------------------------
+cache_t* cache_new(size_t budget) {
+    cache_t* new = malloc(sizeof(cache_t));
+    // a bucket per smallest frame the budget fits - there are never more
+    // entries than that, and each store after this is a single allocation
+    new->n_buckets = 1;
+    while ((new->n_buckets < budget / CACHE_BYTES_PER_BUCKET) && (new->n_buckets < ((size_t)1 << 24)))
+        new->n_buckets <<= 1;
+    new->buckets = calloc(new->n_buckets, sizeof(cache_entry_t*));
+    new->newest = NULL;
+    new->oldest = NULL;
+    new->budget = budget;
+    memset(&new->stats, 0, sizeof(new->stats));
+    new->scratch = NULL;
+    new->scratch_size = 0;
+    return new;
+}
+
+bool cache_spin_init(cache_spin_t* spin, float speed_x, float speed_y, float speed_z) {
+    const double speeds[] = {fabs(speed_x), fabs(speed_y), fabs(speed_z)};
+    const double fastest = UT_MAX(UT_MAX(speeds[0], speeds[1]), speeds[2]);
+    // standing still repeats every frame
+    if (fastest == 0) {
+        *spin = (cache_spin_t) {.speed = 0, .ratio = 1};
+        return true;
+    }
+    for (int ratio = 1; ratio <= CACHE_MAX_SPIN_RATIO; ++ratio) {
+        const double speed = fastest / ratio;
+        bool is_common = true;
+        // the speeds are floats, e.g. 0.7/20, so multiples are close to integers only
+        for (int i = 0; i < 3; ++i)
+            is_common = is_common && (fabs(speeds[i]/speed - round(speeds[i]/speed)) < 1e-3);
+        if (is_common) {
+            *spin = (cache_spin_t) {.speed = speed, .ratio = ratio};
+            return true;
+        }
+    }
+    return false;
+}
+
+cache_key_t cache_key_of_spin(const cache_spin_t* spin, size_t t, const mesh_t* mesh, unsigned sample_step) {
+    // the phase turns once per cycle, in which the fastest angle turns `ratio` times
+    const double phase = fmod(spin->speed * t, 2.0 * M_PI);
+    return (cache_key_t) {
+        .phase = (long) floor(phase * spin->ratio / LUT_BIN_SIZE) % ((long) spin->ratio * LUT_SIZE),
+        .x = mesh->center->x,
+        .y = mesh->center->y,
+        .z = mesh->center->z,
+        .sample_step = sample_step
+    };
+}
+
+bool cache_get(cache_t* cache, cache_key_t key, color_t* frame, int rows, int cols) {
+    cache_entry_t* entry = *cache__find(cache, &key);
+    if ((entry == NULL) || (entry->rows != rows) || (entry->cols != cols)) {
+        cache->stats.n_misses++;
+        return false;
+    }
+    cache__lru_unlink(cache, entry);
+    cache__lru_push(cache, entry);
+    cache__decode(frame, entry->data, entry->size);
+    cache->stats.n_hits++;
+    return true;
+}
+
+void cache_put(cache_t* cache, cache_key_t key, const color_t* frame, int rows, int cols) {
+    const size_t n_chars = (size_t)rows*cols;
+    if (cache->scratch_size < 2*n_chars) {
+        cache->scratch = realloc(cache->scratch, 2*n_chars);
+        cache->scratch_size = 2*n_chars;
+    }
+    const size_t size = cache__encode(cache->scratch, frame, n_chars);
+    if (sizeof(cache_entry_t) + size > cache->budget)
+        return;
+    // a frame of another size under the same key replaces it
+    cache_entry_t** link = cache__find(cache, &key);
+    if (*link != NULL)
+        cache__remove(cache, link);
+    while (cache->stats.bytes + sizeof(cache_entry_t) + size > cache->budget)
+        cache__evict_oldest(cache);
+
+    cache_entry_t* entry = malloc(sizeof(cache_entry_t) + size);
+    entry->key = key;
+    entry->rows = rows;
+    entry->cols = cols;
+    entry->size = size;
+    memcpy(entry->data, cache->scratch, size);
+    link = cache__find(cache, &key);
+    entry->next = *link;
+    *link = entry;
+    cache__lru_push(cache, entry);
+    cache->stats.bytes += cache__entry_bytes(entry);
+    cache->stats.bytes_peak = UT_MAX(cache->stats.bytes_peak, cache->stats.bytes);
+    cache->stats.bytes_raw += n_chars*sizeof(color_t);
+    cache->stats.n_entries++;
+    cache->stats.n_stored++;
+}
+
+void cache_report(cache_t* cache, FILE* stream) {
+    const cache_stats_t* stats = &cache->stats;
+    const size_t n_lookups = stats->n_hits + stats->n_misses;
+    fprintf(stream, "cache: %zu hits out of %zu frames (%.1f%%), %zu frames stored, %zu evicted, "
+                    "%zu held in %zu of %zu bytes (peak %zu), %.1fx smaller than unencoded\n",
+            stats->n_hits, n_lookups, (n_lookups > 0) ? 100.0*stats->n_hits/n_lookups : 0.0,
+            stats->n_stored, stats->n_evicted, stats->n_entries, stats->bytes, cache->budget,
+            stats->bytes_peak, (stats->bytes > 0) ? (double)stats->bytes_raw/stats->bytes : 0.0);
+}
+
+void cache_free(cache_t* cache) {
+    while (cache->oldest != NULL)
+        cache__remove(cache, cache__find(cache, &cache->oldest->key));
+    free(cache->buckets);
+    free(cache->scratch);
+    free(cache);
+}
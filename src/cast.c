@@ -0,0 +1,281 @@
+#include "cast.h"
+#include "sink.h"
+#include "objects.h" // color_t
+#include "utils.h" // ut_secs_since
+#include <stdio.h> // FILE, fopen, fprintf, fgets
+#include <stdlib.h> // malloc, realloc, free, strtod
+#include <string.h> // memcpy, strchr, strstr
+#include <stdbool.h> // bool
+#include <stddef.h> // size_t
+#include <time.h> // clock_gettime, nanosleep, time
+#include <signal.h> // signal, sig_atomic_t
+
+// longest cursor move, "\u001b[<row>;<col>H"
+#define CAST_MAX_MOVE_LEN 32
+// longest event prefix, "[<time>, "o", ""
+#define CAST_MAX_PREFIX_LEN 64
+
+typedef struct cast_recorder {
+    FILE* file;
+    // the previous frame, which the next one is delta-encoded against
+    color_t* prev;
+    // holds an event while it's encoded - sized for the worst case of a frame
+    char* event;
+    int rows;
+    int cols;
+    struct timespec t_start;
+    // statistics reported at the end
+    size_t n_frames;
+    size_t n_events;
+    size_t n_bytes;
+    double encode_secs;
+} cast_recorder_t;
+
+static volatile sig_atomic_t cast__is_interrupted = 0;
+
+//----------------------------------------------------------------------------------
+// Static functions
+//----------------------------------------------------------------------------------
+/* appends a character as it appears in a JSON string, returns the end */
+static inline char* cast__escape(char* dest, unsigned char c) {
+    if ((c == '"') || (c == '\\')) {
+        *dest++ = '\\';
+        *dest++ = c;
+    } else if ((c < 0x20) || (c >= 0x7f)) {
+        dest += sprintf(dest, "\\u%04x", c);
+    } else {
+        *dest++ = c;
+    }
+    return dest;
+}
+
+/* appends a string of terminal escape codes, returns the end */
+static inline char* cast__escape_str(char* dest, const char* str) {
+    while (*str != '\0')
+        dest = cast__escape(dest, *str++);
+    return dest;
+}
+
+/**
+ * @brief Encodes the characters of a row that changed since the previous frame,
+ *        as runs that start with a cursor move
+ *
+ * @param rec       Recorder holding the previous frame
+ * @param dest      Where to append the encoded row
+ * @param frame     Frame to encode
+ * @param row       Row to encode
+ * @param is_full   Whether to encode the whole row regardless of changes
+ *
+ * @return The end of the encoded row
+ */
+static char* cast__encode_row(cast_recorder_t* rec, char* dest, const color_t* frame, int row, bool is_full) {
+    const size_t row_start = (size_t)row*rec->cols;
+    const color_t* prev = (is_full) ? NULL : &rec->prev[row_start];
+    int col = 0;
+    for (int start; (start = sink_next_run(&frame[row_start], prev, rec->cols, &col)) < rec->cols;) {
+        dest += sprintf(dest, "\\u001b[%d;%dH", row + 1, start + 1);
+        for (int i = start; i < col; ++i)
+            dest = cast__escape(dest, frame[row_start + i]);
+    }
+    return dest;
+}
+
+static void cast__sink_write(sink_t* sink, const color_t* frame, int rows, int cols) {
+    cast_recorder_t* rec = sink->state;
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    const bool is_first = (rec->prev == NULL);
+    // the first frame - or one of a new size - is written in full
+    const bool is_full = is_first || (rows != rec->rows) || (cols != rec->cols);
+    if (is_full) {
+        free(rec->prev);
+        free(rec->event);
+        rec->rows = rows;
+        rec->cols = cols;
+        rec->prev = malloc(sizeof(color_t) * rows * cols);
+        // every character escaped to \uXXXX and a cursor move per row at most
+        rec->event = malloc((size_t)rows*(6*cols + CAST_MAX_MOVE_LEN) + 2*CAST_MAX_PREFIX_LEN);
+    }
+    if (is_first) {
+        rec->t_start = t0;
+        fprintf(rec->file, "{\"version\": 2, \"width\": %d, \"height\": %d, \"timestamp\": %ld}\n",
+                cols, rows, (long)time(NULL));
+    }
+    char* const payload = rec->event + sprintf(rec->event, "[%.6f, \"o\", \"",
+                                               (t0.tv_sec - rec->t_start.tv_sec) +
+                                               1e-9*(t0.tv_nsec - rec->t_start.tv_nsec));
+    char* end = payload;
+    if (is_full)
+        end = cast__escape_str(end, "\033[H\033[J");
+    for (int row = 0; row < rows; ++row)
+        end = cast__encode_row(rec, end, frame, row, is_full);
+    // frames that didn't change produce no event
+    if (end != payload) {
+        end += sprintf(end, "\"]\n");
+        fwrite(rec->event, 1, end - rec->event, rec->file);
+        rec->n_events++;
+        rec->n_bytes += end - rec->event;
+    }
+    memcpy(rec->prev, frame, sizeof(color_t) * rows * cols);
+    rec->n_frames++;
+    rec->encode_secs += ut_secs_since(&t0);
+}
+
+static void cast__sink_close(sink_t* sink) {
+    cast_recorder_t* rec = sink->state;
+    fclose(rec->file);
+    if (rec->n_frames > 0)
+        fprintf(stderr, "recorded %zu frames in %zu events, %zu bytes, %.1f us/frame to encode and write\n",
+                rec->n_frames, rec->n_events, rec->n_bytes, 1e6*rec->encode_secs/rec->n_frames);
+    free(rec->prev);
+    free(rec->event);
+    free(rec);
+}
+
+/* whether the first line of a file is the header of asciicast v2 */
+static bool cast__is_v2_header(const char* line) {
+    const char* version = strstr(line, "\"version\"");
+    const char* colon = (version != NULL) ? strchr(version, ':') : NULL;
+    return (colon != NULL) && (atoi(colon + 1) == 2);
+}
+
+/**
+ * @brief Reads a line, growing the buffer to fit it - like getline, but the
+ *        buffer is allocated with the project's malloc, e.g. counted with
+ *        ALLOC_STATS, so it can be released with its free
+ *
+ * @return Length of the line or -1 at the end of the file
+ */
+static long cast__read_line(char** line, size_t* size, FILE* file) {
+    size_t len = 0;
+    for (;;) {
+        if (*size - len < 2) {
+            *size = (*size == 0) ? 4096 : 2*(*size);
+            *line = realloc(*line, *size);
+        }
+        if (fgets(*line + len, *size - len, file) == NULL)
+            return (len > 0) ? (long)len : -1;
+        len += strlen(*line + len);
+        if ((*line)[len - 1] == '\n')
+            return len;
+    }
+}
+
+static void cast__on_interrupt(int int_num) {
+    cast__is_interrupted = 1;
+}
+
+/**
+ * @brief Decodes a JSON string in place
+ *
+ * @param str The string's characters, right after its opening quote
+ *
+ * @return Number of decoded bytes
+ */
+static size_t cast__unescape(char* str) {
+    char* src = str;
+    char* dest = str;
+    while ((*src != '\0') && (*src != '"')) {
+        if (*src != '\\') {
+            *dest++ = *src++;
+            continue;
+        }
+        src++;
+        switch (*src) {
+            case 'b': *dest++ = '\b'; src++; break;
+            case 'f': *dest++ = '\f'; src++; break;
+            case 'n': *dest++ = '\n'; src++; break;
+            case 'r': *dest++ = '\r'; src++; break;
+            case 't': *dest++ = '\t'; src++; break;
+            case 'u': {
+                char hex[5] = {0};
+                strncpy(hex, src + 1, 4);
+                const unsigned long code = strtoul(hex, NULL, 16);
+                src += 1 + strlen(hex);
+                // code points of a byte are what the recorder escapes - encode
+                // anything else, e.g. from other recorders, as UTF-8
+                if (code < 0x100) {
+                    *dest++ = code;
+                } else if (code < 0x800) {
+                    *dest++ = 0xc0 | (code >> 6);
+                    *dest++ = 0x80 | (code & 0x3f);
+                } else {
+                    *dest++ = 0xe0 | (code >> 12);
+                    *dest++ = 0x80 | ((code >> 6) & 0x3f);
+                    *dest++ = 0x80 | (code & 0x3f);
+                }
+                break;
+            }
+            case '\0': break;
+            // \" \\ \/
+            default: *dest++ = *src++; break;
+        }
+    }
+    return dest - str;
+}
+
+//----------------------------------------------------------------------------------
+// External functions
+//----------------------------------------------------------------------------------
+sink_t* cast_sink_new(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+        return NULL;
+    cast_recorder_t* rec = malloc(sizeof(cast_recorder_t));
+    rec->file = file;
+    rec->prev = NULL;
+    rec->event = NULL;
+    rec->rows = rec->cols = 0;
+    rec->n_frames = rec->n_events = rec->n_bytes = 0;
+    rec->encode_secs = 0;
+    return sink_new(cast__sink_write, cast__sink_close, rec);
+}
+
+bool cast_play(const char* path, float speed) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+    // the buffer grows to the longest event, i.e. about a frame, and is reused
+    char* line = NULL;
+    size_t line_size = 0;
+    if ((cast__read_line(&line, &line_size, file) < 0) || !cast__is_v2_header(line)) {
+        free(line);
+        fclose(file);
+        return false;
+    }
+    cast__is_interrupted = 0;
+    void (*prev_handler)(int) = signal(SIGINT, cast__on_interrupt);
+    // hide the cursor and clear the terminal
+    printf("\033[?25l\033[H\033[J");
+    struct timespec t_start;
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+    while (!cast__is_interrupted && (cast__read_line(&line, &line_size, file) > 0)) {
+        // [<time>, "<type>", "<data>"]
+        if (line[0] != '[')
+            continue;
+        char* pos;
+        const double t_event = strtod(line + 1, &pos);
+        char* type = strchr(pos, '"');
+        if (type == NULL)
+            continue;
+        char* data = strchr(type + 1, '"');
+        if ((data == NULL) || (data - type != 2) || (type[1] != 'o') || ((data = strchr(data + 1, '"')) == NULL))
+            continue;
+        const size_t data_size = cast__unescape(++data);
+        if (speed > 0) {
+            const double t_wait = t_event/speed - ut_secs_since(&t_start);
+            if (t_wait > 0) {
+                fflush(stdout);
+                nanosleep((const struct timespec[]) {{(time_t)t_wait, (long)((t_wait - (time_t)t_wait)*1e9)}}, NULL);
+            }
+        }
+        fwrite(data, 1, data_size, stdout);
+    }
+    // clear the terminal and restore the cursor
+    printf("\033[H\033[J\033[?25h");
+    fflush(stdout);
+    signal(SIGINT, prev_handler);
+    free(line);
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,351 @@
+#include "export.h"
+#include "objects.h" // mesh_t, color_t
+#include "renderer.h" // renderer_t
+#include "screen.h" // screen_t
+#include "utils.h" // ut_secs_since
+#include <pthread.h> // pthread_create, pthread_join, pthread_mutex_t, pthread_cond_t
+#include <unistd.h> // sysconf
+#include <stdio.h> // FILE, fopen, fwrite, fprintf, sprintf
+#include <stdlib.h> // malloc, calloc, free
+#include <string.h> // memcpy, memset, strcmp, strncmp
+#include <stdbool.h> // bool
+#include <stddef.h> // size_t
+#include <time.h> // clock_gettime
+
+#define EXPORT_FIRST_GLYPH ' '
+#define EXPORT_LAST_GLYPH '~'
+// Y4M luma of the glyphs and of the background - video range
+#define EXPORT_Y4M_INK 235
+#define EXPORT_Y4M_PAPER 16
+
+/*
+ * Glyphs of the printable ASCII characters, 8x8 pixels each. Byte i is row i
+ * from the top and bit j of it column j from the left. These are the glyphs of
+ * the IBM PC BIOS, as in the public domain font8x8_basic by Daniel Hepper.
+ */
+static const unsigned char export__glyphs[EXPORT_LAST_GLYPH - EXPORT_FIRST_GLYPH + 1][8] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // space
+    {0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00}, // !
+    {0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // "
+    {0x36, 0x36, 0x7F, 0x36, 0x7F, 0x36, 0x36, 0x00}, // #
+    {0x0C, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x0C, 0x00}, // $
+    {0x00, 0x63, 0x33, 0x18, 0x0C, 0x66, 0x63, 0x00}, // %
+    {0x1C, 0x36, 0x1C, 0x6E, 0x3B, 0x33, 0x6E, 0x00}, // &
+    {0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00}, // '
+    {0x18, 0x0C, 0x06, 0x06, 0x06, 0x0C, 0x18, 0x00}, // (
+    {0x06, 0x0C, 0x18, 0x18, 0x18, 0x0C, 0x06, 0x00}, // )
+    {0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00, 0x00}, // *
+    {0x00, 0x0C, 0x0C, 0x3F, 0x0C, 0x0C, 0x00, 0x00}, // +
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x06}, // ,
+    {0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00, 0x00}, // -
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00}, // .
+    {0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x00}, // /
+    {0x3E, 0x63, 0x73, 0x7B, 0x6F, 0x67, 0x3E, 0x00}, // 0
+    {0x0C, 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x3F, 0x00}, // 1
+    {0x1E, 0x33, 0x30, 0x1C, 0x06, 0x33, 0x3F, 0x00}, // 2
+    {0x1E, 0x33, 0x30, 0x1C, 0x30, 0x33, 0x1E, 0x00}, // 3
+    {0x38, 0x3C, 0x36, 0x33, 0x7F, 0x30, 0x78, 0x00}, // 4
+    {0x3F, 0x03, 0x1F, 0x30, 0x30, 0x33, 0x1E, 0x00}, // 5
+    {0x1C, 0x06, 0x03, 0x1F, 0x33, 0x33, 0x1E, 0x00}, // 6
+    {0x3F, 0x33, 0x30, 0x18, 0x0C, 0x0C, 0x0C, 0x00}, // 7
+    {0x1E, 0x33, 0x33, 0x1E, 0x33, 0x33, 0x1E, 0x00}, // 8
+    {0x1E, 0x33, 0x33, 0x3E, 0x30, 0x18, 0x0E, 0x00}, // 9
+    {0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x00}, // :
+    {0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x06}, // ;
+    {0x18, 0x0C, 0x06, 0x03, 0x06, 0x0C, 0x18, 0x00}, // <
+    {0x00, 0x00, 0x3F, 0x00, 0x00, 0x3F, 0x00, 0x00}, // =
+    {0x06, 0x0C, 0x18, 0x30, 0x18, 0x0C, 0x06, 0x00}, // >
+    {0x1E, 0x33, 0x30, 0x18, 0x0C, 0x00, 0x0C, 0x00}, // ?
+    {0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00}, // @
+    {0x0C, 0x1E, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x00}, // A
+    {0x3F, 0x66, 0x66, 0x3E, 0x66, 0x66, 0x3F, 0x00}, // B
+    {0x3C, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3C, 0x00}, // C
+    {0x1F, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1F, 0x00}, // D
+    {0x7F, 0x46, 0x16, 0x1E, 0x16, 0x46, 0x7F, 0x00}, // E
+    {0x7F, 0x46, 0x16, 0x1E, 0x16, 0x06, 0x0F, 0x00}, // F
+    {0x3C, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7C, 0x00}, // G
+    {0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00}, // H
+    {0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00}, // I
+    {0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E, 0x00}, // J
+    {0x67, 0x66, 0x36, 0x1E, 0x36, 0x66, 0x67, 0x00}, // K
+    {0x0F, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7F, 0x00}, // L
+    {0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00}, // M
+    {0x63, 0x67, 0x6F, 0x7B, 0x73, 0x63, 0x63, 0x00}, // N
+    {0x1C, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1C, 0x00}, // O
+    {0x3F, 0x66, 0x66, 0x3E, 0x06, 0x06, 0x0F, 0x00}, // P
+    {0x1E, 0x33, 0x33, 0x33, 0x3B, 0x1E, 0x38, 0x00}, // Q
+    {0x3F, 0x66, 0x66, 0x3E, 0x36, 0x66, 0x67, 0x00}, // R
+    {0x1E, 0x33, 0x07, 0x0E, 0x38, 0x33, 0x1E, 0x00}, // S
+    {0x3F, 0x2D, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00}, // T
+    {0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3F, 0x00}, // U
+    {0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00}, // V
+    {0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00}, // W
+    {0x63, 0x63, 0x36, 0x1C, 0x1C, 0x36, 0x63, 0x00}, // X
+    {0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x1E, 0x00}, // Y
+    {0x7F, 0x63, 0x31, 0x18, 0x4C, 0x66, 0x7F, 0x00}, // Z
+    {0x1E, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1E, 0x00}, // [
+    {0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x40, 0x00}, // backslash
+    {0x1E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1E, 0x00}, // ]
+    {0x08, 0x1C, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00}, // ^
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF}, // _
+    {0x0C, 0x0C, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00}, // `
+    {0x00, 0x00, 0x1E, 0x30, 0x3E, 0x33, 0x6E, 0x00}, // a
+    {0x07, 0x06, 0x06, 0x3E, 0x66, 0x66, 0x3B, 0x00}, // b
+    {0x00, 0x00, 0x1E, 0x33, 0x03, 0x33, 0x1E, 0x00}, // c
+    {0x38, 0x30, 0x30, 0x3E, 0x33, 0x33, 0x6E, 0x00}, // d
+    {0x00, 0x00, 0x1E, 0x33, 0x3F, 0x03, 0x1E, 0x00}, // e
+    {0x1C, 0x36, 0x06, 0x0F, 0x06, 0x06, 0x0F, 0x00}, // f
+    {0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x1F}, // g
+    {0x07, 0x06, 0x36, 0x6E, 0x66, 0x66, 0x67, 0x00}, // h
+    {0x0C, 0x00, 0x0E, 0x0C, 0x0C, 0x0C, 0x1E, 0x00}, // i
+    {0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E}, // j
+    {0x07, 0x06, 0x66, 0x36, 0x1E, 0x36, 0x67, 0x00}, // k
+    {0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00}, // l
+    {0x00, 0x00, 0x33, 0x7F, 0x7F, 0x6B, 0x63, 0x00}, // m
+    {0x00, 0x00, 0x1F, 0x33, 0x33, 0x33, 0x33, 0x00}, // n
+    {0x00, 0x00, 0x1E, 0x33, 0x33, 0x33, 0x1E, 0x00}, // o
+    {0x00, 0x00, 0x3B, 0x66, 0x66, 0x3E, 0x06, 0x0F}, // p
+    {0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x78}, // q
+    {0x00, 0x00, 0x3B, 0x6E, 0x66, 0x06, 0x0F, 0x00}, // r
+    {0x00, 0x00, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x00}, // s
+    {0x08, 0x0C, 0x3E, 0x0C, 0x0C, 0x2C, 0x18, 0x00}, // t
+    {0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6E, 0x00}, // u
+    {0x00, 0x00, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00}, // v
+    {0x00, 0x00, 0x63, 0x6B, 0x7F, 0x7F, 0x36, 0x00}, // w
+    {0x00, 0x00, 0x63, 0x36, 0x1C, 0x36, 0x63, 0x00}, // x
+    {0x00, 0x00, 0x33, 0x33, 0x33, 0x3E, 0x30, 0x1F}, // y
+    {0x00, 0x00, 0x3F, 0x19, 0x0C, 0x26, 0x3F, 0x00}, // z
+    {0x38, 0x0C, 0x0C, 0x07, 0x0C, 0x0C, 0x38, 0x00}, // {
+    {0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00}, // |
+    {0x07, 0x0C, 0x0C, 0x38, 0x0C, 0x0C, 0x07, 0x00}, // }
+    {0x6E, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // ~
+};
+
+/* reorder buffer between the workers and the writer */
+typedef struct export_queue {
+    const export_job_t* job;
+    pthread_mutex_t lock;
+    // a slot was written out, so a worker may fill it
+    pthread_cond_t slot_freed;
+    // a frame was encoded, maybe the one the writer waits for
+    pthread_cond_t slot_filled;
+    // frame `i` of the job is encoded into slot `i % n_slots`
+    unsigned char* slots;
+    bool* is_slot_ready;
+    size_t n_slots;
+    size_t slot_size;
+    // the next frame a worker takes and the next one the writer waits for
+    size_t next_claimed;
+    size_t next_written;
+    // set when the job is given up, workers then stop without encoding
+    bool is_cancelled;
+} export_queue_t;
+
+//----------------------------------------------------------------------------------
+// Static functions
+//----------------------------------------------------------------------------------
+static inline const unsigned char* export__glyph(color_t c) {
+    // there's nothing to draw for the rest, like for a space
+    if ((c < EXPORT_FIRST_GLYPH) || (c > EXPORT_LAST_GLYPH))
+        c = ' ';
+    return export__glyphs[c - EXPORT_FIRST_GLYPH];
+}
+
+/* size of a frame of the job once encoded, the same for all frames */
+static size_t export__frame_size(const export_job_t* job) {
+    const size_t n_pixels = (size_t)job->rows*EXPORT_CELL_HEIGHT * job->cols*EXPORT_CELL_WIDTH;
+    switch (job->format) {
+        case EXPORT_PPM:
+            return snprintf(NULL, 0, "P6\n%d %d\n255\n", job->cols*EXPORT_CELL_WIDTH,
+                            job->rows*EXPORT_CELL_HEIGHT) + 3*n_pixels;
+        case EXPORT_Y4M:
+            // luma and two chroma planes of a quarter of its size each
+            return strlen("FRAME\n") + n_pixels + n_pixels/2;
+        default:
+            return (size_t)job->rows*job->cols;
+    }
+}
+
+/**
+ * @brief Draws the glyphs of a frame, `bytes_per_pixel` bytes per pixel
+ *
+ * @param dest  Where to write the image, row by row
+ * @param frame Characters to draw
+ * @param ink   Value of the pixels of a glyph
+ * @param paper Value of the rest
+ */
+static void export__rasterize(unsigned char* dest, const color_t* frame, int rows, int cols,
+                              size_t bytes_per_pixel, unsigned char ink, unsigned char paper) {
+    for (int row = 0; row < rows; ++row) {
+        for (int y = 0; y < EXPORT_CELL_HEIGHT; ++y) {
+            for (int col = 0; col < cols; ++col) {
+                const unsigned char bits = export__glyph(frame[(size_t)row*cols + col])[y*8/EXPORT_CELL_HEIGHT];
+                for (int x = 0; x < EXPORT_CELL_WIDTH; ++x) {
+                    memset(dest, ((bits >> (x*8/EXPORT_CELL_WIDTH)) & 1) ? ink : paper, bytes_per_pixel);
+                    dest += bytes_per_pixel;
+                }
+            }
+        }
+    }
+}
+
+static void export__encode(const export_job_t* job, unsigned char* dest, const color_t* frame) {
+    const size_t width = (size_t)job->cols*EXPORT_CELL_WIDTH;
+    const size_t height = (size_t)job->rows*EXPORT_CELL_HEIGHT;
+    switch (job->format) {
+        case EXPORT_PPM: {
+            // its terminating null is overwritten by the first pixel
+            const int header_len = sprintf((char*) dest, "P6\n%d %d\n255\n", job->cols*EXPORT_CELL_WIDTH,
+                                           job->rows*EXPORT_CELL_HEIGHT);
+            export__rasterize(dest + header_len, frame, job->rows, job->cols, 3, 255, 0);
+            break;
+        }
+        case EXPORT_Y4M:
+            memcpy(dest, "FRAME\n", strlen("FRAME\n"));
+            dest += strlen("FRAME\n");
+            export__rasterize(dest, frame, job->rows, job->cols, 1, EXPORT_Y4M_INK, EXPORT_Y4M_PAPER);
+            // gray, no color
+            memset(dest + width*height, 128, width*height/2);
+            break;
+        default:
+            memcpy(dest, frame, sizeof(color_t) * job->rows * job->cols);
+    }
+}
+
+static void* export__worker(void* arg) {
+    export_queue_t* queue = arg;
+    const export_job_t* job = queue->job;
+    mesh_t* mesh = obj_mesh_copy(job->mesh);
+    color_t* pixels = malloc(sizeof(color_t) * job->rows * job->cols);
+    int* depth = malloc(sizeof(int) * job->rows * job->cols);
+    screen_t screen;
+    screen_init_offscreen_r(&screen, job->rows, job->cols, job->screen_res, pixels);
+    renderer_t renderer = job->settings;
+    render_init_offscreen_r(&renderer, &screen, depth);
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        const size_t i = queue->next_claimed;
+        if (i < job->n_frames)
+            queue->next_claimed++;
+        pthread_mutex_unlock(&queue->lock);
+        if (i >= job->n_frames)
+            break;
+        job->pose(mesh, job->t_first + i, job->user);
+        render_write_shape_r(&renderer, mesh);
+        // wait until the writer is done with the frame that had the slot before
+        pthread_mutex_lock(&queue->lock);
+        while (!queue->is_cancelled && (i >= queue->next_written + queue->n_slots))
+            pthread_cond_wait(&queue->slot_freed, &queue->lock);
+        const bool is_cancelled = queue->is_cancelled;
+        pthread_mutex_unlock(&queue->lock);
+        if (is_cancelled)
+            break;
+        // nobody else touches the slot until it's marked ready
+        export__encode(job, &queue->slots[(i % queue->n_slots) * queue->slot_size], pixels);
+        render_clear_r(&renderer);
+        pthread_mutex_lock(&queue->lock);
+        queue->is_slot_ready[i % queue->n_slots] = true;
+        pthread_cond_signal(&queue->slot_filled);
+        pthread_mutex_unlock(&queue->lock);
+    }
+    render_end_r(&renderer);
+    obj_mesh_free(mesh);
+    free(pixels);
+    free(depth);
+    return NULL;
+}
+
+//----------------------------------------------------------------------------------
+// External functions
+//----------------------------------------------------------------------------------
+bool export_parse_spec(const char* spec, export_format_t* format, const char** path) {
+    const char* names[] = {"raw:", "ppm:", "y4m:"};
+    const export_format_t formats[] = {EXPORT_RAW, EXPORT_PPM, EXPORT_Y4M};
+    for (size_t i = 0; i < sizeof(formats)/sizeof(formats[0]); ++i) {
+        if ((strncmp(spec, names[i], 4) == 0) && (spec[4] != '\0')) {
+            *format = formats[i];
+            *path = spec + 4;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool export_run(const export_job_t* job, const char* path) {
+    const bool is_stdout = (strcmp(path, "-") == 0);
+    FILE* file = (is_stdout) ? stdout : fopen(path, "wb");
+    if (file == NULL)
+        return false;
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    unsigned n_threads = job->n_threads;
+    if (n_threads == 0) {
+        const long n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = (n_cores > 0) ? n_cores : 1;
+    }
+    // a worker without a frame would only take slots
+    if (n_threads > job->n_frames)
+        n_threads = (job->n_frames > 0) ? job->n_frames : 1;
+    export_queue_t queue;
+    queue.job = job;
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.slot_freed, NULL);
+    pthread_cond_init(&queue.slot_filled, NULL);
+    queue.n_slots = EXPORT_SLOTS_PER_THREAD*n_threads;
+    queue.slot_size = export__frame_size(job);
+    queue.slots = malloc(queue.n_slots * queue.slot_size);
+    queue.is_slot_ready = calloc(queue.n_slots, sizeof(bool));
+    queue.next_claimed = 0;
+    queue.next_written = 0;
+    queue.is_cancelled = false;
+    if (job->format == EXPORT_Y4M)
+        fprintf(file, "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C420jpeg\n", job->cols*EXPORT_CELL_WIDTH,
+                job->rows*EXPORT_CELL_HEIGHT, (job->fps > 0) ? job->fps : 30);
+    pthread_t* threads = malloc(sizeof(pthread_t) * n_threads);
+    unsigned n_started = 0;
+    while ((n_started < n_threads) && (pthread_create(&threads[n_started], NULL, export__worker, &queue) == 0))
+        n_started++;
+    // the frames the missing workers would take would never come, so stop the others
+    const bool is_started = (n_started == n_threads);
+    if (!is_started) {
+        fprintf(stderr, "Can't start export worker %u of %u\n", n_started + 1, n_threads);
+        pthread_mutex_lock(&queue.lock);
+        queue.is_cancelled = true;
+        queue.next_claimed = job->n_frames;
+        pthread_cond_broadcast(&queue.slot_freed);
+        pthread_mutex_unlock(&queue.lock);
+    }
+    // write the frames in order as they come - a failed write only stops the writing
+    bool is_ok = is_started;
+    for (size_t i = 0; is_started && (i < job->n_frames); ++i) {
+        const size_t islot = i % queue.n_slots;
+        pthread_mutex_lock(&queue.lock);
+        while (!queue.is_slot_ready[islot])
+            pthread_cond_wait(&queue.slot_filled, &queue.lock);
+        pthread_mutex_unlock(&queue.lock);
+        if (is_ok)
+            is_ok = (fwrite(&queue.slots[islot * queue.slot_size], 1, queue.slot_size, file) == queue.slot_size);
+        pthread_mutex_lock(&queue.lock);
+        queue.is_slot_ready[islot] = false;
+        queue.next_written++;
+        pthread_cond_broadcast(&queue.slot_freed);
+        pthread_mutex_unlock(&queue.lock);
+    }
+    for (unsigned i = 0; i < n_started; ++i)
+        pthread_join(threads[i], NULL);
+    if (is_stdout)
+        is_ok = (fflush(file) == 0) && is_ok;
+    else
+        is_ok = (fclose(file) == 0) && is_ok;
+    const double secs = ut_secs_since(&t0);
+    if (is_started)
+        fprintf(stderr, "exported %zu frames, %zu bytes, in %.2f s with %u threads, %.1f frames/s\n",
+                job->n_frames, job->n_frames*queue.slot_size, secs, n_threads, job->n_frames/secs);
+    free(threads);
+    free(queue.slots);
+    free(queue.is_slot_ready);
+    pthread_cond_destroy(&queue.slot_freed);
+    pthread_cond_destroy(&queue.slot_filled);
+    pthread_mutex_destroy(&queue.lock);
+    return is_ok;
+}
@@ -0,0 +1,564 @@
+#include "lod.h"
+#include "utils.h" // UT_MIN
+#include <stdlib.h> // malloc, calloc, realloc, free, qsort
+#include <stdbool.h> // bool
+#include <stdint.h> // uint64_t
+#include <math.h> // sqrt, fabs, lrint
+
+/*
+ * Symmetric 4x4 matrix Q of a quadric, so that the error of a point p is
+ * [p 1] Q [p 1]^T. Only the upper triangle is stored, row by row:
+ * aa ab ac ad bb bc bd cc cd dd
+ */
+typedef struct lod_quadric {
+    double q[10];
+} lod_quadric_t;
+
+typedef struct lod_collapse {
+    // error the collapse adds
+    double cost;
+    // the edge, v is merged into u at `pos`
+    int u, v;
+    // stamps of the vertices when it was computed, it's stale if either changed
+    unsigned stamp_u, stamp_v;
+    double pos[3];
+} lod_collapse_t;
+
+// an edge of a triangle, to find the unique edges and the open borders
+typedef struct lod_edge {
+    // the lower vertex index in the upper 32 bits, the other in the lower
+    uint64_t key;
+    int tri;
+} lod_edge_t;
+
+// a vertex and where it is, to weld the ones at the same place
+typedef struct lod_vertex {
+    const double* pos;
+    int index;
+} lod_vertex_t;
+
+/* state of the simplification of a mesh */
+typedef struct lod_state {
+    size_t n_verts;
+    double (*pos)[3];
+    lod_quadric_t* quadrics;
+    // changed every time a vertex is moved, see `lod_collapse_t`
+    unsigned* stamps;
+    bool* is_vert_alive;
+    // last collapse each vertex was visited by, so each new edge is pushed once
+    size_t* visits;
+    size_t n_collapses;
+    size_t n_tris;
+    size_t n_tris_alive;
+    int (*tris)[3];
+    color_t* colors;
+    bool* is_tri_alive;
+    // triangles around each vertex as linked lists of their corners, where
+    // corner 3*t + i is vertex i of triangle t - dead triangles are unlinked lazily
+    int* first_corner;
+    int* next_corner;
+    // min heap of candidate collapses by cost, stale ones are skipped when popped
+    lod_collapse_t* heap;
+    size_t heap_size;
+    size_t heap_capacity;
+} lod_state_t;
+
+//----------------------------------------------------------------------------------
+// Static functions
+//----------------------------------------------------------------------------------
+static inline void lod__sub(double* dest, const double* a, const double* b) {
+    dest[0] = a[0] - b[0];
+    dest[1] = a[1] - b[1];
+    dest[2] = a[2] - b[2];
+}
+
+static inline void lod__cross(double* dest, const double* a, const double* b) {
+    dest[0] = a[1]*b[2] - a[2]*b[1];
+    dest[1] = a[2]*b[0] - a[0]*b[2];
+    dest[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+static inline double lod__dot(const double* a, const double* b) {
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+/* normal of a triangle, as long as twice its area */
+static inline void lod__tri_normal(double* normal, const double* p0, const double* p1, const double* p2) {
+    double e1[3], e2[3];
+    lod__sub(e1, p1, p0);
+    lod__sub(e2, p2, p0);
+    lod__cross(normal, e1, e2);
+}
+
+/* adds the squared distance to plane n.p + d = 0, n of unit length, times `weight` */
+static void lod__quadric_add_plane(lod_quadric_t* quadric, const double* n, double d, double weight) {
+    const double plane[4] = {n[0], n[1], n[2], d};
+    double* q = quadric->q;
+    for (int i = 0, k = 0; i < 4; ++i)
+        for (int j = i; j < 4; ++j)
+            q[k++] += weight * plane[i]*plane[j];
+}
+
+static inline void lod__quadric_sum(lod_quadric_t* dest, const lod_quadric_t* a, const lod_quadric_t* b) {
+    for (int i = 0; i < 10; ++i)
+        dest->q[i] = a->q[i] + b->q[i];
+}
+
+static inline double lod__quadric_error(const lod_quadric_t* quadric, const double* p) {
+    const double* q = quadric->q;
+    const double x = p[0], y = p[1], z = p[2];
+    return q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x +
+           q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y +
+           q[7]*z*z + 2*q[8]*z +
+           q[9];
+}
+
+/*
+ * point that minimises the error of a quadric, where its gradient is 0, if it's
+ * well defined, i.e. the planes aren't (nearly) parallel - by Cramer's rule
+ */
+static bool lod__quadric_minimum(const lod_quadric_t* quadric, double* p) {
+    const double* q = quadric->q;
+    const double a[3][3] = {{q[0], q[1], q[2]},
+                            {q[1], q[4], q[5]},
+                            {q[2], q[5], q[7]}};
+    const double b[3] = {-q[3], -q[6], -q[8]};
+    const double det = a[0][0]*(a[1][1]*a[2][2] - a[1][2]*a[2][1]) -
+                       a[0][1]*(a[1][0]*a[2][2] - a[1][2]*a[2][0]) +
+                       a[0][2]*(a[1][0]*a[2][1] - a[1][1]*a[2][0]);
+    if (fabs(det) <= 1e-9 * fabs(a[0][0]*a[1][1]*a[2][2]) || det == 0)
+        return false;
+    for (int i = 0; i < 3; ++i) {
+        double m[3][3];
+        for (int row = 0; row < 3; ++row)
+            for (int col = 0; col < 3; ++col)
+                m[row][col] = (col == i) ? b[row] : a[row][col];
+        p[i] = (m[0][0]*(m[1][1]*m[2][2] - m[1][2]*m[2][1]) -
+                m[0][1]*(m[1][0]*m[2][2] - m[1][2]*m[2][0]) +
+                m[0][2]*(m[1][0]*m[2][1] - m[1][1]*m[2][0])) / det;
+    }
+    return true;
+}
+
+static void lod__heap_push(lod_state_t* state, const lod_collapse_t* collapse) {
+    if (state->heap_size == state->heap_capacity) {
+        state->heap_capacity = (state->heap_capacity > 0) ? 2*state->heap_capacity : 64;
+        state->heap = realloc(state->heap, sizeof(lod_collapse_t) * state->heap_capacity);
+    }
+    lod_collapse_t* heap = state->heap;
+    size_t i = state->heap_size++;
+    while ((i > 0) && (heap[(i - 1)/2].cost > collapse->cost)) {
+        heap[i] = heap[(i - 1)/2];
+        i = (i - 1)/2;
+    }
+    heap[i] = *collapse;
+}
+
+static lod_collapse_t lod__heap_pop(lod_state_t* state) {
+    lod_collapse_t* heap = state->heap;
+    const lod_collapse_t top = heap[0];
+    const lod_collapse_t last = heap[--state->heap_size];
+    size_t i = 0;
+    while (2*i + 1 < state->heap_size) {
+        size_t child = 2*i + 1;
+        if ((child + 1 < state->heap_size) && (heap[child + 1].cost < heap[child].cost))
+            ++child;
+        if (heap[child].cost >= last.cost)
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+/* computes where collapsing edge (u, v) puts the vertex and at what cost, and queues it */
+static void lod__push_edge(lod_state_t* state, int u, int v) {
+    lod_quadric_t quadric;
+    lod__quadric_sum(&quadric, &state->quadrics[u], &state->quadrics[v]);
+    lod_collapse_t collapse = {.u = u, .v = v, .stamp_u = state->stamps[u], .stamp_v = state->stamps[v]};
+    const double* pu = state->pos[u];
+    const double* pv = state->pos[v];
+    double edge[3], offset[3];
+    lod__sub(edge, pv, pu);
+    bool is_found = lod__quadric_minimum(&quadric, collapse.pos);
+    if (is_found) {
+        // a minimum far from the edge comes from nearly parallel planes, don't trust it
+        const double mid[3] = {(pu[0] + pv[0])/2, (pu[1] + pv[1])/2, (pu[2] + pv[2])/2};
+        lod__sub(offset, collapse.pos, mid);
+        is_found = lod__dot(offset, offset) <= lod__dot(edge, edge);
+    }
+    if (is_found) {
+        collapse.cost = lod__quadric_error(&quadric, collapse.pos);
+    } else {
+        // otherwise the best of the ends and the middle
+        const double candidates[3][3] = {{pu[0], pu[1], pu[2]},
+                                         {pv[0], pv[1], pv[2]},
+                                         {(pu[0] + pv[0])/2, (pu[1] + pv[1])/2, (pu[2] + pv[2])/2}};
+        collapse.cost = INFINITY;
+        for (int i = 0; i < 3; ++i) {
+            const double cost = lod__quadric_error(&quadric, candidates[i]);
+            if (cost < collapse.cost) {
+                collapse.cost = cost;
+                collapse.pos[0] = candidates[i][0];
+                collapse.pos[1] = candidates[i][1];
+                collapse.pos[2] = candidates[i][2];
+            }
+        }
+    }
+    lod__heap_push(state, &collapse);
+}
+
+static inline bool lod__tri_has(const lod_state_t* state, int tri, int vertex) {
+    return (state->tris[tri][0] == vertex) || (state->tris[tri][1] == vertex) || (state->tris[tri][2] == vertex);
+}
+
+static int lod__edge_compare(const void* a, const void* b) {
+    const uint64_t ka = ((const lod_edge_t*) a)->key;
+    const uint64_t kb = ((const lod_edge_t*) b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+/* orders vertices by position, to find the ones at the same place */
+static int lod__vertex_compare(const void* a, const void* b) {
+    const double* pa = ((const lod_vertex_t*) a)->pos;
+    const double* pb = ((const lod_vertex_t*) b)->pos;
+    for (int i = 0; i < 3; ++i) {
+        if (pa[i] != pb[i])
+            return (pa[i] > pb[i]) - (pa[i] < pb[i]);
+    }
+    return ((const lod_vertex_t*) a)->index - ((const lod_vertex_t*) b)->index;
+}
+
+/*
+ * welds the vertices at the same position, which rounding to integers makes
+ * common in dense meshes, splits the faces into triangles, sums the quadrics
+ * of the vertices and queues every edge
+ */
+static void lod__init(lod_state_t* state, const mesh_t* mesh) {
+    const size_t n_verts = mesh->n_vertices;
+    state->n_verts = n_verts;
+    state->pos = malloc(sizeof(double[3]) * n_verts);
+    for (size_t i = 0; i < n_verts; ++i) {
+        state->pos[i][0] = COORD_TO_FLOAT(mesh->vertices_local->x[i]);
+        state->pos[i][1] = COORD_TO_FLOAT(mesh->vertices_local->y[i]);
+        state->pos[i][2] = COORD_TO_FLOAT(mesh->vertices_local->z[i]);
+    }
+    state->quadrics = calloc(n_verts, sizeof(lod_quadric_t));
+    state->stamps = calloc(n_verts, sizeof(unsigned));
+    state->visits = calloc(n_verts, sizeof(size_t));
+    state->n_collapses = 0;
+    state->is_vert_alive = malloc(sizeof(bool) * n_verts);
+    // each vertex is replaced by the first one at its position
+    lod_vertex_t* sorted = malloc(sizeof(lod_vertex_t) * n_verts);
+    for (size_t i = 0; i < n_verts; ++i) {
+        sorted[i].pos = state->pos[i];
+        sorted[i].index = (int) i;
+    }
+    qsort(sorted, n_verts, sizeof(lod_vertex_t), lod__vertex_compare);
+    int* welded = malloc(sizeof(int) * n_verts);
+    for (size_t i = 0; i < n_verts; ++i) {
+        const bool is_first = (i == 0) || (sorted[i - 1].pos[0] != sorted[i].pos[0]) ||
+                              (sorted[i - 1].pos[1] != sorted[i].pos[1]) ||
+                              (sorted[i - 1].pos[2] != sorted[i].pos[2]);
+        welded[sorted[i].index] = is_first ? sorted[i].index : welded[sorted[i - 1].index];
+        state->is_vert_alive[sorted[i].index] = is_first;
+    }
+    free(sorted);
+
+    // quads (p0, p1, p2, p3) are split along p0-p2, triangles welded into a
+    // line or a point are dropped
+    size_t n_tris = 0;
+    for (size_t iface = 0; iface < mesh->n_faces; ++iface)
+        n_tris += (mesh->connections[iface][4] == CONNECTION_RECT) ? 2 : 1;
+    state->n_tris = n_tris;
+    state->n_tris_alive = 0;
+    state->tris = malloc(sizeof(int[3]) * n_tris);
+    state->colors = malloc(sizeof(color_t) * n_tris);
+    state->is_tri_alive = malloc(sizeof(bool) * n_tris);
+    for (size_t iface = 0, t = 0; iface < mesh->n_faces; ++iface) {
+        const int* conn = mesh->connections[iface];
+        const int n_split = (conn[4] == CONNECTION_RECT) ? 2 : 1;
+        for (int k = 0; k < n_split; ++k, ++t) {
+            int* tri = state->tris[t];
+            tri[0] = welded[conn[0]];
+            tri[1] = welded[conn[1 + k]];
+            tri[2] = welded[conn[2 + k]];
+            state->colors[t] = conn[5];
+            state->is_tri_alive[t] = (tri[0] != tri[1]) && (tri[1] != tri[2]) && (tri[2] != tri[0]);
+            state->n_tris_alive += state->is_tri_alive[t];
+        }
+    }
+    free(welded);
+
+    // each vertex gets the planes of its triangles, weighted by their area
+    double (*normals)[3] = malloc(sizeof(double[3]) * n_tris);
+    for (size_t t = 0; t < n_tris; ++t) {
+        if (!state->is_tri_alive[t])
+            continue;
+        const int* tri = state->tris[t];
+        lod__tri_normal(normals[t], state->pos[tri[0]], state->pos[tri[1]], state->pos[tri[2]]);
+        const double len = sqrt(lod__dot(normals[t], normals[t]));
+        if (len == 0)
+            continue;
+        for (int i = 0; i < 3; ++i)
+            normals[t][i] /= len;
+        const double d = -lod__dot(normals[t], state->pos[tri[0]]);
+        for (int i = 0; i < 3; ++i)
+            lod__quadric_add_plane(&state->quadrics[tri[i]], normals[t], d, len/2);
+    }
+
+    // sorting the edges of all triangles puts the shared ones next to each other
+    lod_edge_t* edges = malloc(sizeof(lod_edge_t) * 3 * state->n_tris_alive);
+    size_t n_edges = 0;
+    for (size_t t = 0; t < n_tris; ++t) {
+        if (!state->is_tri_alive[t])
+            continue;
+        for (int i = 0; i < 3; ++i) {
+            const uint64_t a = state->tris[t][i], b = state->tris[t][(i + 1) % 3];
+            edges[n_edges++] = (lod_edge_t) {(a < b) ? (a << 32 | b) : (b << 32 | a), (int) t};
+        }
+    }
+    qsort(edges, n_edges, sizeof(lod_edge_t), lod__edge_compare);
+    size_t n_unique = 0;
+    for (size_t i = 0; i < n_edges;) {
+        size_t n_shared = 1;
+        while ((i + n_shared < n_edges) && (edges[i + n_shared].key == edges[i].key))
+            ++n_shared;
+        const int u = (int) (edges[i].key >> 32), v = (int) (edges[i].key & 0xffffffff);
+        if (n_shared == 1) {
+            // an open border keeps its place with a plane through it, perpendicular to its face
+            double edge[3], n[3];
+            lod__sub(edge, state->pos[v], state->pos[u]);
+            lod__cross(n, edge, normals[edges[i].tri]);
+            const double len = sqrt(lod__dot(n, n));
+            if (len > 0) {
+                for (int k = 0; k < 3; ++k)
+                    n[k] /= len;
+                const double d = -lod__dot(n, state->pos[u]);
+                const double weight = LOD_BORDER_WEIGHT * lod__dot(edge, edge);
+                lod__quadric_add_plane(&state->quadrics[u], n, d, weight);
+                lod__quadric_add_plane(&state->quadrics[v], n, d, weight);
+            }
+        }
+        edges[n_unique++] = edges[i];
+        i += n_shared;
+    }
+    // only once every quadric is complete
+    state->heap = NULL;
+    state->heap_size = state->heap_capacity = 0;
+    for (size_t i = 0; i < n_unique; ++i)
+        lod__push_edge(state, (int) (edges[i].key >> 32), (int) (edges[i].key & 0xffffffff));
+    free(edges);
+    free(normals);
+
+    state->first_corner = malloc(sizeof(int) * n_verts);
+    state->next_corner = malloc(sizeof(int) * 3 * n_tris);
+    for (size_t i = 0; i < n_verts; ++i)
+        state->first_corner[i] = -1;
+    for (size_t c = 0; c < 3*n_tris; ++c) {
+        if (!state->is_tri_alive[c/3])
+            continue;
+        const int vertex = state->tris[c/3][c%3];
+        state->next_corner[c] = state->first_corner[vertex];
+        state->first_corner[vertex] = (int) c;
+    }
+}
+
+static void lod__free(lod_state_t* state) {
+    free(state->pos);
+    free(state->quadrics);
+    free(state->stamps);
+    free(state->visits);
+    free(state->is_vert_alive);
+    free(state->tris);
+    free(state->colors);
+    free(state->is_tri_alive);
+    free(state->first_corner);
+    free(state->next_corner);
+    free(state->heap);
+}
+
+/* whether moving `moved` to `pos` flips any of its triangles that survive collapsing it with `other` */
+static bool lod__flips_faces(const lod_state_t* state, int moved, int other, const double* pos) {
+    for (int c = state->first_corner[moved]; c != -1; c = state->next_corner[c]) {
+        const int t = c / 3;
+        if (!state->is_tri_alive[t] || lod__tri_has(state, t, other))
+            continue;
+        const int* tri = state->tris[t];
+        const double* p[3] = {state->pos[tri[0]], state->pos[tri[1]], state->pos[tri[2]]};
+        double before[3], after[3];
+        lod__tri_normal(before, p[0], p[1], p[2]);
+        // a triangle that's already flat has no side to flip to
+        if (lod__dot(before, before) == 0)
+            continue;
+        p[c % 3] = pos;
+        lod__tri_normal(after, p[0], p[1], p[2]);
+        if (lod__dot(before, after) <= 0)
+            return true;
+    }
+    return false;
+}
+
+/* merges vertex v into u at `pos` and queues the edges around u again */
+static void lod__collapse(lod_state_t* state, int u, int v, const double* pos) {
+    state->pos[u][0] = pos[0];
+    state->pos[u][1] = pos[1];
+    state->pos[u][2] = pos[2];
+    lod__quadric_sum(&state->quadrics[u], &state->quadrics[u], &state->quadrics[v]);
+    state->stamps[u]++;
+    state->is_vert_alive[v] = false;
+    // the triangles on the edge disappear, the others of v become u's
+    int last = -1;
+    for (int c = state->first_corner[v]; c != -1; c = state->next_corner[c]) {
+        const int t = c / 3;
+        if (state->is_tri_alive[t]) {
+            if (lod__tri_has(state, t, u)) {
+                state->is_tri_alive[t] = false;
+                state->n_tris_alive--;
+            } else {
+                state->tris[t][c % 3] = u;
+            }
+        }
+        last = c;
+    }
+    if (last != -1) {
+        state->next_corner[last] = state->first_corner[u];
+        state->first_corner[u] = state->first_corner[v];
+        state->first_corner[v] = -1;
+    }
+    // drop the dead triangles from u's list while queueing its edges
+    const size_t visit = ++state->n_collapses;
+    int* link = &state->first_corner[u];
+    while (*link != -1) {
+        const int c = *link;
+        const int t = c / 3;
+        if (!state->is_tri_alive[t]) {
+            *link = state->next_corner[c];
+            continue;
+        }
+        for (int i = 0; i < 3; ++i) {
+            const int w = state->tris[t][i];
+            if ((w != u) && (state->visits[w] != visit)) {
+                state->visits[w] = visit;
+                lod__push_edge(state, u, w);
+            }
+        }
+        link = &state->next_corner[c];
+    }
+}
+
+/* collapses the cheapest edges until there are at most `n_tris` triangles or none can be */
+static void lod__collapse_to(lod_state_t* state, size_t n_tris) {
+    while ((state->n_tris_alive > n_tris) && (state->heap_size > 0)) {
+        const lod_collapse_t collapse = lod__heap_pop(state);
+        const int u = collapse.u, v = collapse.v;
+        if (!state->is_vert_alive[u] || !state->is_vert_alive[v] ||
+            (state->stamps[u] != collapse.stamp_u) || (state->stamps[v] != collapse.stamp_v))
+            continue;
+        if (lod__flips_faces(state, u, v, collapse.pos) || lod__flips_faces(state, v, u, collapse.pos))
+            continue;
+        lod__collapse(state, u, v, collapse.pos);
+    }
+}
+
+/* builds a mesh from the triangles left, dropping the ones that rounding to integers flattens */
+static mesh_t* lod__snapshot(const lod_state_t* state, const mesh_t* mesh) {
+    int* index = malloc(sizeof(int) * state->n_verts);
+    vec3i_t* vertices = malloc(sizeof(vec3i_t) * state->n_verts);
+    int* faces = malloc(sizeof(int) * 6 * state->n_tris_alive);
+    for (size_t i = 0; i < state->n_verts; ++i)
+        index[i] = -1;
+    size_t n_verts = 0, n_faces = 0;
+    for (size_t t = 0; t < state->n_tris; ++t) {
+        if (!state->is_tri_alive[t])
+            continue;
+        vec3i_t p[3];
+        for (int i = 0; i < 3; ++i) {
+            const double* pos = state->pos[state->tris[t][i]];
+            p[i] = (vec3i_t) {lrint(pos[0]), lrint(pos[1]), lrint(pos[2])};
+        }
+        vec3i_t e1 = vec_vec3i_sub(&p[1], &p[0]);
+        vec3i_t e2 = vec_vec3i_sub(&p[2], &p[0]);
+        if ((e1.y*e2.z == e1.z*e2.y) && (e1.z*e2.x == e1.x*e2.z) && (e1.x*e2.y == e1.y*e2.x))
+            continue;
+        int* face = &faces[6*n_faces++];
+        for (int i = 0; i < 3; ++i) {
+            const int vertex = state->tris[t][i];
+            if (index[vertex] == -1) {
+                index[vertex] = (int) n_verts;
+                vertices[n_verts++] = p[i];
+            }
+            face[i] = index[vertex];
+        }
+        face[3] = face[0];
+        face[4] = CONNECTION_TRIANGLE;
+        face[5] = state->colors[t];
+    }
+    mesh_t* new = obj_mesh_new_in(NULL, vertices, n_verts, faces, n_faces,
+                                  mesh->center->x, mesh->center->y, mesh->center->z);
+    obj_mesh_rotate_to(new, mesh->transform.angle_x_rad, mesh->transform.angle_y_rad,
+                            mesh->transform.angle_z_rad);
+    // the coarse levels are drawn small, where a cube's worth of faces per pixel is the aim
+    obj_mesh_build_bvh(new);
+    free(index);
+    free(vertices);
+    free(faces);
+    return new;
+}
+
+//----------------------------------------------------------------------------------
+// External functions
+//----------------------------------------------------------------------------------
+mesh_t* lod_simplify(const mesh_t* mesh, size_t n_faces) {
+    lod_state_t state;
+    lod__init(&state, mesh);
+    lod__collapse_to(&state, n_faces);
+    mesh_t* new = lod__snapshot(&state, mesh);
+    lod__free(&state);
+    return new;
+}
+
+void lod_build(mesh_t* mesh, size_t n_levels) {
+    if ((mesh->n_faces < LOD_MIN_FACES) || (mesh->lods != NULL))
+        return;
+    lod_state_t state;
+    lod__init(&state, mesh);
+    n_levels = UT_MIN(n_levels, LOD_MAX_LEVELS);
+    mesh->lods = malloc(sizeof(mesh_t*) * LOD_MAX_LEVELS);
+    size_t n_tris = state.n_tris_alive;
+    for (size_t level = 0; level < n_levels; ++level) {
+        const size_t target = n_tris / LOD_RATIO;
+        if (target < LOD_COARSEST_FACES)
+            break;
+        lod__collapse_to(&state, target);
+        // stop once the edges left can't be collapsed without flipping faces
+        if (state.n_tris_alive > 3*n_tris/4)
+            break;
+        n_tris = state.n_tris_alive;
+        mesh->lods[mesh->n_lods++] = lod__snapshot(&state, mesh);
+    }
+    lod__free(&state);
+    if (mesh->n_lods == 0) {
+        free(mesh->lods);
+        mesh->lods = NULL;
+    }
+}
+
+mesh_t* lod_select(mesh_t* mesh, float n_samples) {
+    const float max_faces = n_samples*n_samples / LOD_SAMPLES_PER_FACE;
+    mesh_t* level = mesh;
+    for (size_t i = 0; (i < mesh->n_lods) && (level->n_faces > max_faces); ++i)
+        level = mesh->lods[i];
+    if (level == mesh)
+        return mesh;
+    obj_mesh_rotate_to(level, mesh->transform.angle_x_rad, mesh->transform.angle_y_rad,
+                              mesh->transform.angle_z_rad);
+    obj_mesh_translate_to(level, mesh->center->x, mesh->center->y, mesh->center->z);
+    // the level drew the pose, the mesh's own vertices catch up if it's drawn again
+    if (mesh->transform.is_dirty) {
+        mesh->transform.is_dirty = false;
+        mesh->transform.is_stale = true;
+    }
+    return level;
+}
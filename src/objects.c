@@ -1,15 +1,18 @@
 #include "vector.h"
 #include "objects.h"
 #include "utils.h"
-#include "renderer.h" // g_plane_test
+#include "arena.h"
+#include "spatial.h" // spatial_update, spatial_remove
 #include <math.h> // round, abs
 #include <stdlib.h>
 #include <stdbool.h> // bool
 #include <stddef.h> // size_t
 #include <stdio.h> // FILE, open, fclose, printf
 #include <ctype.h> // isempty
-#include <string.h> // strtok
+#include <string.h> // strtok, memcpy, strchr
 #include <assert.h> // assert
+#include <limits.h> // INT_MAX, INT_MIN
+#include <stdint.h> // uint32_t
 
 
 // perpendicular 2D vector, i.e. rotated by 90 degrees ccw
@@ -24,6 +27,11 @@
 )
 
 #define VEC_PERP_DOT_PROD(a, b) a.x*b.y - a.y*b.x
+// perp dot product of coordinates, without scaling it back as only its sign is used
+#define VEC_PERP_DOT_PROD_WIDE(a, b) ((coord_wide_t) a.x*b.y - (coord_wide_t) a.y*b.x)
+// how many pixels to grow the face BVH's leaves by to account for rounding
+// in the ray-plane intersection
+#define BVH_PAD 2
 
 static char conn_letters[] = {
 #define X(a, b, c) a,
@@ -69,11 +77,261 @@ static inline void obj__mesh_update_bbox(mesh_t* mesh) {
     mesh->bounding_box.x1 = mesh->center->x + m/2;
     mesh->bounding_box.y1 = mesh->center->y + m/2;
     mesh->bounding_box.z1 = mesh->center->z + m/2;
+    // the box only changes when the mesh moves - keep its index in step
+    if (mesh->index != NULL)
+        spatial_update(mesh->index, mesh->proxy);
 }
+
+static inline size_t obj__face_n_vertices(mesh_t* mesh, size_t iface) {
+    return (mesh->connections[iface][4] == CONNECTION_RECT) ? 4 : 3;
+}
+
+/*
+ * copies the freshly read vertices, relative to center, to the rest pose, measures
+ * the faces and places the vertices in world space
+ */
+static void obj__mesh_init_pose(mesh_t* mesh) {
+    for (size_t i = 0; i < mesh->n_vertices; ++i) {
+        mesh->vertices_local->x[i] = COORD_FROM_INT(mesh->vertices[i]->x);
+        mesh->vertices_local->y[i] = COORD_FROM_INT(mesh->vertices[i]->y);
+        mesh->vertices_local->z[i] = COORD_FROM_INT(mesh->vertices[i]->z);
+    }
+    mesh->max_face_diameter = 0;
+    for (size_t iface = 0; iface < mesh->n_faces; ++iface) {
+        const size_t n = obj__face_n_vertices(mesh, iface);
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = i + 1; j < n; ++j) {
+                vec3i_t edge = vec_vec3i_sub(mesh->vertices[mesh->connections[iface][i]],
+                                             mesh->vertices[mesh->connections[iface][j]]);
+                mesh->max_face_diameter = UT_MAX(mesh->max_face_diameter,
+                                                 (float)sqrt(vec_vec3i_dotprod(&edge, &edge)));
+            }
+        }
+    }
+    mesh->transform.is_dirty = true;
+    obj_mesh_apply_transform(mesh);
+}
+
+static inline void obj__face_centroid(mesh_t* mesh, size_t iface, float* centroid) {
+    const size_t n = obj__face_n_vertices(mesh, iface);
+    centroid[0] = centroid[1] = centroid[2] = 0;
+    for (size_t i = 0; i < n; ++i) {
+        vec3i_t* v = mesh->vertices[mesh->connections[iface][i]];
+        centroid[0] += (float)v->x/n;
+        centroid[1] += (float)v->y/n;
+        centroid[2] += (float)v->z/n;
+    }
+}
+
+/**
+ * @brief Reorders `faces` so that the one with the median centroid along an axis
+ *        is in the middle, the smaller ones before it and the larger after it
+ *        (quickselect)
+ */
+static void obj__bvh_partition(unsigned* faces, size_t count, float* centroids, int axis) {
+    size_t lo = 0, hi = count - 1, mid = count/2;
+    while (lo < hi) {
+        const float pivot = centroids[3*faces[(lo + hi)/2] + axis];
+        size_t i = lo, j = hi;
+        while (i <= j) {
+            while (centroids[3*faces[i] + axis] < pivot) i++;
+            while (centroids[3*faces[j] + axis] > pivot) j--;
+            if (i <= j) {
+                const unsigned tmp = faces[i];
+                faces[i] = faces[j];
+                faces[j] = tmp;
+                i++;
+                if (j == 0)
+                    break;
+                j--;
+            }
+        }
+        if (mid <= j)
+            hi = j;
+        else if (mid >= i)
+            lo = i;
+        else
+            break;
+    }
+}
+
+/*
+ * merges the ascending runs of `src` two by two into `dest`, gives the number
+ * of runs `dest` is left with
+ */
+static size_t obj__merge_runs(unsigned* dest, const unsigned* src, size_t n) {
+    size_t n_runs = 0;
+    for (size_t start = 0; start < n; n_runs++) {
+        size_t mid = start + 1;
+        while ((mid < n) && (src[mid-1] < src[mid]))
+            mid++;
+        size_t end = (mid < n) ? mid + 1 : n;
+        while ((end < n) && (src[end-1] < src[end]))
+            end++;
+        size_t a = start, b = mid, out = start;
+        while ((a < mid) && (b < end))
+            dest[out++] = (src[a] < src[b]) ? src[a++] : src[b++];
+        while (a < mid)
+            dest[out++] = src[a++];
+        while (b < end)
+            dest[out++] = src[b++];
+        start = end;
+    }
+    return n_runs;
+}
+
+static void obj__bvh_build_node(face_bvh_t* bvh, float* centroids, size_t inode, size_t start, size_t count) {
+    face_bvh_node_t* node = &bvh->nodes[inode];
+    if (count <= OBJ_BVH_LEAF_SIZE) {
+        node->start = start;
+        node->count = count;
+        // in ascending order, so that a query only has to merge the leaves it hits
+        unsigned* faces = &bvh->faces[start];
+        for (size_t i = 1; i < count; ++i) {
+            const unsigned face = faces[i];
+            size_t j = i;
+            for (; (j > 0) && (faces[j-1] > face); --j)
+                faces[j] = faces[j-1];
+            faces[j] = face;
+        }
+        return;
+    }
+    // split at the median along the axis the centroids are spread the most
+    float lo[3] = {INFINITY, INFINITY, INFINITY}, hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (size_t i = start; i < start + count; ++i) {
+        for (int axis = 0; axis < 3; ++axis) {
+            lo[axis] = UT_MIN(lo[axis], centroids[3*bvh->faces[i] + axis]);
+            hi[axis] = UT_MAX(hi[axis], centroids[3*bvh->faces[i] + axis]);
+        }
+    }
+    int axis = 0;
+    for (int i = 1; i < 3; ++i)
+        axis = (hi[i] - lo[i] > hi[axis] - lo[axis]) ? i : axis;
+    obj__bvh_partition(bvh->faces + start, count, centroids, axis);
+    const size_t ileft = bvh->n_nodes;
+    bvh->n_nodes += 2;
+    node->start = ileft;
+    node->count = 0;
+    obj__bvh_build_node(bvh, centroids, ileft, start, count/2);
+    obj__bvh_build_node(bvh, centroids, ileft + 1, start + count/2, count - count/2);
+}
+
 //----------------------------------------------------------------------------------------------------------
 // Renderable shapes
 //----------------------------------------------------------------------------------------------------------
+/* bytes an SoA of `n` points takes in an arena */
+static inline size_t obj__soa_arena_size(size_t n) {
+    return arena_aligned_size(sizeof(vec3_soa_t)) + 3*arena_aligned_size(sizeof(coord_t) * n);
+}
+
+/* bytes the face BVH of a mesh with `n_faces` faces takes in an arena */
+static inline size_t obj__bvh_arena_size(size_t n_faces) {
+    return arena_aligned_size(sizeof(face_bvh_t)) +
+           arena_aligned_size(sizeof(face_bvh_node_t) * 2 * n_faces) +
+           3*arena_aligned_size(sizeof(unsigned) * n_faces);
+}
+
+/* bytes a mesh takes in an arena, including its face BVH if it gets one when loaded */
+static size_t obj__mesh_arena_size(size_t n_verts, size_t n_faces) {
+    return arena_aligned_size(sizeof(mesh_t)) +
+           arena_aligned_size(sizeof(vec3i_t)) +
+           arena_aligned_size(sizeof(vec3i_t*) * n_verts) +
+           arena_aligned_size(sizeof(vec3i_t) * n_verts) +
+           2*obj__soa_arena_size(n_verts) +
+           arena_aligned_size(sizeof(int*) * n_faces) +
+           arena_aligned_size(sizeof(int) * 6 * n_faces) +
+           ((n_faces >= OBJ_BVH_MIN_FACES) ? obj__bvh_arena_size(n_faces) : 0);
+}
+
+static vec3_soa_t* obj__soa_from_arena(arena_t* arena, size_t n) {
+    vec3_soa_t* soa = arena_alloc(arena, sizeof(vec3_soa_t));
+    soa->x = arena_alloc(arena, sizeof(coord_t) * n);
+    soa->y = arena_alloc(arena, sizeof(coord_t) * n);
+    soa->z = arena_alloc(arena, sizeof(coord_t) * n);
+    soa->n = soa->capacity = n;
+    return soa;
+}
+
+/* copies the coordinates of a SoA into one of the same size */
+static void obj__soa_copy(vec3_soa_t* dest, const vec3_soa_t* src) {
+    memcpy(dest->x, src->x, sizeof(coord_t) * src->n);
+    memcpy(dest->y, src->y, sizeof(coord_t) * src->n);
+    memcpy(dest->z, src->z, sizeof(coord_t) * src->n);
+}
+
+/**
+ * @brief Allocates a mesh and all its arrays from an arena
+ *
+ * @param arena   Arena to allocate from or NULL to give the mesh its own,
+ *                sized so that it takes a single allocation
+ * @param n_verts Number of vertices
+ * @param n_faces Number of faces
+ *
+ * @return A pointer to the mesh - only its sizes and arrays are set
+ */
+static mesh_t* obj__mesh_alloc(arena_t* arena, size_t n_verts, size_t n_faces) {
+    const bool owns_arena = (arena == NULL);
+    if (owns_arena)
+        arena = arena_new(obj__mesh_arena_size(n_verts, n_faces));
+    mesh_t* new = arena_alloc(arena, sizeof(mesh_t));
+    new->arena = arena;
+    new->owns_arena = owns_arena;
+    new->n_vertices = n_verts;
+    new->n_faces = n_faces;
+    new->center = arena_alloc(arena, sizeof(vec3i_t));
+    // the vertices are contiguous, `vertices` points at each of them
+    new->vertices = arena_alloc(arena, sizeof(vec3i_t*) * n_verts);
+    vec3i_t* vertex_data = arena_alloc(arena, sizeof(vec3i_t) * n_verts);
+    for (size_t i = 0; i < n_verts; ++i)
+        new->vertices[i] = &vertex_data[i];
+    new->vertices_local = obj__soa_from_arena(arena, n_verts);
+    new->vertices_world = obj__soa_from_arena(arena, n_verts);
+    // same for the rows of the connections
+    new->connections = arena_alloc(arena, sizeof(int*) * n_faces);
+    int* connection_data = arena_alloc(arena, sizeof(int) * 6 * n_faces);
+    for (size_t i = 0; i < n_faces; ++i)
+        new->connections[i] = &connection_data[6*i];
+    new->face_bvh = NULL;
+    new->edges = NULL;
+    new->n_edges = 0;
+    new->lods = NULL;
+    new->index = NULL;
+    new->proxy = SPATIAL_NULL_NODE;
+    new->n_lods = 0;
+    new->transform = (transform_t) {0, 0, 0, false, false};
+    return new;
+}
+
+mesh_t* obj_mesh_new_in(arena_t* arena, const vec3i_t* vertices, size_t n_verts,
+                        const int* faces, size_t n_faces, int cx, int cy, int cz) {
+    mesh_t* new = obj__mesh_alloc(arena, n_verts, n_faces);
+    // bounds symmetric about the center, like those of meshes read from files
+    vec3i_t extent = {0, 0, 0};
+    for (size_t i = 0; i < n_verts; ++i) {
+        *new->vertices[i] = vertices[i];
+        extent.x = UT_MAX(extent.x, abs(vertices[i].x));
+        extent.y = UT_MAX(extent.y, abs(vertices[i].y));
+        extent.z = UT_MAX(extent.z, abs(vertices[i].z));
+    }
+    if (n_faces > 0)
+        memcpy(new->connections[0], faces, sizeof(int) * 6 * n_faces);
+    new->bounding_box.width = 2*extent.x;
+    new->bounding_box.height = 2*extent.y;
+    new->bounding_box.depth = 2*extent.z;
+    vec_vec3i_set(new->center, cx, cy, cz);
+    obj__mesh_update_bbox(new);
+    obj__mesh_init_pose(new);
+    if (new->n_faces >= OBJ_BVH_MIN_FACES)
+        obj_mesh_build_bvh(new);
+    return new;
+}
+
 mesh_t* obj_mesh_from_file(const char* fpath, int cx, int cy, int cz, unsigned width, unsigned height, unsigned depth) {
+    return obj_mesh_from_file_in(NULL, fpath, cx, cy, cz, width, height, depth);
+}
+
+mesh_t* obj_mesh_from_file_in(arena_t* arena, const char* fpath, int cx, int cy, int cz,
+                              unsigned width, unsigned height, unsigned depth) {
     FILE* file;
     file = fopen(fpath, "r");
     if (file == NULL) {
@@ -91,21 +349,12 @@ mesh_t* obj_mesh_from_file(const char* fpath, int cx, int cy, int cz, unsigned w
     }
     //// allocate data and prepare for reading
     // this is what we want to return
-    mesh_t* new = malloc(sizeof(mesh_t));
+    mesh_t* new = obj__mesh_alloc(arena, n_verts, n_surfs);
     new->bounding_box.width = width;
     new->bounding_box.height = height;
     new->bounding_box.depth = depth;
-    new->center = vec_vec3i_new();
     vec_vec3i_set(new->center, cx, cy, cz);
-    new->n_vertices = n_verts;
-    new->n_faces = n_surfs;
-    new->vertices = (vec3i_t**) malloc(sizeof(vec3i_t*) * n_verts);
-    new->vertices_backup = (vec3i_t**) malloc(sizeof(vec3i_t*) * n_verts);
     obj__mesh_update_bbox(new);
-    // allocate 2D array that indicates how vertices are connected at each surface
-    new->connections = malloc(new->n_faces * sizeof(int*));
-    for (int i = 0; i < new->n_faces; ++i)
-        new->connections[i] = malloc(6 * sizeof(int));
 
     //// set vertices and surfaces
     // go back to beginning of the file
@@ -119,7 +368,6 @@ mesh_t* obj_mesh_from_file(const char* fpath, int cx, int cy, int cz, unsigned w
             const float y = atof(pch);
             pch = strtok (NULL, " ");
             const float z = atof(pch);
-            new->vertices[ivert] = vec_vec3i_new();
             vec_vec3i_set(new->vertices[ivert++], round(width/2*x), round(height/2*y), round(depth/2*z));
         } else if (obj__starts_with(buffer, 'f')) {
             assert(atoi(pch) <= new->n_vertices);
@@ -141,26 +389,22 @@ mesh_t* obj_mesh_from_file(const char* fpath, int cx, int cy, int cz, unsigned w
         }
     }
     fclose(file);
-    //// shift them to center and back them up
-    for (int i = 0; i < new->n_vertices; ++i) {
-        *new->vertices[i] = vec_vec3i_add(new->vertices[i], new->center);
-        new->vertices_backup[i] = vec_vec3i_new();
-        vec_vec3i_set(new->vertices_backup[i], 0, 0, 0);
-        vec_vec3i_copy(new->vertices_backup[i], new->vertices[i]);
-    }
+    //// keep the rest pose and shift the world space vertices to center
+    obj__mesh_init_pose(new);
+    if (new->n_faces >= OBJ_BVH_MIN_FACES)
+        obj_mesh_build_bvh(new);
     return new;
 }
 
 mesh_t* obj_triangle_new(vec3i_t* p0, vec3i_t* p1, vec3i_t* p2, color_t color) {
-    mesh_t* new = malloc(sizeof(mesh_t));
-    new->center = malloc(sizeof(vec3i_t));
+    return obj_triangle_new_in(NULL, p0, p1, p2, color);
+}
+
+mesh_t* obj_triangle_new_in(arena_t* arena, vec3i_t* p0, vec3i_t* p1, vec3i_t* p2, color_t color) {
+    mesh_t* new = obj__mesh_alloc(arena, 3, 1);
     new->center->x = (p0->x + p1->x + p2->x)/3;
     new->center->y = (p0->y + p1->y + p2->y)/3;
     new->center->z = (p0->z + p1->z + p2->z)/3;
-    new->n_vertices = 3;
-    new->n_faces = 1;
-    new->vertices = (vec3i_t**) malloc(sizeof(vec3i_t*) * new->n_vertices);
-    new->vertices_backup = (vec3i_t**) malloc(sizeof(vec3i_t*) * new->n_vertices);
     unsigned width = UT_MAX( UT_MAX(abs(p0->x - p1->x), abs(p0->x - p2->x)),
                              UT_MAX(abs(p0->x - p1->x), abs(p1->x - p2->x)));
     unsigned height = UT_MAX(UT_MAX(abs(p0->y - p1->y), abs(p0->y - p2->y)),
@@ -168,9 +412,6 @@ mesh_t* obj_triangle_new(vec3i_t* p0, vec3i_t* p1, vec3i_t* p2, color_t color) {
     new->bounding_box.width = width;
     new->bounding_box.height = height;
     new->bounding_box.depth = 1;
-    new->vertices[0] = vec_vec3i_new();
-    new->vertices[1] = vec_vec3i_new();
-    new->vertices[2] = vec_vec3i_new();
     vec_vec3i_set(new->vertices[0], p0->x, p0->y, p0->z);
     vec_vec3i_set(new->vertices[1], p1->x, p1->y, p1->z);
     vec_vec3i_set(new->vertices[2], p2->x, p2->y, p2->z);
@@ -178,10 +419,6 @@ mesh_t* obj_triangle_new(vec3i_t* p0, vec3i_t* p1, vec3i_t* p2, color_t color) {
     obj__mesh_update_bbox(new);
     obj__mesh_update_bbox(new);
 
-    // allocate 2D array that indicates how vertices are connected at each surface
-    new->connections = malloc(new->n_faces * sizeof(int*));
-    for (int i = 0; i < new->n_faces; ++i)
-        new->connections[i] = malloc(6 * sizeof(int));
     // define surfaces
     new->connections[0][0] = 0;
     new->connections[0][1] = 1;
@@ -190,53 +427,776 @@ mesh_t* obj_triangle_new(vec3i_t* p0, vec3i_t* p1, vec3i_t* p2, color_t color) {
     new->connections[0][4] = CONNECTION_TRIANGLE;
     new->connections[0][5] = color;
 
-    // finish creating the vertices - shift the to the mesh's origin, back them up
-    for (int i = 0; i < new->n_vertices; ++i) {
-        *new->vertices[i] = vec_vec3i_add(new->vertices[i], new->center);
-        new->vertices_backup[i] = vec_vec3i_new();
-        vec_vec3i_set(new->vertices_backup[i], 0, 0, 0);
-        vec_vec3i_copy(new->vertices_backup[i], new->vertices[i]);
-    }
+    // finish creating the vertices - keep the rest pose, shift them to the mesh's origin
+    obj__mesh_init_pose(new);
     return new;
 }
 
 void obj_mesh_rotate_to (mesh_t* mesh, float angle_x_rad, float angle_y_rad, float angle_z_rad) {
-    for (size_t i = 0; i < mesh->n_vertices; ++i) {
-        // first, reset each vertex so no floating point error is accumulated
-        vec_vec3i_copy(mesh->vertices[i], mesh->vertices_backup[i]);
-
-        // point to rotate about
-        int x0 = mesh->center->x, y0 = mesh->center->y, z0 = mesh->center->z;
-        // rotate around x axis, then y, then z
-        // We rotate as follows (* denotes matrix product, C the mesh's origin):
-        // v = v - C, v = Rz*Ry*Rx*v, v = v + C
-        vec_vec3i_rotate(mesh->vertices[i], angle_x_rad, angle_y_rad, angle_z_rad, x0, y0, z0);
-    }
+    if ((mesh->transform.angle_x_rad == angle_x_rad) && (mesh->transform.angle_y_rad == angle_y_rad) &&
+        (mesh->transform.angle_z_rad == angle_z_rad))
+        return;
+    mesh->transform.angle_x_rad = angle_x_rad;
+    mesh->transform.angle_y_rad = angle_y_rad;
+    mesh->transform.angle_z_rad = angle_z_rad;
+    mesh->transform.is_dirty = true;
 }
 
 void obj_mesh_translate_by(mesh_t* mesh, float dx, float dy, float dz) {
     vec3i_t translation = {round(dx), round(dy), round(dz)};
     *mesh->center = vec_vec3i_add(mesh->center, &translation);
-    for (size_t i = 0; i < mesh->n_vertices; ++i) {
-        *mesh->vertices[i] = vec_vec3i_add(mesh->vertices[i], &translation);
-        *mesh->vertices_backup[i] = vec_vec3i_add(mesh->vertices_backup[i], &translation);
-	}
     obj__mesh_update_bbox(mesh);
+    mesh->transform.is_dirty = true;
+}
+
+void obj_mesh_translate_to(mesh_t* mesh, float x, float y, float z) {
+    const vec3i_t center = {round(x), round(y), round(z)};
+    if ((center.x == mesh->center->x) && (center.y == mesh->center->y) && (center.z == mesh->center->z))
+        return;
+    *mesh->center = center;
+    obj__mesh_update_bbox(mesh);
+    mesh->transform.is_dirty = true;
+}
+
+void obj_mesh_set_transform(mesh_t* mesh, mat34_t* model) {
+    vec_mat34_to_euler(model, &mesh->transform.angle_x_rad,
+                              &mesh->transform.angle_y_rad,
+                              &mesh->transform.angle_z_rad);
+    vec_vec3i_set(mesh->center, round(model->m[0][3]), round(model->m[1][3]), round(model->m[2][3]));
+    obj__mesh_update_bbox(mesh);
+    mesh->transform.is_dirty = true;
+}
+
+void obj_mesh_apply_transform(mesh_t* mesh) {
+    if (!mesh->transform.is_dirty && !mesh->transform.is_stale)
+        return;
+    // always start from the rest pose so no error is accumulated
+    // We rotate around x axis, then y, then z and move to the mesh's origin C:
+    // v = Rz*Ry*Rx*v + C
+    mat34_t model;
+    vec_mat34_from_euler(&model, mesh->transform.angle_x_rad,
+                                 mesh->transform.angle_y_rad,
+                                 mesh->transform.angle_z_rad,
+                                 mesh->center->x, mesh->center->y, mesh->center->z);
+    vec_batch_transform(mesh->vertices_world, &model, mesh->vertices_local);
+    vec3c_t min, max;
+    vec_batch_bounds(&min, &max, mesh->vertices_world);
+    // rounding is monotonic so the bounds of the rounded vertices are the rounded bounds
+    vec_vec3i_set(&mesh->vertices_min, COORD_TO_INT(min.x), COORD_TO_INT(min.y), COORD_TO_INT(min.z));
+    vec_vec3i_set(&mesh->vertices_max, COORD_TO_INT(max.x), COORD_TO_INT(max.y), COORD_TO_INT(max.z));
+    // the integral vertices are only what the rasterizer works with
+    for (size_t i = 0; i < mesh->n_vertices; ++i)
+        vec_vec3i_set(mesh->vertices[i], COORD_TO_INT(mesh->vertices_world->x[i]),
+                                         COORD_TO_INT(mesh->vertices_world->y[i]),
+                                         COORD_TO_INT(mesh->vertices_world->z[i]));
+    if (mesh->face_bvh != NULL)
+        mesh->face_bvh->is_stale = true;
+    mesh->transform.is_dirty = false;
+    mesh->transform.is_stale = false;
+}
+
+mesh_t* obj_mesh_copy(const mesh_t* mesh) {
+    mesh_t* new = obj__mesh_alloc(NULL, mesh->n_vertices, mesh->n_faces);
+    for (size_t i = 0; i < mesh->n_vertices; ++i)
+        *new->vertices[i] = *mesh->vertices[i];
+    obj__soa_copy(new->vertices_local, mesh->vertices_local);
+    obj__soa_copy(new->vertices_world, mesh->vertices_world);
+    // the rows of the connections are contiguous in every mesh
+    if (mesh->n_faces > 0)
+        memcpy(new->connections[0], mesh->connections[0], sizeof(int) * 6 * mesh->n_faces);
+    new->vertices_min = mesh->vertices_min;
+    new->vertices_max = mesh->vertices_max;
+    new->max_face_diameter = mesh->max_face_diameter;
+    *new->center = *mesh->center;
+    new->transform = mesh->transform;
+    new->bounding_box = mesh->bounding_box;
+    // same vertices, so the same hierarchy
+    if (mesh->face_bvh != NULL)
+        obj_mesh_build_bvh(new);
+    if (mesh->n_lods > 0) {
+        new->lods = malloc(sizeof(mesh_t*) * mesh->n_lods);
+        for (size_t i = 0; i < mesh->n_lods; ++i)
+            new->lods[i] = obj_mesh_copy(mesh->lods[i]);
+        new->n_lods = mesh->n_lods;
+    }
+    if (mesh->edges != NULL)
+        obj_mesh_build_edges(new);
+    return new;
 }
 
 void obj_mesh_free(mesh_t* mesh) {
-    // free the data of the vertices first
-    for (size_t i = 0; i < mesh->n_vertices; ++i) {
-        free(mesh->vertices[i]);
-        free(mesh->vertices_backup[i]);
+    if (mesh->index != NULL)
+        spatial_remove(mesh->index, mesh->proxy);
+    // the levels of detail are never in a shared arena
+    for (size_t i = 0; i < mesh->n_lods; ++i)
+        obj_mesh_free(mesh->lods[i]);
+    free(mesh->lods);
+    // everything else the mesh owns lives in its arena, a shared one is freed by its owner
+    if (mesh->owns_arena)
+        arena_free(mesh->arena);
+}
+
+void obj_mesh_build_bvh(mesh_t* mesh) {
+    if (mesh->face_bvh != NULL || mesh->n_faces == 0)
+        return;
+    face_bvh_t* bvh = arena_alloc(mesh->arena, sizeof(face_bvh_t));
+    // a binary tree with leaves of at least one face has fewer than 2n nodes
+    bvh->nodes = arena_alloc(mesh->arena, sizeof(face_bvh_node_t) * 2 * mesh->n_faces);
+    bvh->faces = arena_alloc(mesh->arena, sizeof(unsigned) * mesh->n_faces);
+    bvh->hits = arena_alloc(mesh->arena, sizeof(unsigned) * mesh->n_faces);
+    bvh->hits_tmp = arena_alloc(mesh->arena, sizeof(unsigned) * mesh->n_faces);
+    float* centroids = malloc(sizeof(float) * 3 * mesh->n_faces);
+    for (size_t i = 0; i < mesh->n_faces; ++i) {
+        bvh->faces[i] = i;
+        obj__face_centroid(mesh, i, &centroids[3*i]);
+    }
+    bvh->n_nodes = 1;
+    obj__bvh_build_node(bvh, centroids, 0, 0, mesh->n_faces);
+    free(centroids);
+    mesh->face_bvh = bvh;
+    obj_face_bvh_refit(mesh);
+}
+
+void obj_mesh_build_edges(mesh_t* mesh) {
+    for (size_t i = 0; i < mesh->n_lods; ++i)
+        obj_mesh_build_edges(mesh->lods[i]);
+    if (mesh->edges != NULL)
+        return;
+    // the other end of each edge, grouped by its lower vertex, in compressed rows
+    size_t* row_start = calloc(mesh->n_vertices + 1, sizeof(size_t));
+    for (size_t iface = 0; iface < mesh->n_faces; ++iface) {
+        const int* face = mesh->connections[iface];
+        const size_t n_verts = obj__face_n_vertices(mesh, iface);
+        for (size_t k = 0; k < n_verts; ++k) {
+            const int a = face[k], b = face[(k + 1) % n_verts];
+            if (a != b)
+                row_start[UT_MIN(a, b) + 1]++;
+        }
+    }
+    for (size_t i = 0; i < mesh->n_vertices; ++i)
+        row_start[i + 1] += row_start[i];
+    int* others = malloc(sizeof(int) * row_start[mesh->n_vertices]);
+    size_t* row_end = malloc(sizeof(size_t) * mesh->n_vertices);
+    memcpy(row_end, row_start, sizeof(size_t) * mesh->n_vertices);
+    for (size_t iface = 0; iface < mesh->n_faces; ++iface) {
+        const int* face = mesh->connections[iface];
+        const size_t n_verts = obj__face_n_vertices(mesh, iface);
+        for (size_t k = 0; k < n_verts; ++k) {
+            const int a = face[k], b = face[(k + 1) % n_verts];
+            if (a != b)
+                others[row_end[UT_MIN(a, b)]++] = UT_MAX(a, b);
+        }
+    }
+    // a vertex has a handful of neighbours, so sorting each row by insertion
+    // brings the copies of an edge together cheaply
+    size_t n_edges = 0;
+    for (size_t v = 0; v < mesh->n_vertices; ++v) {
+        int* row = &others[row_start[v]];
+        const size_t n = row_end[v] - row_start[v];
+        for (size_t i = 1; i < n; ++i) {
+            const int other = row[i];
+            size_t j = i;
+            for (; (j > 0) && (row[j-1] > other); --j)
+                row[j] = row[j-1];
+            row[j] = other;
+        }
+        for (size_t i = 0; i < n; ++i)
+            n_edges += (i == 0) || (row[i] != row[i-1]);
+    }
+    mesh->edges = arena_alloc(mesh->arena, sizeof(int) * 2 * n_edges);
+    mesh->n_edges = 0;
+    for (size_t v = 0; v < mesh->n_vertices; ++v) {
+        for (size_t i = row_start[v]; i < row_end[v]; ++i) {
+            if ((i > row_start[v]) && (others[i] == others[i-1]))
+                continue;
+            mesh->edges[2*mesh->n_edges] = v;
+            mesh->edges[2*mesh->n_edges + 1] = others[i];
+            mesh->n_edges++;
+        }
+    }
+    free(row_start);
+    free(row_end);
+    free(others);
+}
+
+void obj_face_bvh_refit(mesh_t* mesh) {
+    face_bvh_t* bvh = mesh->face_bvh;
+    // children are always stored after their parent so go backwards
+    for (size_t inode = bvh->n_nodes; inode-- > 0;) {
+        face_bvh_node_t* node = &bvh->nodes[inode];
+        if (node->count > 0) {
+            node->x0 = node->y0 = INT_MAX;
+            node->x1 = node->y1 = INT_MIN;
+            for (size_t i = node->start; i < node->start + node->count; ++i) {
+                const size_t iface = bvh->faces[i];
+                for (size_t j = 0; j < obj__face_n_vertices(mesh, iface); ++j) {
+                    vec3i_t* v = mesh->vertices[mesh->connections[iface][j]];
+                    node->x0 = UT_MIN(node->x0, v->x - BVH_PAD);
+                    node->y0 = UT_MIN(node->y0, v->y - BVH_PAD);
+                    node->x1 = UT_MAX(node->x1, v->x + BVH_PAD);
+                    node->y1 = UT_MAX(node->y1, v->y + BVH_PAD);
+                }
+            }
+        } else {
+            face_bvh_node_t* left = &bvh->nodes[node->start];
+            face_bvh_node_t* right = &bvh->nodes[node->start + 1];
+            node->x0 = UT_MIN(left->x0, right->x0);
+            node->y0 = UT_MIN(left->y0, right->y0);
+            node->x1 = UT_MAX(left->x1, right->x1);
+            node->y1 = UT_MAX(left->y1, right->y1);
+        }
+    }
+    bvh->is_stale = false;
+}
+
+size_t obj_face_bvh_query(face_bvh_t* bvh, int x, int y) {
+    // the tree is balanced so its depth is about log2(n_faces)
+    unsigned stack[64];
+    size_t top = 0, n_hits = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        face_bvh_node_t* node = &bvh->nodes[stack[--top]];
+        if ((x < node->x0) || (x > node->x1) || (y < node->y0) || (y > node->y1))
+            continue;
+        if (node->count > 0) {
+            for (size_t i = node->start; i < node->start + node->count; ++i)
+                bvh->hits[n_hits++] = bvh->faces[i];
+        } else {
+            stack[top++] = node->start;
+            stack[top++] = node->start + 1;
+        }
+    }
+    // the renderer expects the faces in their original order so that faces
+    // at the same depth overlap the same way as without the BVH - each leaf's
+    // are, so merging the leaves takes O(n_hits*log(leaves hit)) where sorting
+    // the hits by insertion took O(n_hits^2)
+    for (size_t n_runs = n_hits; n_runs > 1;) {
+        n_runs = obj__merge_runs(bvh->hits_tmp, bvh->hits, n_hits);
+        unsigned* merged = bvh->hits_tmp;
+        bvh->hits_tmp = bvh->hits;
+        bvh->hits = merged;
+    }
+    return n_hits;
+}
+
+//----------------------------------------------------------------------------------------------------------
+// Generated shapes
+//----------------------------------------------------------------------------------------------------------
+// colors of the faces that face -x, +x, -y, +y, -z and +z most, like the sides of cube.scl
+static const color_t obj__side_colors[6] = {'.', '@', '+', '?', '~', '='};
+
+/* color of a face by the axis its normal is closest to */
+static color_t obj__side_color(const double* p0, const double* p1, const double* p2) {
+    const double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    const double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    const double n[3] = {e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0]};
+    int axis = 0;
+    for (int i = 1; i < 3; ++i)
+        if (fabs(n[i]) > fabs(n[axis]))
+            axis = i;
+    return obj__side_colors[2*axis + (n[axis] > 0)];
+}
+
+/*
+ * makes a mesh from generated vertices, in units of its size, i.e. within
+ * [-0.5, 0.5] on each axis, and faces whose colors are yet to be picked
+ */
+static mesh_t* obj__mesh_generated(arena_t* arena, double (*pos)[3], size_t n_verts, int* faces, size_t n_faces,
+                                   int cx, int cy, int cz, unsigned width, unsigned height, unsigned depth) {
+    vec3i_t* vertices = malloc(sizeof(vec3i_t) * n_verts);
+    for (size_t i = 0; i < n_verts; ++i) {
+        pos[i][0] *= width;
+        pos[i][1] *= height;
+        pos[i][2] *= depth;
+        vec_vec3i_set(&vertices[i], round(pos[i][0]), round(pos[i][1]), round(pos[i][2]));
+    }
+    for (size_t i = 0; i < n_faces; ++i) {
+        int* face = &faces[6*i];
+        face[5] = obj__side_color(pos[face[0]], pos[face[1]], pos[face[2]]);
+    }
+    mesh_t* new = obj_mesh_new_in(arena, vertices, n_verts, faces, n_faces, cx, cy, cz);
+    free(vertices);
+    return new;
+}
+
+static inline void obj__set_face(int* face, int i0, int i1, int i2, int i3, int type) {
+    face[0] = i0;
+    face[1] = i1;
+    face[2] = i2;
+    face[3] = i3;
+    face[4] = type;
+}
+
+/* side of a square grid of cells with `per_cell` faces each that comes closest to `n_faces` faces */
+static inline size_t obj__grid_side(size_t n_faces, size_t per_cell, size_t min_side) {
+    return UT_MAX((size_t) lround(sqrt((double) n_faces / per_cell)), min_side);
+}
+
+/* xorshift, so generated shapes don't depend on or disturb rand() */
+static inline double obj__random(uint32_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state / 4294967296.0;
+}
+
+mesh_t* obj_sphere_new_in(arena_t* arena, int cx, int cy, int cz, unsigned width, unsigned height, unsigned depth,
+                          size_t n_faces) {
+    // `n_stacks` bands from pole to pole, each of twice as many faces, the
+    // ones touching a pole are triangles
+    const size_t n_stacks = obj__grid_side(n_faces, 2, 2);
+    const size_t n_slices = 2*n_stacks;
+    const size_t n_verts = 2 + (n_stacks - 1)*n_slices;
+    double (*pos)[3] = malloc(sizeof(double[3]) * n_verts);
+    int* faces = malloc(sizeof(int) * 6 * n_stacks*n_slices);
+    const size_t south = n_verts - 1;
+    pos[0][0] = 0, pos[0][1] = 0.5, pos[0][2] = 0;
+    pos[south][0] = 0, pos[south][1] = -0.5, pos[south][2] = 0;
+    for (size_t i = 1; i < n_stacks; ++i) {
+        const double theta = M_PI * i / n_stacks;
+        for (size_t j = 0; j < n_slices; ++j) {
+            const double phi = 2*M_PI * j / n_slices;
+            double* p = pos[1 + (i - 1)*n_slices + j];
+            p[0] = 0.5*sin(theta)*cos(phi);
+            p[1] = 0.5*cos(theta);
+            p[2] = 0.5*sin(theta)*sin(phi);
+        }
+    }
+    size_t iface = 0;
+    for (size_t i = 0; i < n_stacks; ++i) {
+        for (size_t j = 0; j < n_slices; ++j) {
+            const size_t k = (j + 1) % n_slices;
+            // vertices of the parallels above and below the band
+            const int a0 = 1 + (i - 1)*n_slices + j, a1 = 1 + (i - 1)*n_slices + k;
+            const int b0 = 1 + i*n_slices + j, b1 = 1 + i*n_slices + k;
+            int* face = &faces[6*iface++];
+            if (i == 0)
+                obj__set_face(face, 0, b1, b0, 0, CONNECTION_TRIANGLE);
+            else if (i == n_stacks - 1)
+                obj__set_face(face, a0, a1, south, a0, CONNECTION_TRIANGLE);
+            else
+                obj__set_face(face, a0, a1, b1, b0, CONNECTION_RECT);
+        }
+    }
+    mesh_t* new = obj__mesh_generated(arena, pos, n_verts, faces, iface, cx, cy, cz, width, height, depth);
+    free(pos);
+    free(faces);
+    return new;
+}
+
+mesh_t* obj_torus_new_in(arena_t* arena, int cx, int cy, int cz, unsigned width, unsigned height, unsigned depth,
+                         size_t n_faces) {
+    // `n_rings` around the hole, each of half as many faces around the tube
+    const size_t n_sides = obj__grid_side(n_faces, 2, 3);
+    const size_t n_rings = 2*n_sides;
+    // the tube is 0.3 thick, so the torus is 1 across and faces the camera
+    const double r_ring = 0.35, r_tube = 0.15;
+    const size_t n_verts = n_rings*n_sides;
+    double (*pos)[3] = malloc(sizeof(double[3]) * n_verts);
+    int* faces = malloc(sizeof(int) * 6 * n_verts);
+    for (size_t i = 0; i < n_rings; ++i) {
+        const double u = 2*M_PI * i / n_rings;
+        for (size_t j = 0; j < n_sides; ++j) {
+            const double v = 2*M_PI * j / n_sides;
+            double* p = pos[i*n_sides + j];
+            p[0] = (r_ring + r_tube*cos(v))*cos(u);
+            p[1] = (r_ring + r_tube*cos(v))*sin(u);
+            p[2] = r_tube*sin(v);
+        }
+    }
+    for (size_t i = 0; i < n_rings; ++i) {
+        const size_t i1 = (i + 1) % n_rings;
+        for (size_t j = 0; j < n_sides; ++j) {
+            const size_t j1 = (j + 1) % n_sides;
+            obj__set_face(&faces[6*(i*n_sides + j)], i*n_sides + j, i1*n_sides + j,
+                          i1*n_sides + j1, i*n_sides + j1, CONNECTION_RECT);
+        }
+    }
+    mesh_t* new = obj__mesh_generated(arena, pos, n_verts, faces, n_verts, cx, cy, cz, width, height, depth);
+    free(pos);
+    free(faces);
+    return new;
+}
+
+mesh_t* obj_subdivided_cube_new_in(arena_t* arena, int cx, int cy, int cz, unsigned width, unsigned height,
+                                   unsigned depth, size_t n_faces) {
+    // each side is a grid of n x n quads with its own vertices
+    const size_t n = obj__grid_side(n_faces, 6, 1);
+    const size_t n_side_verts = (n + 1)*(n + 1);
+    double (*pos)[3] = malloc(sizeof(double[3]) * 6 * n_side_verts);
+    int* faces = malloc(sizeof(int) * 6 * 6*n*n);
+    // same corners as cube.scl, so that 6 faces make the same cube
+    const double half = 0.3535;
+    size_t iface = 0;
+    for (int side = 0; side < 6; ++side) {
+        const int axis = side / 2;
+        const double sign = (side % 2) ? 1 : -1;
+        // the other two axes, in the order that makes the normal point outwards
+        const int u_axis = (sign > 0) ? (axis + 1) % 3 : (axis + 2) % 3;
+        const int v_axis = (sign > 0) ? (axis + 2) % 3 : (axis + 1) % 3;
+        const size_t first = side*n_side_verts;
+        for (size_t i = 0; i <= n; ++i) {
+            for (size_t j = 0; j <= n; ++j) {
+                double* p = pos[first + i*(n + 1) + j];
+                p[axis] = sign*half;
+                p[u_axis] = half*(2.0*j/n - 1);
+                p[v_axis] = half*(2.0*i/n - 1);
+            }
+        }
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < n; ++j) {
+                const int v00 = first + i*(n + 1) + j;
+                obj__set_face(&faces[6*iface++], v00, v00 + 1, v00 + n + 2, v00 + n + 1, CONNECTION_RECT);
+            }
+        }
+    }
+    mesh_t* new = obj__mesh_generated(arena, pos, 6*n_side_verts, faces, iface, cx, cy, cz, width, height, depth);
+    free(pos);
+    free(faces);
+    return new;
+}
+
+mesh_t* obj_heightfield_new_in(arena_t* arena, int cx, int cy, int cz, unsigned width, unsigned height,
+                               unsigned depth, size_t n_faces) {
+    // a grid of n x n cells on the xz plane, each split into two triangles
+    // since its corners are at different heights
+    const size_t n = obj__grid_side(n_faces, 2, 1);
+    const size_t n_verts = (n + 1)*(n + 1);
+    double (*pos)[3] = malloc(sizeof(double[3]) * n_verts);
+    int* faces = malloc(sizeof(int) * 6 * 2*n*n);
+    for (size_t i = 0; i <= n; ++i) {
+        for (size_t j = 0; j <= n; ++j) {
+            double* p = pos[i*(n + 1) + j];
+            p[0] = (double) j/n - 0.5;
+            p[2] = (double) i/n - 0.5;
+            // rolling hills, within [-0.25, 0.25]
+            p[1] = 0.15*sin(3*M_PI*p[0])*cos(2*M_PI*p[2]) + 0.1*sin(5*M_PI*(p[0] + p[2]));
+        }
+    }
+    size_t iface = 0;
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+            const int v00 = i*(n + 1) + j, v01 = v00 + 1, v10 = v00 + n + 1, v11 = v10 + 1;
+            obj__set_face(&faces[6*iface++], v00, v10, v11, v00, CONNECTION_TRIANGLE);
+            obj__set_face(&faces[6*iface++], v00, v11, v01, v00, CONNECTION_TRIANGLE);
+        }
+    }
+    mesh_t* new = obj__mesh_generated(arena, pos, n_verts, faces, iface, cx, cy, cz, width, height, depth);
+    free(pos);
+    free(faces);
+    return new;
+}
+
+/*
+ * Face of a convex hull under construction, a triangle whose vertices are
+ * counterclockwise seen from outside. Each point still outside the hull is
+ * kept by one face it's above.
+ */
+typedef struct hull_face {
+    int v[3];
+    // neighbour across the edge from v[i] to v[i+1]
+    int nb[3];
+    // outward plane n.x = d
+    double n[3];
+    double d;
+    // first point above the face, the rest are linked through `hull_t::next`, -1 if none
+    int first;
+    // the one farthest above it
+    int farthest;
+    double farthest_dist;
+    bool is_alive;
+    // last point the face was checked against for visibility
+    int visit;
+} hull_face_t;
+
+typedef struct hull {
+    double (*points)[3];
+    int* next;
+    hull_face_t* faces;
+    size_t n_faces;
+    size_t capacity;
+    // slots of dead faces to reuse
+    int* free;
+    size_t n_free;
+} hull_t;
+
+// how far above a face a point must be to see it
+#define HULL_EPS 1e-12
+
+/* appends to a growable array of ints */
+static inline void obj__push_int(int** array, size_t* size, size_t* capacity, int value) {
+    if (*size == *capacity) {
+        *capacity = (*capacity > 0) ? 2 * *capacity : 64;
+        *array = realloc(*array, sizeof(int) * *capacity);
+    }
+    (*array)[(*size)++] = value;
+}
+
+static inline void obj__hull_plane(double (*points)[3], int a, int b, int c, double* n, double* d) {
+    const double* p0 = points[a];
+    const double* p1 = points[b];
+    const double* p2 = points[c];
+    const double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    const double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+    n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+    n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+    *d = n[0]*p0[0] + n[1]*p0[1] + n[2]*p0[2];
+}
+
+static inline double obj__hull_dist(const hull_t* hull, int iface, int ipoint) {
+    const hull_face_t* face = &hull->faces[iface];
+    const double* p = hull->points[ipoint];
+    return face->n[0]*p[0] + face->n[1]*p[1] + face->n[2]*p[2] - face->d;
+}
+
+static int obj__hull_new_face(hull_t* hull, int a, int b, int c) {
+    int iface;
+    if (hull->n_free > 0) {
+        iface = hull->free[--hull->n_free];
+    } else {
+        if (hull->n_faces == hull->capacity) {
+            hull->capacity *= 2;
+            hull->faces = realloc(hull->faces, sizeof(hull_face_t) * hull->capacity);
+            hull->free = realloc(hull->free, sizeof(int) * hull->capacity);
+        }
+        iface = hull->n_faces++;
     }
-    free(mesh->vertices);
-    free(mesh->vertices_backup);
-    for (int i = 0; i < mesh->n_faces; ++i)
-        free(mesh->connections[i]);
-    free(mesh->connections);
-    free(mesh->center);
-    free(mesh);
+    hull_face_t* face = &hull->faces[iface];
+    face->v[0] = a;
+    face->v[1] = b;
+    face->v[2] = c;
+    obj__hull_plane(hull->points, a, b, c, face->n, &face->d);
+    face->first = face->farthest = -1;
+    face->farthest_dist = 0;
+    face->is_alive = true;
+    face->visit = -1;
+    return iface;
+}
+
+/* gives a point to the first of `n_faces` faces it's above, if any */
+static void obj__hull_assign(hull_t* hull, int ipoint, const int* faces, size_t n_faces) {
+    for (size_t i = 0; i < n_faces; ++i) {
+        const double dist = obj__hull_dist(hull, faces[i], ipoint);
+        if (dist > HULL_EPS) {
+            hull_face_t* face = &hull->faces[faces[i]];
+            hull->next[ipoint] = face->first;
+            face->first = ipoint;
+            if (dist > face->farthest_dist) {
+                face->farthest_dist = dist;
+                face->farthest = ipoint;
+            }
+            return;
+        }
+    }
+}
+
+/* sets the neighbour of a face across its edge from vertex a to b */
+static inline void obj__hull_link(hull_t* hull, int iface, int a, int b, int nb) {
+    hull_face_t* face = &hull->faces[iface];
+    for (int i = 0; i < 3; ++i)
+        if ((face->v[i] == a) && (face->v[(i + 1) % 3] == b))
+            face->nb[i] = nb;
+}
+
+/*
+ * Quickhull: starts from a tetrahedron and repeatedly adds the point farthest
+ * above a face, replacing the faces it sees with a fan from it to their
+ * horizon, until no point is left outside. The points must be in general
+ * position, e.g. random. Returns the number of faces, whose vertices are
+ * written to `tris`.
+ */
+static size_t obj__hull_build(double (*points)[3], size_t n_points, int (**tris)[3]) {
+    hull_t hull = {.points = points, .n_faces = 0, .capacity = 64, .n_free = 0};
+    hull.next = malloc(sizeof(int) * n_points);
+    hull.faces = malloc(sizeof(hull_face_t) * hull.capacity);
+    hull.free = malloc(sizeof(int) * hull.capacity);
+    // faces that may have points above them
+    int* pending = NULL;
+    size_t n_pending = 0, pending_capacity = 0;
+    // faces the current point sees, the edges around them as (from, to, face
+    // beyond) and the fan of faces that replaces them
+    int* visible = NULL;
+    size_t n_visible = 0, visible_capacity = 0;
+    int* horizon = NULL;
+    size_t n_horizon = 0, horizon_capacity = 0;
+    int* fan = NULL;
+    size_t n_fan = 0, fan_capacity = 0;
+    // fan face by the horizon vertex its edge starts at
+    int* fan_of = malloc(sizeof(int) * n_points);
+
+    // a tetrahedron of the first three points and the one farthest from their plane
+    double n[3], d;
+    obj__hull_plane(points, 0, 1, 2, n, &d);
+    int apex = 3;
+    double apex_dist = 0;
+    for (size_t i = 3; i < n_points; ++i) {
+        const double dist = n[0]*points[i][0] + n[1]*points[i][1] + n[2]*points[i][2] - d;
+        if (fabs(dist) > fabs(apex_dist)) {
+            apex_dist = dist;
+            apex = i;
+        }
+    }
+    // the base must see the apex from behind
+    const int b0 = 0, b1 = (apex_dist > 0) ? 2 : 1, b2 = (apex_dist > 0) ? 1 : 2;
+    const int tetra[4][3] = {{b0, b1, b2}, {b0, apex, b1}, {b1, apex, b2}, {b2, apex, b0}};
+    int first_faces[4];
+    for (int i = 0; i < 4; ++i)
+        first_faces[i] = obj__hull_new_face(&hull, tetra[i][0], tetra[i][1], tetra[i][2]);
+    for (int i = 0; i < 4; ++i)
+        for (int j = 0; j < 4; ++j)
+            for (int k = 0; (k < 3) && (i != j); ++k)
+                obj__hull_link(&hull, first_faces[i], tetra[j][(k + 1) % 3], tetra[j][k], first_faces[j]);
+    for (size_t i = 0; i < n_points; ++i)
+        if (((int) i != b0) && ((int) i != b1) && ((int) i != b2) && ((int) i != apex))
+            obj__hull_assign(&hull, i, first_faces, 4);
+    for (int i = 0; i < 4; ++i)
+        obj__push_int(&pending, &n_pending, &pending_capacity, first_faces[i]);
+
+    while (n_pending > 0) {
+        const int iface = pending[--n_pending];
+        if (!hull.faces[iface].is_alive || (hull.faces[iface].first == -1))
+            continue;
+        const int eye = hull.faces[iface].farthest;
+        // walk from this face to the others the eye sees
+        n_visible = n_horizon = n_fan = 0;
+        obj__push_int(&visible, &n_visible, &visible_capacity, iface);
+        hull.faces[iface].visit = eye;
+        for (size_t i = 0; i < n_visible; ++i) {
+            const hull_face_t* face = &hull.faces[visible[i]];
+            for (int k = 0; k < 3; ++k) {
+                const int nb = face->nb[k];
+                if (hull.faces[nb].visit == eye)
+                    continue;
+                if (obj__hull_dist(&hull, nb, eye) > HULL_EPS) {
+                    hull.faces[nb].visit = eye;
+                    obj__push_int(&visible, &n_visible, &visible_capacity, nb);
+                    // may have moved
+                    face = &hull.faces[visible[i]];
+                } else {
+                    obj__push_int(&horizon, &n_horizon, &horizon_capacity, face->v[k]);
+                    obj__push_int(&horizon, &n_horizon, &horizon_capacity, face->v[(k + 1) % 3]);
+                    obj__push_int(&horizon, &n_horizon, &horizon_capacity, nb);
+                }
+            }
+        }
+        // the faces it sees die, their points wait to be handed to the fan
+        int first_orphan = -1;
+        for (size_t i = 0; i < n_visible; ++i) {
+            hull_face_t* face = &hull.faces[visible[i]];
+            for (int p = face->first; p != -1;) {
+                const int next = hull.next[p];
+                hull.next[p] = first_orphan;
+                first_orphan = p;
+                p = next;
+            }
+            face->is_alive = false;
+            hull.free[hull.n_free++] = visible[i];
+        }
+        // the horizon is a loop, so each of its vertices starts one edge of the fan
+        for (size_t i = 0; i < n_horizon; i += 3) {
+            const int a = horizon[i], b = horizon[i + 1], beyond = horizon[i + 2];
+            const int inew = obj__hull_new_face(&hull, a, b, eye);
+            hull.faces[inew].nb[0] = beyond;
+            obj__hull_link(&hull, beyond, b, a, inew);
+            fan_of[a] = inew;
+            obj__push_int(&fan, &n_fan, &fan_capacity, inew);
+        }
+        for (size_t i = 0; i < n_fan; ++i) {
+            const int next = fan_of[hull.faces[fan[i]].v[1]];
+            hull.faces[fan[i]].nb[1] = next;
+            hull.faces[next].nb[2] = fan[i];
+        }
+        for (int p = first_orphan; p != -1;) {
+            const int next = hull.next[p];
+            if (p != eye)
+                obj__hull_assign(&hull, p, fan, n_fan);
+            p = next;
+        }
+        for (size_t i = 0; i < n_fan; ++i)
+            if (hull.faces[fan[i]].first != -1)
+                obj__push_int(&pending, &n_pending, &pending_capacity, fan[i]);
+    }
+
+    size_t n_tris = 0;
+    *tris = malloc(sizeof(int[3]) * hull.n_faces);
+    for (size_t i = 0; i < hull.n_faces; ++i) {
+        if (!hull.faces[i].is_alive)
+            continue;
+        for (int k = 0; k < 3; ++k)
+            (*tris)[n_tris][k] = hull.faces[i].v[k];
+        ++n_tris;
+    }
+    free(hull.next);
+    free(hull.faces);
+    free(hull.free);
+    free(pending);
+    free(visible);
+    free(horizon);
+    free(fan);
+    free(fan_of);
+    return n_tris;
+}
+
+mesh_t* obj_convex_hull_new_in(arena_t* arena, int cx, int cy, int cz, unsigned width, unsigned height,
+                               unsigned depth, size_t n_faces, unsigned seed) {
+    // every point on a sphere is on the hull, and a hull of n points has 2n - 4 triangles
+    const size_t n_points = UT_MAX(n_faces/2 + 2, 4);
+    double (*pos)[3] = malloc(sizeof(double[3]) * n_points);
+    uint32_t state = (seed != 0) ? seed : 1;
+    for (size_t i = 0; i < n_points; ++i) {
+        // uniform on the sphere, as a uniform height and longitude on a cylinder
+        const double z = 2*obj__random(&state) - 1;
+        const double phi = 2*M_PI * obj__random(&state);
+        const double r = sqrt(1 - z*z);
+        pos[i][0] = 0.5*r*cos(phi);
+        pos[i][1] = 0.5*r*sin(phi);
+        pos[i][2] = 0.5*z;
+    }
+    int (*tris)[3];
+    const size_t n_tris = obj__hull_build(pos, n_points, &tris);
+    int* faces = malloc(sizeof(int) * 6 * n_tris);
+    for (size_t i = 0; i < n_tris; ++i)
+        obj__set_face(&faces[6*i], tris[i][0], tris[i][1], tris[i][2], tris[i][0], CONNECTION_TRIANGLE);
+    mesh_t* new = obj__mesh_generated(arena, pos, n_points, faces, n_tris, cx, cy, cz, width, height, depth);
+    free(pos);
+    free(tris);
+    free(faces);
+    return new;
+}
+
+/* the hull of the same points every time, so benchmarks are repeatable */
+static mesh_t* obj__convex_hull_new_in(arena_t* arena, int cx, int cy, int cz, unsigned width, unsigned height,
+                                       unsigned depth, size_t n_faces) {
+    return obj_convex_hull_new_in(arena, cx, cy, cz, width, height, depth, n_faces, 1);
+}
+
+static const struct {
+    const char* name;
+    mesh_t* (*generate)(arena_t* arena, int cx, int cy, int cz, unsigned width, unsigned height,
+                        unsigned depth, size_t n_faces);
+} obj__generators[] = {
+    {"sphere", obj_sphere_new_in},
+    {"torus", obj_torus_new_in},
+    {"cube", obj_subdivided_cube_new_in},
+    {"hull", obj__convex_hull_new_in},
+    {"heightfield", obj_heightfield_new_in}
+};
+
+mesh_t* obj_mesh_generate(const char* spec, int cx, int cy, int cz, unsigned width, unsigned height, unsigned depth) {
+    const char* colon = strchr(spec, ':');
+    if (colon == NULL)
+        return NULL;
+    char* end;
+    const long n_faces = strtol(colon + 1, &end, 10);
+    if ((*end != '\0') || (n_faces <= 0))
+        return NULL;
+    for (size_t i = 0; i < sizeof(obj__generators)/sizeof(obj__generators[0]); ++i) {
+        if ((strlen(obj__generators[i].name) == (size_t) (colon - spec)) &&
+            (strncmp(spec, obj__generators[i].name, colon - spec) == 0))
+            return obj__generators[i].generate(NULL, cx, cy, cz, width, height, depth, n_faces);
+    }
+    return NULL;
 }
 
 //----------------------------------------------------------------------------------------------------------
@@ -250,8 +1210,6 @@ ray_t* obj_ray_new() {
 }
 
 void obj_ray_set(ray_t* ray, int x0, int y0, int z0, int x1, int y1, int z1) {
-    ray->orig = vec_vec3i_new();
-    ray->end = vec_vec3i_new();
     vec_vec3i_set(ray->orig, x0, y0, z0);
     vec_vec3i_set(ray->end, x1, y1, z1);
 
@@ -283,6 +1241,94 @@ void obj_camera_set(camera_t* camera, int cam_x0, int cam_y0, float focal_length
     camera->focal_length = focal_length;
 }
 
+void obj_frustum_set(frustum_t* frustum, camera_t* camera, int half_width, int half_height, float z_near) {
+   /*
+    * The camera projects point (x, y, z) to (x*f/z, y*f/z), therefore
+    * it's visible if |x*f/z| <= half_width and |y*f/z| <= half_height.
+    * For z > 0 the first one is written as two planes through the origin:
+    * x + z*half_width/|f| >= 0 and -x + z*half_width/|f| >= 0
+    * and likewise for y. The focal length can be negative, which only
+    * mirrors the image, so we use its absolute value.
+    *
+    *          \  left         right  /
+    *           \       frustum      /
+    *            \                  /
+    *          ---\----------------/--- near (z = z_near)
+    *              \              /
+    *               \            /
+    *                \          /
+    *                 \        /
+    *                  \      /                 ^ z
+    *                   \    /                  |
+    *                    \  /                   |
+    *                     \/ camera (0, 0, 0)   o-----> x
+    */
+    const float f = fabs(camera->focal_length);
+    const float kx = (float)half_width/f;
+    const float ky = (float)half_height/f;
+    frustum->normals[FRUSTUM_NEAR]   = (vec3_t) { 0,  0,  1};
+    frustum->normals[FRUSTUM_LEFT]   = (vec3_t) { 1,  0, kx};
+    frustum->normals[FRUSTUM_RIGHT]  = (vec3_t) {-1,  0, kx};
+    frustum->normals[FRUSTUM_BOTTOM] = (vec3_t) { 0,  1, ky};
+    frustum->normals[FRUSTUM_TOP]    = (vec3_t) { 0, -1, ky};
+    for (int i = 0; i < NUM_FRUSTUM_PLANES; ++i)
+        frustum->offsets[i] = 0;
+    frustum->offsets[FRUSTUM_NEAR] = -z_near;
+}
+
+bool obj_frustum_culls_box(frustum_t* frustum, int x0, int y0, int z0, int x1, int y1, int z1) {
+    for (int i = 0; i < NUM_FRUSTUM_PLANES; ++i) {
+        // the box corner furthest along the normal is the most likely to be inside,
+        // if even that one is outside the plane, the whole box is outside
+        const vec3_t* n = &frustum->normals[i];
+        vec3_t p = (vec3_t) {(n->x >= 0) ? UT_MAX(x0, x1) : UT_MIN(x0, x1),
+                             (n->y >= 0) ? UT_MAX(y0, y1) : UT_MIN(y0, y1),
+                             (n->z >= 0) ? UT_MAX(z0, z1) : UT_MIN(z0, z1)};
+        if (vec_vec3_dotprod((vec3_t*)n, &p) + frustum->offsets[i] < 0)
+            return true;
+    }
+    return false;
+}
+
+size_t obj_frustum_clip_polygon(frustum_t* frustum, vec3_t* in, size_t n_in, vec3_t* out) {
+    // each plane adds at most one vertex to a convex polygon so
+    // we ping-pong between two buffers of the output's capacity
+    vec3_t buffer[2][NUM_FRUSTUM_PLANES + 8];
+    assert(n_in <= 8);
+    size_t n = n_in;
+    for (size_t i = 0; i < n; ++i)
+        buffer[0][i] = in[i];
+    int src = 0;
+    for (int iplane = 0; (iplane < NUM_FRUSTUM_PLANES) && (n > 0); ++iplane) {
+        vec3_t* normal = &frustum->normals[iplane];
+        const float offset = frustum->offsets[iplane];
+        vec3_t* poly_in = buffer[src];
+        vec3_t* poly_out = buffer[1 - src];
+        size_t n_out = 0;
+        for (size_t i = 0; i < n; ++i) {
+            // keep the vertices inside the plane and add the crossing of each edge
+            // that goes through the plane
+            vec3_t* a = &poly_in[i];
+            vec3_t* b = &poly_in[(i + 1) % n];
+            const float da = vec_vec3_dotprod(normal, a) + offset;
+            const float db = vec_vec3_dotprod(normal, b) + offset;
+            if (da >= 0)
+                poly_out[n_out++] = *a;
+            if ((da >= 0) != (db >= 0)) {
+                const float t = da/(da - db);
+                poly_out[n_out++] = (vec3_t) {a->x + t*(b->x - a->x),
+                                              a->y + t*(b->y - a->y),
+                                              a->z + t*(b->z - a->z)};
+            }
+        }
+        n = n_out;
+        src = 1 - src;
+    }
+    for (size_t i = 0; i < n; ++i)
+        out[i] = buffer[src][i];
+    return n;
+}
+
 
 //----------------------------------------------------------------------------------------------------------
 // Plane
@@ -349,8 +1395,21 @@ void obj_plane_set(plane_t* plane, vec3i_t* p0, vec3i_t* p1, vec3i_t* p2) {
 }
 
 
+/* difference between a point in world coordinates and an integral one */
+static inline vec3c_t obj__coord_sub(vec3c_t* src1, vec3i_t* src2) {
+    return (vec3c_t) {src1->x - COORD_FROM_INT(src2->x),
+                      src1->y - COORD_FROM_INT(src2->y),
+                      src1->z - COORD_FROM_INT(src2->z)};
+}
+
+/* dot product of coordinates, without scaling it back */
+static inline coord_wide_t obj__coord_dotprod_wide(const vec3c_t* src1, const vec3c_t* src2) {
+    return (coord_wide_t) src1->x*src2->x + (coord_wide_t) src1->y*src2->y + (coord_wide_t) src1->z*src2->z;
+}
+
+
 // Whether a point m is inside a triangle (a, b, c)
-bool obj_is_point_in_triangle(vec3i_t* m, vec3i_t* a, vec3i_t* b, vec3i_t* c) {
+bool obj_is_point_in_triangle(vec3c_t* m, vec3i_t* a, vec3i_t* b, vec3i_t* c) {
 /*
  * To test whether a point is inside a triangle,    | a_perp(-a_y, a,x)
  * we use the concept of perpendicular (perp)       | ^                     <----
@@ -398,20 +1457,20 @@ bool obj_is_point_in_triangle(vec3i_t* m, vec3i_t* a, vec3i_t* b, vec3i_t* c) {
  * .                                               .|      +
  * .                                               .|      B
  */
-    const vec3i_t ma = vec_vec3i_sub(m, a);
-    const vec3i_t mb = vec_vec3i_sub(m, b);
-    const vec3i_t mc = vec_vec3i_sub(m, c);
+    const vec3c_t ma = obj__coord_sub(m, a);
+    const vec3c_t mb = obj__coord_sub(m, b);
+    const vec3c_t mc = obj__coord_sub(m, c);
     // cw = clockwise, ccw = counter-clockwise
-    const bool are_all_cw =  ((VEC_PERP_DOT_PROD(ma, mb) < 0) &&
-                              (VEC_PERP_DOT_PROD(mb, mc) < 0) &&
-                              (VEC_PERP_DOT_PROD(mc, ma) < 0));
-    const bool are_all_ccw = ((VEC_PERP_DOT_PROD(ma, mb) > 0) &&
-                              (VEC_PERP_DOT_PROD(mb, mc) > 0) &&
-                              (VEC_PERP_DOT_PROD(mc, ma) > 0));
+    const bool are_all_cw =  ((VEC_PERP_DOT_PROD_WIDE(ma, mb) < 0) &&
+                              (VEC_PERP_DOT_PROD_WIDE(mb, mc) < 0) &&
+                              (VEC_PERP_DOT_PROD_WIDE(mc, ma) < 0));
+    const bool are_all_ccw = ((VEC_PERP_DOT_PROD_WIDE(ma, mb) > 0) &&
+                              (VEC_PERP_DOT_PROD_WIDE(mb, mc) > 0) &&
+                              (VEC_PERP_DOT_PROD_WIDE(mc, ma) > 0));
     return are_all_cw || are_all_ccw;
 }
 
-bool obj_is_point_in_rect(vec3i_t* m, vec3i_t* a, vec3i_t* b, vec3i_t* c, vec3i_t* d) {
+bool obj_is_point_in_rect(vec3c_t* m, vec3i_t* a, vec3i_t* b, vec3i_t* c, vec3i_t* d) {
    /*
     * The diagram below visualises the conditions for M to be inside rectangle ABCD:
     *
@@ -429,16 +1488,20 @@ bool obj_is_point_in_rect(vec3i_t* m, vec3i_t* a, vec3i_t* b, vec3i_t* c, vec3i_
     *                  D                            C
     *
     */
-    vec3i_t ab = vec_vec3i_sub(a, b);
-    vec3i_t ad = vec_vec3i_sub(a, d);
-    vec3i_t am = vec_vec3i_sub(a, m);
-    return (0 < vec_vec3i_dotprod(&am, &ab)) &&
-           (vec_vec3i_dotprod(&am, &ab) < vec_vec3i_dotprod(&ab, &ab)) &&
-           (0 < vec_vec3i_dotprod(&am, &ad)) &&
-           (vec_vec3i_dotprod(&am, &ad) < vec_vec3i_dotprod(&ad, &ad));
+    const vec3i_t ab_i = vec_vec3i_sub(a, b);
+    const vec3i_t ad_i = vec_vec3i_sub(a, d);
+    const vec3c_t ab = {COORD_FROM_INT(ab_i.x), COORD_FROM_INT(ab_i.y), COORD_FROM_INT(ab_i.z)};
+    const vec3c_t ad = {COORD_FROM_INT(ad_i.x), COORD_FROM_INT(ad_i.y), COORD_FROM_INT(ad_i.z)};
+    vec3c_t am = obj__coord_sub(m, a);
+    am = (vec3c_t) {-am.x, -am.y, -am.z};
+    // all products keep the same scale so they can be compared as they are
+    const coord_wide_t am_ab = obj__coord_dotprod_wide(&am, &ab);
+    const coord_wide_t am_ad = obj__coord_dotprod_wide(&am, &ad);
+    return (0 < am_ab) && (am_ab < obj__coord_dotprod_wide(&ab, &ab)) &&
+           (0 < am_ad) && (am_ad < obj__coord_dotprod_wide(&ad, &ad));
 }
 
-vec3i_t render__ray_plane_intersection(plane_t* plane, ray_t* ray) {
+vec3c_t render__ray_plane_intersection(plane_t* plane, ray_t* ray) {
    /*
     * The parametric line of a ray from from the origin O through
     * point B ('end' of the ray) is:
@@ -458,14 +1521,14 @@ vec3i_t render__ray_plane_intersection(plane_t* plane, ray_t* ray) {
     * R(t0) = (d/(n.B))*B
     * This is what this function returns.
     */
-    float t0 = (float)plane->offset / vec_vec3i_dotprod(plane->normal, ray->end);
+    coord_t t0 = COORD_FROM_RATIO(plane->offset, vec_vec3i_dotprod(plane->normal, ray->end));
     // only interested in intersections along the positive direction
-    t0 = (t0 < 0.0) ? -t0 : t0;
-    vec3i_t ray_at_intersection = vec_vec3i_mul_scalar(ray->end, t0);
-    return ray_at_intersection;
+    t0 = (t0 < 0) ? -t0 : t0;
+    // the ray's end is integral so scaling it by t0 needs no rounding
+    return (vec3c_t) {ray->end->x*t0, ray->end->y*t0, ray->end->z*t0};
 }
 
-bool obj_ray_hits_rectangle(ray_t* ray, vec3i_t** points) {
+bool obj_ray_hits_rectangle(ray_t* ray, vec3i_t** points, plane_t* plane) {
     // find the intersection between the ray and the plane segment
     // defined by p0, p1, p2, p3 and if the intersection is whithin
     // that segment, return true
@@ -473,19 +1536,25 @@ bool obj_ray_hits_rectangle(ray_t* ray, vec3i_t** points) {
     vec3i_t* p1 = points[1];
     vec3i_t* p2 = points[2];
     vec3i_t* p3 = points[3];
-    obj_plane_set(g_plane_test, p0, p1, p2);
-    vec3i_t ray_plane_intersection = render__ray_plane_intersection(g_plane_test, ray);
+    obj_plane_set(plane, p0, p1, p2);
+    // a ray parallel to the plane never meets it - in fixed point it can't even be divided
+    if (vec_vec3i_dotprod(plane->normal, ray->end) == 0)
+        return false;
+    vec3c_t ray_plane_intersection = render__ray_plane_intersection(plane, ray);
     return obj_is_point_in_rect(&ray_plane_intersection, p0, p1, p2, p3);
 }
 
-bool obj_ray_hits_triangle(ray_t* ray, vec3i_t** points) {
+bool obj_ray_hits_triangle(ray_t* ray, vec3i_t** points, plane_t* plane) {
     // Find the intersection between the ray and the triangle (p0, p1, p2).
     // Return whether the intersection is whithin that triangle
     vec3i_t* p0 = points[0];
     vec3i_t* p1 = points[1];
     vec3i_t* p2 = points[2];
-    obj_plane_set(g_plane_test, p0, p1, p2);
-    vec3i_t ray_plane_intersection = render__ray_plane_intersection(g_plane_test, ray);
+    obj_plane_set(plane, p0, p1, p2);
+    // a ray parallel to the plane never meets it - in fixed point it can't even be divided
+    if (vec_vec3i_dotprod(plane->normal, ray->end) == 0)
+        return false;
+    vec3c_t ray_plane_intersection = render__ray_plane_intersection(plane, ray);
     return obj_is_point_in_triangle(&ray_plane_intersection, p0, p1, p2);
 }
 
@@ -0,0 +1,54 @@
+#include "quality.h"
+#include <string.h> // memset
+
+//----------------------------------------------------------------------------------
+// External functions
+//----------------------------------------------------------------------------------
+void quality_init(quality_t* quality, unsigned fps) {
+    quality->budget_secs = 1.0 / fps;
+    quality->secs = 0;
+    quality->step = 1;
+    quality->n_since_change = 0;
+    memset(&quality->stats, 0, sizeof(quality->stats));
+}
+
+unsigned quality_update(quality_t* quality, double frame_secs) {
+    quality_stats_t* stats = &quality->stats;
+    stats->n_frames++;
+    stats->n_frames_at[quality->step]++;
+    stats->secs_total += frame_secs;
+    if (frame_secs > quality->budget_secs)
+        stats->n_over_budget++;
+    // the first frame after a change starts the average over
+    quality->secs = (quality->n_since_change == 0) ?
+        frame_secs : QUALITY_SMOOTHING*frame_secs + (1 - QUALITY_SMOOTHING)*quality->secs;
+    quality->n_since_change++;
+
+    const unsigned step = quality->step;
+    if ((quality->secs > QUALITY_DEGRADE_AT*quality->budget_secs) && (step < QUALITY_MAX_STEP) &&
+        (quality->n_since_change >= QUALITY_DWELL)) {
+        quality->step++;
+        quality->n_since_change = 0;
+        stats->n_coarser++;
+    } else if ((step > 1) && (quality->n_since_change >= 2*QUALITY_DWELL)) {
+        const double secs_finer = quality->secs * (step*step) / ((step - 1)*(step - 1));
+        if (secs_finer < QUALITY_IMPROVE_AT*quality->budget_secs) {
+            quality->step--;
+            quality->n_since_change = 0;
+            stats->n_finer++;
+        }
+    }
+    return quality->step;
+}
+
+void quality_report(const quality_t* quality, FILE* stream) {
+    const quality_stats_t* stats = &quality->stats;
+    fprintf(stream, "quality: %zu frames, %zu over the %.1f ms budget, %.2f ms/frame on average, "
+                    "%zu times coarser and %zu finer, now step %u, frames per step:",
+            stats->n_frames, stats->n_over_budget, 1e3*quality->budget_secs,
+            (stats->n_frames > 0) ? 1e3*stats->secs_total/stats->n_frames : 0.0,
+            stats->n_coarser, stats->n_finer, quality->step);
+    for (unsigned step = 1; step <= QUALITY_MAX_STEP; ++step)
+        fprintf(stream, " %zu", stats->n_frames_at[step]);
+    fprintf(stream, "\n");
+}
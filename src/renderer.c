@@ -3,30 +3,56 @@
 #include "objects.h"
 #include "vector.h"
 #include "utils.h"
+#include "lod.h"
 #include <stdio.h>
 #include <stdlib.h> // malloc, free
 #include <string.h> // memset
 #include <limits.h> // INT_MAX, INT_MIN
+#include <stdint.h> // SIZE_MAX, uint32_t
+#include <math.h> // floor, ceil, fabs
 
 
 #define VEC_MAGN_SQUARED(vec) vec->x*vec->x + vec->y*vec->y + vec->z*vec->z
 #define VEC_PERP_DOT_PROD(a, b) a.x*b.y - a.y*b.x
+// depth of the near plane of the perspective camera - anything closer is clipped
+#define RENDER_Z_NEAR 1.0
 
+// how far behind the faces in front an edge may be and still be drawn, for the
+// rounding of the depths and the faces' slope across a character
+#define RENDER_EDGE_DEPTH_BIAS 4
 
-bool g_use_perspective = false;
-bool g_use_reflectance = false;
-int* g_z_buffer;
-vec3i_t** g_surf_points;
-// defines a plane each time we're about to hit a pixel
-plane_t* g_plane_test;
-ray_t* g_ray_test;
-// camera where rays are shot from 
-camera_t g_camera;
-// stores the colors of a surfaces after it reflects light - from brightest to darkest
-color_t g_colors_refl[32];
+// marks a face that has no samples on the current row
+#define RENDER_NO_SAMPLES SIZE_MAX
+
+// marks a face whose samples on the current row didn't fit in the row buffers
+#define RENDER_UNBATCHED (SIZE_MAX - 1)
+// faces per point of a row the row buffers have room for - hardly ever more than
+// half of it in practice
+#define RENDER_ROW_DEPTH 64
+
+// visible part of a face in the perspective mode, in world coordinates
+typedef struct face_bounds {
+    int x0, y0;
+    int x1, y1;
+    bool is_visible;
+    // index of the face's first sample in `row_samples` and its x
+    size_t row_start;
+    int row_x0;
+} face_bounds_t;
+
+// a face and the key it's sorted by when painting
+typedef struct face_depth {
+    uint32_t key;
+    unsigned face;
+} face_depth_t;
+
+
+renderer_t g_renderer;
+// reflection colors from brightest to darkest
+const color_t g_colors_refl[32] = "#OT&=@$x%><)(nc+:;qy\"/?|+.,-v^!`";
 // expand the second column of `CONN_TABLE`, mapping connections
 // to intersection functions in an 1-1 manner
-bool (*func_table_intersection[NUM_CONNECTIONS])(ray_t* ray, vec3i_t** points) = {
+bool (*func_table_intersection[NUM_CONNECTIONS])(ray_t* ray, vec3i_t** points, plane_t* plane) = {
 #define X(a, b, c) c,
     CONN_TABLE
 #undef X
@@ -44,37 +70,213 @@ static inline float render__cosine_squared(vec3i_t* vec1, vec3i_t* vec2) {
 
 
 /* find the z-coordinate on a plane given x and y */
-static inline int plane_z_at_xy(plane_t* plane, int x, int y) {
+static inline coord_t plane_z_at_xy(plane_t* plane, int x, int y) {
     // solve for z in plane's eq/n: n.x*x + n.y*y + n.z*z + offset = 0
     vec3i_t coeffs = (vec3i_t) {plane->normal->x, plane->normal->y, plane->offset};
     vec3i_t xyz = (vec3i_t) {x, y, 1};
-    return round(1.0/plane->normal->z*(-vec_vec3i_dotprod(&coeffs, &xyz)));
+    return COORD_FROM_RATIO(-vec_vec3i_dotprod(&coeffs, &xyz), plane->normal->z);
+}
+
+
+/* whether a projected point falls within the screen, i.e. inside the frustum's sides */
+static inline bool render__is_on_screen(screen_t* screen, vec3i_t* xyz) {
+    return (-screen->cols/2 <= xyz->x) && (xyz->x <= screen->cols/2) &&
+           (-screen->rows <= xyz->y) && (xyz->y <= screen->rows);
 }
 
+/* world units between the pixels sampled when rendering a shape */
+static inline unsigned render__step(renderer_t* r, mesh_t* shape) {
+    // downscale by subsampling if we use perspective
+    unsigned step = (r->use_perspective) ?
+        UT_MIN(abs(shape->bounding_box.z0), abs(shape->bounding_box.z1))/fabs(r->camera.focal_length) :
+        1;
+    step = (step < 1) ? 1 : step;
+    // coarser sampling paints each sample as a block so there are no holes
+    return step * ((r->sample_step > 1) ? r->sample_step : 1);
+}
+
+static inline size_t render__face_n_vertices(int connection_type) {
+    return (connection_type == CONNECTION_RECT) ? 4 : 3;
+}
+
+/**
+ * @brief Sizes the scratch buffers for any pose of a shape and any of its levels
+ *        of detail, so that rendering it again never allocates
+ */
+static void render__reserve(renderer_t* r, mesh_t* shape) {
+    for (size_t i = 0; i < shape->n_lods; ++i)
+        render__reserve(r, shape->lods[i]);
+    if (shape->n_faces > r->face_bounds_size) {
+        r->face_bounds = realloc(r->face_bounds, sizeof(face_bounds_t) * shape->n_faces);
+        r->face_depths = realloc(r->face_depths, sizeof(face_depth_t) * shape->n_faces);
+        r->face_depths_tmp = realloc(r->face_depths_tmp, sizeof(face_depth_t) * shape->n_faces);
+        r->face_bounds_size = shape->n_faces;
+    }
+    if (!r->use_perspective)
+        return;
+    // on a row, a face spans at most its diameter, plus a pixel for the rounding
+    // of its vertices and two for the padding and rounding of its bounds per side,
+    // and never more than the bounding box the row is clipped to
+    const size_t row_width = shape->bounding_box.width + 1;
+    const size_t max_face_samples = UT_MIN((size_t)ceil(shape->max_face_diameter) + 6, row_width);
+    // only the faces that cross a row take samples on it - far fewer than all of
+    // them for large meshes - so past RENDER_ROW_DEPTH faces per point of the row
+    // the others are sampled where they're drawn, see `render__project_row`
+    const size_t max_row_samples = UT_MIN(shape->n_faces * max_face_samples, RENDER_ROW_DEPTH * row_width);
+    vec_soa_reserve(r->row_samples, max_row_samples);
+    vec_soa_reserve(r->row_projected, max_row_samples);
+}
+
+/**
+ * @brief Culls each face of the shape against the frustum and clips the ones
+ *        that cross it. Writes the visible bounds of each face to `face_bounds`.
+ *
+ * @param[in]  r     Renderer whose frustum to cull against
+ * @param[in]  shape Pointer to the shape to cull
+ * @param[out] xmin  Minimum x of the visible faces in world coordinates
+ * @param[out] ymin  Minimum y of the visible faces in world coordinates
+ * @param[out] xmax  Maximum x of the visible faces in world coordinates
+ * @param[out] ymax  Maximum y of the visible faces in world coordinates
+ *
+ * @return false if no face is visible
+ */
+static bool render__clip_faces(renderer_t* r, mesh_t* shape, int* xmin, int* ymin, int* xmax, int* ymax) {
+    *xmin = *ymin = INT_MAX;
+    *xmax = *ymax = INT_MIN;
+    bool is_any_visible = false;
+    for (size_t isurf = 0; isurf < shape->n_faces; ++isurf) {
+        face_bounds_t* bounds = &r->face_bounds[isurf];
+        bounds->is_visible = false;
+        const size_t n_verts = render__face_n_vertices(shape->connections[isurf][4]);
+        vec3_t poly[4], clipped[4 + NUM_FRUSTUM_PLANES];
+        int x0 = INT_MAX, y0 = INT_MAX, z0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN, z1 = INT_MIN;
+        for (size_t i = 0; i < n_verts; ++i) {
+            vec3i_t* v = shape->vertices[shape->connections[isurf][i]];
+            poly[i] = (vec3_t) {v->x, v->y, v->z};
+            x0 = UT_MIN(x0, v->x); y0 = UT_MIN(y0, v->y); z0 = UT_MIN(z0, v->z);
+            x1 = UT_MAX(x1, v->x); y1 = UT_MAX(y1, v->y); z1 = UT_MAX(z1, v->z);
+        }
+        if (obj_frustum_culls_box(&r->frustum, x0, y0, z0, x1, y1, z1))
+            continue;
+        const size_t n_clipped = obj_frustum_clip_polygon(&r->frustum, poly, n_verts, clipped);
+        if (n_clipped == 0)
+            continue;
+        // bounds of the clipped polygon, padded by a pixel for rounding
+        float fx0 = clipped[0].x, fy0 = clipped[0].y, fx1 = clipped[0].x, fy1 = clipped[0].y;
+        for (size_t i = 1; i < n_clipped; ++i) {
+            fx0 = UT_MIN(fx0, clipped[i].x); fy0 = UT_MIN(fy0, clipped[i].y);
+            fx1 = UT_MAX(fx1, clipped[i].x); fy1 = UT_MAX(fy1, clipped[i].y);
+        }
+        bounds->x0 = floor(fx0) - 1;
+        bounds->y0 = floor(fy0) - 1;
+        bounds->x1 = ceil(fx1) + 1;
+        bounds->y1 = ceil(fy1) + 1;
+        bounds->is_visible = true;
+        is_any_visible = true;
+        *xmin = UT_MIN(*xmin, bounds->x0);
+        *ymin = UT_MIN(*ymin, bounds->y0);
+        *xmax = UT_MAX(*xmax, bounds->x1);
+        *ymax = UT_MAX(*ymax, bounds->y1);
+    }
+    return is_any_visible;
+}
+
+/**
+ * @brief Finds where the pixels of a row hit the plane of each visible face
+ *        and projects these points to the screen, all faces at once
+ *
+ * @param r     Renderer whose row buffers to fill
+ * @param shape Pointer to the shape to render, its faces clipped by `render__clip_faces`
+ * @param y     y-coordinate of the row in world coordinates
+ * @param xmin  Minimum x of the row - samples are taken at xmin + k*step
+ * @param xmax  Maximum x of the row
+ * @param step  Distance between two samples
+ */
+static void render__project_row(renderer_t* r, mesh_t* shape, int y, int xmin, int xmax, unsigned step) {
+    size_t n_samples = 0;
+    for (size_t isurf = 0; isurf < shape->n_faces; ++isurf) {
+        face_bounds_t* bounds = &r->face_bounds[isurf];
+        bounds->row_start = RENDER_NO_SAMPLES;
+        if (!bounds->is_visible || (y < bounds->y0) || (y > bounds->y1))
+            continue;
+        // first sample of the row within the face's bounds
+        int x0 = UT_MAX(xmin, bounds->x0);
+        x0 = xmin + (x0 - xmin + step - 1)/step*step;
+        const int x1 = UT_MIN(xmax, bounds->x1);
+        if (x0 > x1)
+            continue;
+        obj_plane_set(r->plane_test, shape->vertices[shape->connections[isurf][0]],
+                                     shape->vertices[shape->connections[isurf][1]],
+                                     shape->vertices[shape->connections[isurf][2]]);
+        // faces seen edge-on or collapsed to a line by rounding cover no pixels
+        // and their plane has no z at (x, y)
+        if (r->plane_test->normal->z == 0)
+            continue;
+        bounds->row_x0 = x0;
+        // once the row buffers are full, the face is sampled where it's drawn
+        const size_t n_face_samples = (x1 - x0)/step + 1;
+        if (n_samples + n_face_samples > r->row_samples->capacity) {
+            bounds->row_start = RENDER_UNBATCHED;
+            continue;
+        }
+        bounds->row_start = n_samples;
+        vec_soa_resize(r->row_samples, n_samples + n_face_samples);
+        for (int x = x0; x <= x1; x += step, ++n_samples) {
+            // -y to avoid drawing inverted images
+            r->row_samples->x[n_samples] = COORD_FROM_INT(x);
+            r->row_samples->y[n_samples] = COORD_FROM_INT(-y);
+            r->row_samples->z[n_samples] = plane_z_at_xy(r->plane_test, x, y);
+        }
+    }
+    // only points past the near plane are used, so the image is flipped for all of them
+    vec_soa_resize(r->row_samples, n_samples);
+    vec_soa_resize(r->row_projected, n_samples);
+    vec_batch_persp_divide(r->row_projected, r->row_samples, -r->camera.focal_length);
+}
 
-/* perspective trasnform to map world point (3D) to screen (2D) */
-static inline vec3i_t render__persp_transform(vec3i_t* xyz) {
-    // to avoid drawing inverted images
-    int sign = (xyz->z > 0) ? -1 : 1;
-    return (vec3i_t) {UT_CLIP(sign*xyz->x*g_camera.focal_length/(xyz->z + 1e-8), -g_cols/2, g_cols/2),
-                      UT_CLIP(sign*xyz->y*g_camera.focal_length/(xyz->z + 1e-8), -g_rows, g_rows),
-                      xyz->z};
+/**
+ * @brief Samples a face at a pixel of the row the way `render__project_row`
+ *        does for the faces that fit in the row buffers
+ *
+ * @param[in]  r     Renderer whose camera projects the sample
+ * @param[in]  shape Pointer to the shape the face belongs to
+ * @param      isurf Index of the face
+ * @param      x     x-coordinate of the pixel in world coordinates
+ * @param      y     y-coordinate of the pixel in world coordinates
+ * @param[out] point Projected point and its depth
+ *
+ * @return false if the sample is before the near plane
+ */
+static bool render__sample_face(renderer_t* r, mesh_t* shape, size_t isurf, int x, int y, vec3i_t* point) {
+    obj_plane_set(r->plane_test, shape->vertices[shape->connections[isurf][0]],
+                                 shape->vertices[shape->connections[isurf][1]],
+                                 shape->vertices[shape->connections[isurf][2]]);
+    const coord_t z = plane_z_at_xy(r->plane_test, x, y);
+    point->z = COORD_TO_INT(z);
+    if (point->z < RENDER_Z_NEAR)
+        return false;
+    // the same operations as `vec_batch_persp_divide`
+    const coord_t s = COORD_FROM_FLOAT(-r->camera.focal_length);
+    point->x = COORD_TRUNC(COORD_DIV(COORD_MUL(s, COORD_FROM_INT(x)), z));
+    point->y = COORD_TRUNC(COORD_DIV(COORD_MUL(s, COORD_FROM_INT(-y)), z));
+    return true;
 }
 
 /**
 * @brief Returns a color based on the angle between the ray and plane,
 *        simulating reflection
 *
+* @param[in] r A pointer to the renderer whose camera sees the surface
 * @param[in] ray A pointer to ray
 * @param[in] plane A pointer to plane
 * @param[in] shape A pointer to shape
 *
 * @returns Reflected color
 */
-static inline color_t render__reflect(ray_t* ray, plane_t* plane, mesh_t* shape) {
-    const int z_refl = (g_use_perspective) ? g_camera.focal_length : -shape->center->z/2;
-    vec3i_t camera_axis = {g_camera.x0,
-                            g_camera.y0,
+static inline color_t render__reflect(renderer_t* r, ray_t* ray, plane_t* plane, mesh_t* shape) {
+    const int z_refl = (r->use_perspective) ? r->camera.focal_length : -shape->center->z/2;
+    vec3i_t camera_axis = {r->camera.x0,
+                            r->camera.y0,
                             z_refl};
     const vec3i_t plane_normal = *plane->normal;
     const int ray_angle_ccw = VEC_PERP_DOT_PROD(camera_axis, plane_normal);
@@ -113,39 +315,306 @@ static inline color_t render__reflect(ray_t* ray, plane_t* plane, mesh_t* shape)
                          (size_t)((ray_plane_angle+1)/w_a)*w_c)];
 }
 
-static void render_reset_zbuffer() {
-    for (size_t i = 0; i < g_buffer_size; ++i)
-        g_z_buffer[i] = INT_MAX;
+/* paints the `size`x`size` block of pixels centered on a sample, depth testing them unless told not to */
+static void render__write_block(renderer_t* r, const vec3i_t* point, color_t color, int size, bool is_depth_tested) {
+    for (int dy = -(size - 1)/2; dy <= size/2; ++dy) {
+        for (int dx = -(size - 1)/2; dx <= size/2; ++dx) {
+            vec3i_t pixel = {point->x + dx, point->y + dy, point->z};
+            if (!render__is_on_screen(r->screen, &pixel))
+                continue;
+            if (is_depth_tested) {
+                const size_t ind = screen_xy2ind_r(r->screen, pixel.x, pixel.y);
+                if (pixel.z >= r->z_buffer[ind])
+                    continue;
+                r->z_buffer[ind] = pixel.z;
+            }
+            screen_write_pixel_r(r->screen, pixel.x, pixel.y, color);
+        }
+    }
+}
+
+/* character that draws a line going `drow` rows down over `dcol` columns, which are about half as tall */
+static inline color_t render__edge_color(int drow, int dcol) {
+    if (5*abs(drow) <= abs(dcol))
+        return '-';
+    if (abs(drow) >= abs(dcol))
+        return '|';
+    return ((drow > 0) == (dcol > 0)) ? '\\' : '/';
+}
+
+/**
+ * @brief Draws a line between two cells of the screen with Bresenham's
+ *        algorithm, a character per cell it crosses
+ *
+ * @param r      Renderer whose screen to draw on
+ * @param row0   Row of the first end
+ * @param col0   Column of the first end
+ * @param z0     Depth of the first end
+ * @param row1   Row of the other end
+ * @param col1   Column of the other end
+ * @param z1     Depth of the other end
+ */
+static void render__write_line(renderer_t* r, int row0, int col0, float z0, int row1, int col1, float z1) {
+    const int rows = r->screen->rows, cols = r->screen->cols;
+    // all of it on one side of the screen
+    if (((row0 < 0) && (row1 < 0)) || ((row0 >= rows) && (row1 >= rows)) ||
+        ((col0 < 0) && (col1 < 0)) || ((col0 >= cols) && (col1 >= cols)))
+        return;
+    const int drow = abs(row1 - row0), dcol = abs(col1 - col0);
+    const int srow = (row0 < row1) ? 1 : -1, scol = (col0 < col1) ? 1 : -1;
+    const int n_steps = UT_MAX(drow, dcol);
+    const color_t color = render__edge_color(row1 - row0, col1 - col0);
+    // on the screen depth varies linearly along the line in the orthographic
+    // mode and its inverse does in perspective
+    const float w0 = (r->use_perspective) ? 1/z0 : z0, w1 = (r->use_perspective) ? 1/z1 : z1;
+    int err = dcol - drow;
+    for (int row = row0, col = col0, i = 0;; ++i) {
+        if ((row >= 0) && (row < rows) && (col >= 0) && (col < cols)) {
+            bool is_hidden = false;
+            if (r->use_hidden_lines) {
+                const float w = (n_steps > 0) ? w0 + (w1 - w0)*i/n_steps : w0;
+                const float z = (r->use_perspective) ? 1/w : w;
+                is_hidden = (z > (float)r->z_buffer[(size_t)row*cols + col] + RENDER_EDGE_DEPTH_BIAS);
+            }
+            if (!is_hidden)
+                screen_write_cell_r(r->screen, row, col, color);
+        }
+        if ((row == row1) && (col == col1))
+            break;
+        const int err2 = 2*err;
+        if (err2 > -drow) {
+            err -= drow;
+            col += scol;
+        }
+        if (err2 < dcol) {
+            err += dcol;
+            row += srow;
+        }
+    }
+}
+
+/**
+ * @brief Projects each edge of a shape to the screen and draws it, hiding
+ *        the parts behind the depth buffer if the renderer hides lines
+ *
+ * @param r     Renderer to draw with
+ * @param shape Pointer to the shape to draw, its edges found and its vertices transformed
+ */
+static void render__write_edges(renderer_t* r, mesh_t* shape) {
+    const float scale = -r->camera.focal_length;
+    for (size_t iedge = 0; iedge < shape->n_edges; ++iedge) {
+        const vec3i_t* a = shape->vertices[shape->edges[2*iedge]];
+        const vec3i_t* b = shape->vertices[shape->edges[2*iedge + 1]];
+        // -y to avoid drawing inverted images
+        float x0 = a->x, y0 = -a->y, z0 = a->z, x1 = b->x, y1 = -b->y, z1 = b->z;
+        if (r->use_perspective) {
+            // only the part past the near plane is seen
+            if ((z0 < RENDER_Z_NEAR) && (z1 < RENDER_Z_NEAR))
+                continue;
+            if ((z0 < RENDER_Z_NEAR) || (z1 < RENDER_Z_NEAR)) {
+                const float t = (RENDER_Z_NEAR - z0)/(z1 - z0);
+                const float x = x0 + t*(x1 - x0), y = y0 + t*(y1 - y0);
+                if (z0 < RENDER_Z_NEAR)
+                    x0 = x, y0 = y, z0 = RENDER_Z_NEAR;
+                else
+                    x1 = x, y1 = y, z1 = RENDER_Z_NEAR;
+            }
+            x0 = scale*x0/z0, y0 = scale*y0/z0;
+            x1 = scale*x1/z1, y1 = scale*y1/z1;
+        }
+        int row0, col0, row1, col1;
+        screen_xy2cell_r(r->screen, x0, y0, &row0, &col0);
+        screen_xy2cell_r(r->screen, x1, y1, &row1, &col1);
+        render__write_line(r, row0, col0, z0, row1, col1, z1);
+    }
+}
+
+/**
+ * @brief Orders the faces of a shape from the farthest to the closest by the
+ *        depth of their centroids, with a radix sort of a byte per pass
+ *
+ * @return `shape->n_faces` faces in the order to paint them, in one of the
+ *         renderer's buffers
+ */
+static const face_depth_t* render__sort_faces(renderer_t* r, mesh_t* shape) {
+    face_depth_t* src = r->face_depths;
+    face_depth_t* dest = r->face_depths_tmp;
+    const size_t n_faces = shape->n_faces;
+    size_t counts[4][256] = {{0}};
+    for (size_t isurf = 0; isurf < n_faces; ++isurf) {
+        const int* face = shape->connections[isurf];
+        const size_t n_verts = render__face_n_vertices(face[4]);
+        int z_sum = 0;
+        for (size_t i = 0; i < n_verts; ++i)
+            z_sum += shape->vertices[face[i]]->z;
+        // 12 times the depth of the centroid is whole for triangles and quads alike.
+        // Flipping its sign bit orders the keys like the depths, flipping them
+        // all puts the farthest first.
+        const uint32_t key = ~((uint32_t) (z_sum * (int) (12 / n_verts)) ^ 0x80000000u);
+        src[isurf] = (face_depth_t) {key, isurf};
+        for (int pass = 0; pass < 4; ++pass)
+            counts[pass][(key >> 8*pass) & 0xff]++;
+    }
+    for (int pass = 0; (pass < 4) && (n_faces > 0); ++pass) {
+        size_t* count = counts[pass];
+        // a byte all keys share leaves the order as it is, e.g. the top ones of close depths
+        if (count[(src[0].key >> 8*pass) & 0xff] == n_faces)
+            continue;
+        size_t offset = 0;
+        for (int digit = 0; digit < 256; ++digit) {
+            const size_t n = count[digit];
+            count[digit] = offset;
+            offset += n;
+        }
+        for (size_t i = 0; i < n_faces; ++i)
+            dest[count[(src[i].key >> 8*pass) & 0xff]++] = src[i];
+        face_depth_t* sorted = dest;
+        dest = src;
+        src = sorted;
+    }
+    return src;
+}
+
+/**
+ * @brief Fills the faces of a shape from the farthest to the closest, each over
+ *        its own bounds, overwriting the pixels instead of depth testing them.
+ *        The samples are on the same grid as the depth buffered ones.
+ *
+ * @param r     Renderer to draw with
+ * @param shape Pointer to the shape to draw, its faces clipped by
+ *              `render__clip_faces` in perspective
+ * @param xmin  Minimum x of the samples - they're taken at xmin + k*step
+ * @param ymin  Minimum y of the samples - they're taken at ymin + k*step
+ * @param xmax  Maximum x of the samples
+ * @param ymax  Maximum y of the samples
+ * @param step  Distance between two samples
+ */
+static void render__paint_faces(renderer_t* r, mesh_t* shape, int xmin, int ymin, int xmax, int ymax,
+                                unsigned step) {
+    const face_depth_t* order = render__sort_faces(r, shape);
+    const int block = (r->sample_step > 1) ? r->sample_step : 1;
+    const coord_t scale = COORD_FROM_FLOAT(-r->camera.focal_length);
+    for (size_t iorder = 0; iorder < shape->n_faces; ++iorder) {
+        const size_t isurf = order[iorder].face;
+        const int* face = shape->connections[isurf];
+        int x0, y0, x1, y1;
+        if (r->use_perspective) {
+            const face_bounds_t* bounds = &r->face_bounds[isurf];
+            if (!bounds->is_visible)
+                continue;
+            x0 = bounds->x0, y0 = bounds->y0, x1 = bounds->x1, y1 = bounds->y1;
+        } else {
+            x0 = y0 = INT_MAX;
+            x1 = y1 = INT_MIN;
+            for (size_t i = 0; i < render__face_n_vertices(face[4]); ++i) {
+                const vec3i_t* v = shape->vertices[face[i]];
+                x0 = UT_MIN(x0, v->x); y0 = UT_MIN(y0, v->y);
+                x1 = UT_MAX(x1, v->x); y1 = UT_MAX(y1, v->y);
+            }
+        }
+        // first samples within the face's bounds
+        x0 = xmin + (UT_MAX(xmin, x0) - xmin + step - 1)/step*step;
+        y0 = ymin + (UT_MAX(ymin, y0) - ymin + step - 1)/step*step;
+        x1 = UT_MIN(xmax, x1);
+        y1 = UT_MIN(ymax, y1);
+        if ((x0 > x1) || (y0 > y1))
+            continue;
+        obj_plane_set(r->plane_test, shape->vertices[face[0]], shape->vertices[face[1]], shape->vertices[face[2]]);
+        // faces seen edge-on or collapsed to a line by rounding cover no pixels
+        // and their plane has no z at (x, y)
+        if (r->plane_test->normal->z == 0)
+            continue;
+        for (int i = 0; i < 4; ++i)
+            r->surf_points[i] = shape->vertices[face[i]];
+        for (int y = y0; y <= y1; y += step) {
+            for (int x = x0; x <= x1; x += step) {
+                const coord_t z = plane_z_at_xy(r->plane_test, x, y);
+                const int z_hit = COORD_TO_INT(z);
+                // -y to avoid drawing inverted images
+                vec3i_t point = {x, -y, z_hit};
+                if (r->use_perspective) {
+                    // projected like `vec_batch_persp_divide` does the rows of samples
+                    if (z_hit < RENDER_Z_NEAR)
+                        continue;
+                    point.x = COORD_TRUNC(COORD_DIV(COORD_MUL(scale, COORD_FROM_INT(x)), z));
+                    point.y = COORD_TRUNC(COORD_DIV(COORD_MUL(scale, COORD_FROM_INT(-y)), z));
+                    if (!render__is_on_screen(r->screen, &point))
+                        continue;
+                }
+                obj_ray_send(r->ray_test, x, y, z_hit);
+                if (!(*func_table_intersection[face[4]])(r->ray_test, r->surf_points, r->plane_test))
+                    continue;
+                const color_t color = (r->use_reflectance) ?
+                    render__reflect(r, r->ray_test, r->plane_test, shape) : face[5];
+                if (block > 1)
+                    render__write_block(r, &point, color, block, false);
+                else
+                    screen_write_pixel_r(r->screen, point.x, point.y, color);
+            }
+        }
+    }
+}
+
+static void render_reset_zbuffer(renderer_t* r) {
+    const int cols = r->screen->cols;
+    for (int row = r->z_drawn.row0; row <= r->z_drawn.row1; ++row)
+        for (int col = r->z_drawn.col0; col <= r->z_drawn.col1; ++col)
+            r->z_buffer[(size_t)row*cols + col] = INT_MAX;
+    r->z_drawn = sink_rect_empty();
+}
+
+/* z_buffer is NULL for the renderer to allocate its own */
+static void render__init(renderer_t* renderer, screen_t* screen, int* z_buffer) {
+    renderer->screen = screen;
+    // the frustum depends on the screen size so it's known only now
+    obj_frustum_set(&renderer->frustum, &renderer->camera, screen->cols/2, screen->rows, RENDER_Z_NEAR);
+    // z buffer that records the depth of each pixel
+    renderer->owns_z_buffer = (z_buffer == NULL);
+    renderer->z_buffer = (renderer->owns_z_buffer) ? malloc(sizeof(int) * screen->buffer_size) : z_buffer;
+    renderer->z_drawn = (sink_rect_t) {0, 0, screen->rows - 1, screen->cols - 1};
+    render_reset_zbuffer(renderer);
+    renderer->plane_test = obj_plane_new();
+    renderer->ray_test = obj_ray_new();
+    obj_ray_set(renderer->ray_test, 0, 0, 0, 0, 0, 0);
+    renderer->face_bounds = NULL;
+    renderer->face_bounds_size = 0;
+    renderer->face_depths = NULL;
+    renderer->face_depths_tmp = NULL;
+    renderer->row_samples = vec_soa_new(0);
+    renderer->row_projected = vec_soa_new(0);
 }
 
 //------------------------------------------------------------------------------------
 // External functions
 //------------------------------------------------------------------------------------
-void render_use_perspective(int center_x0, int center_y0, float focal_length) {
-    g_use_perspective = true;
-    obj_camera_set(&g_camera, center_x0, center_y0, focal_length);
+void render_use_perspective_r(renderer_t* renderer, int center_x0, int center_y0, float focal_length) {
+    renderer->use_perspective = true;
+    obj_camera_set(&renderer->camera, center_x0, center_y0, focal_length);
 }
 
-void render_use_reflectance() {
-    g_use_reflectance = true;
+void render_use_reflectance_r(renderer_t* renderer) {
+    renderer->use_reflectance = true;
 }
 
-void render_init() {
-    // initialize screen (pixel) buffer
-    screen_init();
-    // z buffer that records the depth of each pixel
-    g_z_buffer = malloc(sizeof(int) * g_buffer_size);
-    render_reset_zbuffer();
-    g_plane_test = obj_plane_new();
-    g_surf_points = malloc(sizeof(vec3i_t*) * 4);
-    g_ray_test = obj_ray_new();
-    obj_ray_set(g_ray_test, 0, 0, 0, 0, 0, 0);
-    // reflection colors from brightest to darkest
-    strncpy(g_colors_refl, "#OT&=@$x%><)(nc+:;qy\"/?|+.,-v^!`", 32);
+void render_use_wireframe_r(renderer_t* renderer, bool hide_lines) {
+    renderer->use_wireframe = true;
+    renderer->use_hidden_lines = hide_lines;
 }
 
+void render_use_painter_r(renderer_t* renderer) {
+    renderer->use_painter = true;
+}
 
-void render_write_shape(mesh_t* shape) {
+void render_init_r(renderer_t* renderer, screen_t* screen) {
+    render__init(renderer, screen, NULL);
+}
+
+void render_init_offscreen_r(renderer_t* renderer, screen_t* screen, int* z_buffer) {
+    render__init(renderer, screen, z_buffer);
+}
+
+
+void render_write_shape_r(renderer_t* r, mesh_t* shape) {
 /*
  * This function renders the given cube by the basic ray tracing principle.
  *
@@ -181,87 +650,213 @@ void render_write_shape(mesh_t* shape) {
  *                                           \
  *                                            V
  */
+    // the first time a shape is seen is the only time it may allocate
+    if (r->use_perspective || r->use_painter)
+        render__reserve(r, shape);
+    if (r->use_wireframe)
+        obj_mesh_build_edges(shape);
+    // draw the coarsest level of detail that still has enough faces for the
+    // samples across the shape
+    if (shape->n_lods > 0) {
+        const struct bounding_box* box = &shape->bounding_box;
+        const float diameter = sqrt((float)box->width*box->width + (float)box->height*box->height +
+                                    (float)box->depth*box->depth);
+        shape = lod_select(shape, diameter / render__step(r, shape));
+    }
+    // bring the vertices to where the mesh was moved or rotated to
+    obj_mesh_apply_transform(shape);
+    // unless lines are hidden behind the faces, no face is filled
+    if (r->use_wireframe && !r->use_hidden_lines) {
+        render__write_edges(r, shape);
+        return;
+    }
+    // faces are filled blank under the wireframe and shaded otherwise
+    const bool is_shaded = r->use_reflectance && !r->use_wireframe;
     // whether we want to use the perspective transform or not
-    vec3i_t ray_origin = (vec3i_t) {g_camera.x0, g_camera.y0, g_camera.focal_length};
-    vec_vec3i_copy(g_ray_test->orig, &ray_origin);
+    vec3i_t ray_origin = (vec3i_t) {r->camera.x0, r->camera.y0, r->camera.focal_length};
+    vec_vec3i_copy(r->ray_test->orig, &ray_origin);
     // screen boundaries
     int xmin, xmax, ymin, ymax;
-    if (g_use_perspective) {
+    if (r->use_perspective) {
+        // skip the shape if the camera can't see it, otherwise render only
+        // the parts of its faces that are inside the frustum
+        if (obj_frustum_culls_box(&r->frustum,
+                                  shape->vertices_min.x, shape->vertices_min.y, shape->vertices_min.z,
+                                  shape->vertices_max.x, shape->vertices_max.y, shape->vertices_max.z))
+            return;
+        if (!render__clip_faces(r, shape, &xmin, &ymin, &xmax, &ymax))
+            return;
         // clip rendering area to bounding box
-        xmin = UT_MIN(shape->bounding_box.x0, shape->bounding_box.x1);
-        ymin = UT_MIN(shape->bounding_box.y0, shape->bounding_box.y1);
-        xmax = UT_MAX(shape->bounding_box.x0, shape->bounding_box.x1);
-        ymax = UT_MAX(shape->bounding_box.y0, shape->bounding_box.y1);
+        xmin = UT_MAX(xmin, UT_MIN(shape->bounding_box.x0, shape->bounding_box.x1));
+        ymin = UT_MAX(ymin, UT_MIN(shape->bounding_box.y0, shape->bounding_box.y1));
+        xmax = UT_MIN(xmax, UT_MAX(shape->bounding_box.x0, shape->bounding_box.x1));
+        ymax = UT_MIN(ymax, UT_MAX(shape->bounding_box.y0, shape->bounding_box.y1));
     } else {
         // clip rendering area to screen clip to rows and columns
-        xmin = UT_MAX(-g_cols/2+1, shape->bounding_box.x0);
-        ymin = UT_MAX(-g_rows, shape->bounding_box.y0);
-        xmax = UT_MIN(g_cols/2, shape->bounding_box.x1);
-        ymax = UT_MIN(g_rows+1, shape->bounding_box.y1);
+        xmin = UT_MAX(-r->screen->cols/2+1, shape->vertices_min.x);
+        ymin = UT_MAX(-r->screen->rows, shape->vertices_min.y);
+        xmax = UT_MIN(r->screen->cols/2, shape->vertices_max.x);
+        ymax = UT_MIN(r->screen->rows+1, shape->vertices_max.y);
     }
-    // downscale by subsampling if we use perspective
-    unsigned step = (g_use_perspective) ?
-        UT_MIN(abs(shape->bounding_box.z0), abs(shape->bounding_box.z1))/g_camera.focal_length :
-        1;
-    step = (step < 1) ? 1 : step;
+    const unsigned step = render__step(r, shape);
+    // hidden lines need the depth buffer filled
+    if (r->use_painter && !r->use_wireframe) {
+        render__paint_faces(r, shape, xmin, ymin, xmax, ymax, step);
+        return;
+    }
+    const int block = (r->sample_step > 1) ? r->sample_step : 1;
+    // with a face BVH we only visit the faces whose bounds contain each pixel
+    face_bvh_t* bvh = shape->face_bvh;
+    if ((bvh != NULL) && bvh->is_stale)
+        obj_face_bvh_refit(shape);
 
     for (int y = ymin;  y <= ymax; y += step) {
+        if (r->use_perspective)
+            render__project_row(r, shape, y, xmin, xmax, step);
         for (int x = xmin; x <= xmax; x += step) {
             // -y to avoid drawing inverted images
-            size_t buffer_ind = screen_xy2ind(x, -y);
+            size_t buffer_ind = screen_xy2ind_r(r->screen, x, -y);
             // the final pixel and color to render
-            vec3i_t rendered_point = (vec3i_t) {x, -y, g_z_buffer[buffer_ind]};
-            for (size_t isurf = 0; isurf < shape->n_faces; ++isurf) {
-                // unpack surface info, hence define surface from shape->vertices
-                const size_t ipoint0 = shape->connections[isurf][0];
-                const size_t ipoint1 = shape->connections[isurf][1];
-                const size_t ipoint2 = shape->connections[isurf][2];
-                const size_t ipoint3 = shape->connections[isurf][3];
-                const int connection_type = shape->connections[isurf][4];
-                const color_t surf_color = shape->connections[isurf][5];
-                g_surf_points[0] = shape->vertices[ipoint0];
-                g_surf_points[1] = shape->vertices[ipoint1];
-                g_surf_points[2] = shape->vertices[ipoint2];
-                g_surf_points[3] = shape->vertices[ipoint3];
-                
-                // find intersections of ray and surface and set colour accordingly
-                obj_plane_set(g_plane_test, g_surf_points[0], g_surf_points[1], g_surf_points[2]);
+            vec3i_t rendered_point = (vec3i_t) {x, -y, r->z_buffer[buffer_ind]};
+            const size_t n_candidates = (bvh != NULL) ? obj_face_bvh_query(bvh, x, y) : shape->n_faces;
+            for (size_t icandidate = 0; icandidate < n_candidates; ++icandidate) {
+                const size_t isurf = (bvh != NULL) ? bvh->hits[icandidate] : icandidate;
                 // we keep the z to find the closest one to the origin and we draw
                 // its x and y at the z the ray hits the current surface
-                int z_hit = plane_z_at_xy(g_plane_test, x, y);
-                obj_ray_send(g_ray_test, x, y, z_hit);
+                int z_hit;
                 vec3i_t persp_point; 
                 // if we use perspective, we index the depth buffer at the (x,y)
                 // of the projected point, not the original one (`persp_point`)
-                if (g_use_perspective) {
-                    persp_point = (vec3i_t) {x, -y, z_hit};
-                    persp_point = render__persp_transform(&persp_point);
-                    buffer_ind = screen_xy2ind(persp_point.x, persp_point.y);
+                if (r->use_perspective) {
+                    const face_bounds_t* bounds = &r->face_bounds[isurf];
+                    if ((bounds->row_start == RENDER_NO_SAMPLES) || (x < bounds->row_x0) || (x > bounds->x1))
+                        continue;
+                    if (bounds->row_start == RENDER_UNBATCHED) {
+                        if (!render__sample_face(r, shape, isurf, x, y, &persp_point))
+                            continue;
+                        z_hit = persp_point.z;
+                    } else {
+                        const size_t isample = bounds->row_start + (x - bounds->row_x0)/step;
+                        z_hit = COORD_TO_INT(r->row_samples->z[isample]);
+                        // near plane and screen edges clip the face
+                        if (z_hit < RENDER_Z_NEAR)
+                            continue;
+                        persp_point = (vec3i_t) {COORD_TRUNC(r->row_projected->x[isample]),
+                                                 COORD_TRUNC(r->row_projected->y[isample]), z_hit};
+                    }
+                    if (!render__is_on_screen(r->screen, &persp_point))
+                        continue;
+                    buffer_ind = screen_xy2ind_r(r->screen, persp_point.x, persp_point.y);
+                } else {
+                    obj_plane_set(r->plane_test, shape->vertices[shape->connections[isurf][0]],
+                                                 shape->vertices[shape->connections[isurf][1]],
+                                                 shape->vertices[shape->connections[isurf][2]]);
+                    // faces seen edge-on or collapsed to a line by rounding cover no pixels
+                    // and their plane has no z at (x, y)
+                    if (r->plane_test->normal->z == 0)
+                        continue;
+                    z_hit = COORD_TO_INT(plane_z_at_xy(r->plane_test, x, y));
                 }
-                if ((*func_table_intersection[connection_type])(g_ray_test, g_surf_points) &&
-                (z_hit < g_z_buffer[buffer_ind])) {
+                obj_ray_send(r->ray_test, x, y, z_hit);
+                // unpack surface info, hence define surface from shape->vertices
+                const int connection_type = shape->connections[isurf][4];
+                const color_t surf_color = (r->use_wireframe) ? ' ' : shape->connections[isurf][5];
+                r->surf_points[0] = shape->vertices[shape->connections[isurf][0]];
+                r->surf_points[1] = shape->vertices[shape->connections[isurf][1]];
+                r->surf_points[2] = shape->vertices[shape->connections[isurf][2]];
+                r->surf_points[3] = shape->vertices[shape->connections[isurf][3]];
+                if ((block > 1) &&
+                    (*func_table_intersection[connection_type])(r->ray_test, r->surf_points, r->plane_test)) {
+                    const color_t rendered_color = (is_shaded) ?
+                        render__reflect(r, r->ray_test, r->plane_test, shape) : surf_color;
+                    if (r->use_perspective)
+                        rendered_point = persp_point;
+                    rendered_point.z = z_hit;
+                    render__write_block(r, &rendered_point, rendered_color, block, true);
+                } else if ((block == 1) &&
+                (*func_table_intersection[connection_type])(r->ray_test, r->surf_points, r->plane_test) &&
+                (z_hit < r->z_buffer[buffer_ind])) {
                     color_t rendered_color = surf_color;
                     // modern compilers (gcc >= 4.0, clang >= 3.0) know how to optimize this:
-                    if (g_use_reflectance)
-                        rendered_color = render__reflect(g_ray_test, g_plane_test, shape);
-                    if (g_use_perspective)
+                    if (is_shaded)
+                        rendered_color = render__reflect(r, r->ray_test, r->plane_test, shape);
+                    if (r->use_perspective)
                         rendered_point = persp_point;
-                    g_z_buffer[buffer_ind] = z_hit;
-                    screen_write_pixel(rendered_point.x, rendered_point.y, rendered_color);
+                    r->z_buffer[buffer_ind] = z_hit;
+                    screen_write_pixel_r(r->screen, rendered_point.x, rendered_point.y, rendered_color);
                 }
             } /* for surfaces */
         } /* for x */
     } /* for y */
+    // depths are only written with pixels, so the screen knows where they are
+    r->z_drawn = sink_rect_union(r->z_drawn, r->screen->drawn);
+    if (r->use_wireframe)
+        render__write_edges(r, shape);
 }
 
-void render_flush() {
-    render_reset_zbuffer();
-    screen_flush();
+void render_clear_r(renderer_t* renderer) {
+    render_reset_zbuffer(renderer);
+    screen_clear_r(renderer->screen);
+}
+
+void render_flush_r(renderer_t* renderer) {
+    render_reset_zbuffer(renderer);
+    screen_flush_r(renderer->screen);
+}
+
+
+void render_end_r(renderer_t* renderer) {
+    if (renderer->owns_z_buffer)
+        free(renderer->z_buffer);
+    obj_plane_free(renderer->plane_test);
+    obj_ray_free(renderer->ray_test);
+    free(renderer->face_bounds);
+    renderer->face_bounds = NULL;
+    free(renderer->face_depths);
+    renderer->face_depths = NULL;
+    free(renderer->face_depths_tmp);
+    renderer->face_depths_tmp = NULL;
+    renderer->face_bounds_size = 0;
+    vec_soa_free(renderer->row_samples);
+    vec_soa_free(renderer->row_projected);
+}
+
+void render_use_perspective(int center_x0, int center_y0, float focal_length) {
+    render_use_perspective_r(&g_renderer, center_x0, center_y0, focal_length);
+}
+
+void render_use_reflectance() {
+    render_use_reflectance_r(&g_renderer);
+}
+
+void render_use_wireframe(bool hide_lines) {
+    render_use_wireframe_r(&g_renderer, hide_lines);
+}
+
+void render_use_painter() {
+    render_use_painter_r(&g_renderer);
+}
+
+void render_init() {
+    // initialize screen (pixel) buffer
+    screen_init();
+    render_init_r(&g_renderer, &g_screen);
 }
 
+void render_init_sink(sink_t* sink, int rows, int cols) {
+    screen_init_sink_r(&g_screen, rows, cols, sink);
+    render_init_r(&g_renderer, &g_screen);
+}
+
+void render_write_shape(mesh_t* shape) {
+    render_write_shape_r(&g_renderer, shape);
+}
+
+void render_flush() {
+    render_flush_r(&g_renderer);
+}
 
 void render_end() {
     screen_end();
-    free(g_surf_points);
-    obj_plane_free(g_plane_test);
+    render_end_r(&g_renderer);
 }
@@ -0,0 +1,124 @@
+#include "scene.h"
+#include "objects.h"
+#include "vector.h"
+#include <stdlib.h> // malloc, realloc, free
+#include <stdbool.h> // bool
+#include <stddef.h> // size_t
+#include <assert.h> // assert
+
+#define SCENE_INITIAL_CHILDREN 4
+
+//----------------------------------------------------------------------------------------------------------
+// Static functions
+//----------------------------------------------------------------------------------------------------------
+/* let the ancestors know they have to visit this node at the next update */
+static void scene__mark_ancestors(scene_node_t* node) {
+    // stop at the first node that's queued already, so are its ancestors
+    for (; (node->parent != NULL) && !node->is_queued; node = node->parent) {
+        scene_node_t* parent = node->parent;
+        parent->dirty_children[parent->n_dirty_children++] = node;
+        node->is_queued = true;
+    }
+}
+
+/* recomputes the world transform of a node whose own or parent's moved */
+static void scene__place(scene_node_t* node) {
+    if (node->parent != NULL)
+        vec_mat34_mul(&node->world, &node->parent->world, &node->local);
+    else
+        node->world = node->local;
+    if (node->mesh != NULL)
+        obj_mesh_set_transform(node->mesh, &node->world);
+}
+
+//----------------------------------------------------------------------------------------------------------
+// External functions
+//----------------------------------------------------------------------------------------------------------
+scene_node_t* scene_node_new(mesh_t* mesh) {
+    scene_node_t* new = malloc(sizeof(scene_node_t));
+    vec_mat34_identity(&new->local);
+    vec_mat34_identity(&new->world);
+    new->is_dirty = true;
+    new->is_queued = false;
+    new->parent = NULL;
+    new->n_children = 0;
+    new->n_dirty_children = 0;
+    new->n_visited = 0;
+    new->capacity = SCENE_INITIAL_CHILDREN;
+    new->children = malloc(sizeof(scene_node_t*) * new->capacity);
+    new->dirty_children = malloc(sizeof(scene_node_t*) * new->capacity);
+    new->mesh = mesh;
+    return new;
+}
+
+void scene_node_add_child(scene_node_t* parent, scene_node_t* child) {
+    assert(child->parent == NULL);
+    if (parent->n_children == parent->capacity) {
+        parent->capacity *= 2;
+        parent->children = realloc(parent->children, sizeof(scene_node_t*) * parent->capacity);
+        parent->dirty_children = realloc(parent->dirty_children, sizeof(scene_node_t*) * parent->capacity);
+    }
+    parent->children[parent->n_children++] = child;
+    child->parent = parent;
+    // its world transform now depends on the parent
+    child->is_dirty = true;
+    scene__mark_ancestors(child);
+}
+
+void scene_node_set_local(scene_node_t* node, float angle_x_rad, float angle_y_rad, float angle_z_rad,
+                          float tx, float ty, float tz) {
+    vec_mat34_from_euler(&node->local, angle_x_rad, angle_y_rad, angle_z_rad, tx, ty, tz);
+    node->is_dirty = true;
+    scene__mark_ancestors(node);
+}
+
+size_t scene_update(scene_node_t* root) {
+    size_t n_updated = 0;
+    if (root->is_dirty) {
+        scene__place(root);
+        n_updated++;
+    }
+    // depth first without recursion, so that any depth fits on any stack - the
+    // path back to the root is the stack and `n_visited` where each node is in it
+    scene_node_t* node = root;
+    for (;;) {
+        // a node that moved stays dirty until its children are done, so that they
+        // follow it - under one that didn't, only the queued children are visited
+        // and clean subtrees are skipped entirely
+        scene_node_t** next = (node->is_dirty) ? node->children : node->dirty_children;
+        const size_t n_next = (node->is_dirty) ? node->n_children : node->n_dirty_children;
+        if (node->n_visited < n_next) {
+            scene_node_t* child = next[node->n_visited++];
+            child->is_dirty |= node->is_dirty;
+            if (child->is_dirty) {
+                scene__place(child);
+                n_updated++;
+            }
+            node = child;
+            continue;
+        }
+        node->n_visited = 0;
+        node->n_dirty_children = 0;
+        node->is_queued = false;
+        node->is_dirty = false;
+        if (node == root)
+            return n_updated;
+        node = node->parent;
+    }
+}
+
+void scene_node_free(scene_node_t* node) {
+    // the last child first, from the bottom up, without recursion like the update
+    scene_node_t* const top = node->parent;
+    while (node != top) {
+        if (node->n_children > 0) {
+            node = node->children[--node->n_children];
+            continue;
+        }
+        scene_node_t* parent = node->parent;
+        free(node->children);
+        free(node->dirty_children);
+        free(node);
+        node = parent;
+    }
+}
@@ -2,61 +2,21 @@
 #include "screen.h"
 #include "objects.h"
 #include "utils.h"
+#include "sink.h"
 #include <sys/ioctl.h>
 #include <stdio.h>
 #include <unistd.h> // STDOUT_FILENO
 #include <stdlib.h> // exit
 #include <stdbool.h> // true/false 
-#include <string.h> // memset
+#include <string.h> // memset, memcpy
 #include <stddef.h> // size_t 
 
-#ifndef _WIN32
 #define IOCTL_SIZE_INVALID 0
-//----------------------------------------------------------------------------------
-// Linux POSIX terminal manipulation macros
-//----------------------------------------------------------------------------------
-#define SCREEN_CLEAR() printf("\033[H\033[J")
-#define SCREEN_GOTO_TOPLEFT() printf("\033[0;0H")
-#define SCREEN_HIDE_CURSOR() printf("\e[?25l")
-#define SCREEN_SHOW_CURSOR() printf("\e[?25h")
-#else
-//----------------------------------------------------------------------------------
-// Windows terminal manipulation macros
-//----------------------------------------------------------------------------------
-// Credits to @oogabooga:
-// https://cboard.cprogramming.com/c-programming/161186-undefined-reference.html
-#define SCREEN_CLEAR() do {                                  \
-    COORD top_left = {0, 0};                                 \
-    DWORD c_chars_written;                                   \
-    CONSOLE_SCREEN_BUFFER_INFO csbi;                         \
-    GetConsoleScreenBufferInfo(g_cons_out, &csbi);           \
-    DWORD dw_con_size = csbi.dwSize.X * csbi.dwSize.Y;       \
-    FillConsoleOutputCharacter(g_cons_out, ' ', dw_con_size, \
-            top_left, &c_chars_written);                     \
-    FillConsoleOutputAttribute(g_cons_out, csbi.wAttributes, \
-            dw_con_size, top_left, &c_chars_written);        \
-    SetConsoleCursorPosition(g_cons_out, top_left);          \
-} while(0)
-// Credits to @Jerry Coffin: https://stackoverflow.com/a/2732327
-#define SCREEN_GOTO_TOPLEFT() do {                           \
-    COORD pos = {0, 0};                                      \
-    HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);         \
-    SetConsoleCursorPosition(output, pos);                   \
-} while(0)
-#define SCREEN_HIDE_CURSOR() ;
-#define SCREEN_SHOW_CURSOR() ;
-#endif
-//----------------------------------------------------------------------------------
+// size to assume when stdout isn't a terminal, e.g. when frames are piped
+#define SCREEN_DEFAULT_ROWS 24
+#define SCREEN_DEFAULT_COLS 80
 
-// rows, columns of the terminal
-int g_rows;
-int g_cols;
-// columns over rows for the terminal 
-static float g_cols_over_rows;
-// screen resolution (pixels over pixels) 
-static float g_screen_res;
-color_t* g_screen_buffer;
-size_t g_buffer_size;
+screen_t g_screen;
 
 
 /**
@@ -64,19 +24,21 @@ size_t g_buffer_size;
  *            1.`ioctl` call - fails on some terminals
  *            2. (fallback) xrandr command
  *            3. (fallback) assume a common screen resolution, e.g. 1920/1080
- *        Writes to global variables `g_screen_res` and `g_cols_over_rows`,
- *        `g_rows`, `g_cols`, `g_min_rows`, `g_min_cols`, `g_max_rows`,
- *        `g_max_cols`
+ *        Writes to the `screen_res`, `cols_over_rows`, `rows` and `cols` of
+ *        the screen
  */
-static void draw__get_screen_info() {
+static void draw__get_screen_info(screen_t* screen) {
     //// 1st way - ioctl call
-    struct winsize wsize;
-    ioctl(STDOUT_FILENO, TIOCGWINSZ, &wsize);
-    g_rows = wsize.ws_row;
-    g_cols = wsize.ws_col;
-    g_cols_over_rows = (float)g_cols/g_rows;
+    struct winsize wsize = {0};
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &wsize) < 0) {
+        wsize.ws_row = SCREEN_DEFAULT_ROWS;
+        wsize.ws_col = SCREEN_DEFAULT_COLS;
+    }
+    screen->rows = wsize.ws_row;
+    screen->cols = wsize.ws_col;
+    screen->cols_over_rows = (float)screen->cols/screen->rows;
     if ((wsize.ws_xpixel != IOCTL_SIZE_INVALID) || (wsize.ws_ypixel != IOCTL_SIZE_INVALID)) {
-        g_screen_res = (float)wsize.ws_xpixel/wsize.ws_ypixel;
+        screen->screen_res = (float)wsize.ws_xpixel/wsize.ws_ypixel;
         return;
     }
 
@@ -93,36 +55,86 @@ static void draw__get_screen_info() {
     // parse the output - it should only be the resolution
     while (fgets(line, sizeof(line), fp) != NULL) {
         if (ut_is_decimal(line)) {
-            g_screen_res = atof(line);
+            screen->screen_res = atof(line);
             pclose(fp);
             return;
         }
     }
 #endif
     //// 3rd way - assume a common resolution
-    g_screen_res = 1920.0/1080.0;
+    screen->screen_res = 1920.0/1080.0;
 }
 
-void screen_init() {
-    SCREEN_HIDE_CURSOR();
-    SCREEN_CLEAR();
+static inline sink_rect_t screen__rect_full(screen_t* screen) {
+    return (sink_rect_t) {0, 0, screen->rows - 1, screen->cols - 1};
+}
+
+/* fills a rectangle of a buffer of the screen's size with spaces */
+static void screen__blank(screen_t* screen, color_t* buffer, sink_rect_t rect) {
+    for (int row = rect.row0; row <= rect.row1; ++row)
+        memset(&buffer[(size_t)row*screen->cols + rect.col0], ' ', sizeof(color_t) * (rect.col1 - rect.col0 + 1));
+}
+
+void screen_init_r(screen_t* screen) {
+    screen_init_sink_r(screen, 0, 0, sink_tty_new());
+}
+
+void screen_init_sink_r(screen_t* screen, int rows, int cols, sink_t* sink) {
     // get terminal's size info
-    draw__get_screen_info();
-    g_buffer_size = g_rows*g_cols;
-    g_screen_buffer = malloc(sizeof(color_t) * g_buffer_size);
+    draw__get_screen_info(screen);
+    if ((rows > 0) && (cols > 0)) {
+        screen->rows = rows;
+        screen->cols = cols;
+        screen->cols_over_rows = (float)cols/rows;
+    }
+    screen->buffer_size = screen->rows*screen->cols;
+    screen->buffer = malloc(sizeof(color_t) * screen->buffer_size);
+    screen->prev = malloc(sizeof(color_t) * screen->buffer_size);
+    screen->drawn_rows = malloc(sizeof(sink_span_t) * screen->rows);
+    screen->drawn_rows_prev = malloc(sizeof(sink_span_t) * screen->rows);
+    screen->damage_rows = malloc(sizeof(sink_span_t) * screen->rows);
+    for (int row = 0; row < screen->rows; ++row)
+        screen->drawn_rows_prev[row] = sink_span_empty();
+    screen_mark_drawn_r(screen);
+    screen_clear_r(screen);
+    screen__blank(screen, screen->prev, screen__rect_full(screen));
+    screen->drawn_prev = sink_rect_empty();
+    screen->sink = sink;
+    screen->is_offscreen = false;
 }
 
-size_t screen_xy2ind(int x, int y) {
-    x += g_cols/2;
-    y += g_rows;
-    const int y_scaled = round(y/(g_cols_over_rows/g_screen_res));
-    const int ind_buffer = round(y_scaled*g_cols + x);
-    if ((ind_buffer >= g_buffer_size) || (ind_buffer < 0))
+void screen_init_offscreen_r(screen_t* screen, int rows, int cols, float screen_res, color_t* buffer) {
+    screen->rows = rows;
+    screen->cols = cols;
+    screen->cols_over_rows = (float)cols/rows;
+    screen->screen_res = screen_res;
+    screen->buffer_size = rows*cols;
+    screen->buffer = buffer;
+    screen->prev = NULL;
+    screen->drawn_rows = screen->drawn_rows_prev = screen->damage_rows = NULL;
+    screen->sink = NULL;
+    screen->is_offscreen = true;
+    screen_mark_drawn_r(screen);
+    screen_clear_r(screen);
+    screen->drawn_prev = sink_rect_empty();
+}
+
+size_t screen_xy2ind_r(screen_t* screen, int x, int y) {
+    x += screen->cols/2;
+    y += screen->rows;
+    const int y_scaled = round(y/(screen->cols_over_rows/screen->screen_res));
+    const int ind_buffer = round(y_scaled*screen->cols + x);
+    if ((ind_buffer >= screen->buffer_size) || (ind_buffer < 0))
         return 0;
     return ind_buffer;
 }
 
-void screen_write_pixel(int x, int y, color_t c) {
+void screen_xy2cell_r(screen_t* screen, int x, int y, int* row, int* col) {
+    *col = x + screen->cols/2;
+    *row = round((y + screen->rows)/(screen->cols_over_rows/screen->screen_res));
+}
+
+void screen_write_pixel_r(screen_t* screen, int x, int y, color_t c) {
    /* Uses the following coordinate system:
     *
     *      ^ y
@@ -134,21 +146,103 @@ void screen_write_pixel(int x, int y, color_t c) {
     *        \
     *         v z
     */
-    size_t ind_buffer = screen_xy2ind(x, y);
-    g_screen_buffer[ind_buffer] = c;
+    size_t ind_buffer = screen_xy2ind_r(screen, x, y);
+    const int row = ind_buffer / screen->cols;
+    screen_write_cell_r(screen, row, ind_buffer - (size_t)row*screen->cols, c);
+}
+
+void screen_write_cell_r(screen_t* screen, int row, int col, color_t c) {
+    screen->buffer[(size_t)row*screen->cols + col] = c;
+    screen->drawn = sink_rect_union(screen->drawn, (sink_rect_t) {row, col, row, col});
+    if (screen->drawn_rows != NULL)
+        screen->drawn_rows[row] = sink_span_union(screen->drawn_rows[row], (sink_span_t) {col, col});
+}
+
+void screen_mark_drawn_r(screen_t* screen) {
+    screen->drawn = screen__rect_full(screen);
+    if (screen->drawn_rows != NULL)
+        for (int row = 0; row < screen->rows; ++row)
+            screen->drawn_rows[row] = (sink_span_t) {0, screen->cols - 1};
+}
+
+void screen_clear_r(screen_t* screen) {
+    if (screen->drawn_rows == NULL) {
+        screen__blank(screen, screen->buffer, screen->drawn);
+        screen->drawn = sink_rect_empty();
+        return;
+    }
+    for (int row = 0; row < screen->rows; ++row) {
+        const sink_span_t span = screen->drawn_rows[row];
+        if (span.col0 <= span.col1)
+            screen__blank(screen, screen->buffer, (sink_rect_t) {row, span.col0, row, span.col1});
+        screen->drawn_rows[row] = sink_span_empty();
+    }
+    screen->drawn = sink_rect_empty();
+}
+
+void screen_flush_r(screen_t* screen) {
+    if (screen->prev != NULL) {
+        // outside of both frames' drawings, both are blank - row by row, so
+        // that the space between two shapes isn't damaged
+        for (int row = 0; row < screen->rows; ++row) {
+            const sink_span_t span = sink_span_union(screen->drawn_rows[row], screen->drawn_rows_prev[row]);
+            screen->damage_rows[row] = span;
+            if (span.col0 <= span.col1) {
+                const size_t start = (size_t)row*screen->cols + span.col0;
+                memcpy(&screen->prev[start], &screen->buffer[start], sizeof(color_t) * (span.col1 - span.col0 + 1));
+            }
+        }
+        if (screen->sink != NULL)
+            sink_write_damaged_rows(screen->sink, screen->buffer, screen->rows, screen->cols, screen->damage_rows);
+        memcpy(screen->drawn_rows_prev, screen->drawn_rows, sizeof(sink_span_t) * screen->rows);
+    } else if (screen->sink != NULL) {
+        sink_write_damaged(screen->sink, screen->buffer, screen->rows, screen->cols,
+                           sink_rect_union(screen->drawn, screen->drawn_prev));
+    }
+    screen->drawn_prev = screen->drawn;
+    screen_clear_r(screen);
+}
+
+void screen_repeat_r(screen_t* screen) {
+    if ((screen->sink != NULL) && (screen->prev != NULL))
+        sink_write_damaged(screen->sink, screen->prev, screen->rows, screen->cols, sink_rect_empty());
+}
+
+void screen_end_r(screen_t* screen) {
+    if (screen->is_offscreen)
+        return;
+    free(screen->buffer);
+    screen->buffer = NULL;
+    free(screen->prev);
+    screen->prev = NULL;
+    free(screen->drawn_rows);
+    free(screen->drawn_rows_prev);
+    free(screen->damage_rows);
+    screen->drawn_rows = screen->drawn_rows_prev = screen->damage_rows = NULL;
+    sink_free(screen->sink);
+    screen->sink = NULL;
+}
+
+size_t screen_xy2ind(int x, int y) {
+    return screen_xy2ind_r(&g_screen, x, y);
+}
+
+void screen_init() {
+    screen_init_r(&g_screen);
+}
+
+void screen_write_pixel(int x, int y, color_t c) {
+    screen_write_pixel_r(&g_screen, x, y, c);
 }
 
 void screen_flush() {
-    // render the screen buffer
-    for (size_t i = 0; i < g_buffer_size; ++i)
-        putchar(g_screen_buffer[i]);
-    memset(g_screen_buffer, ' ', sizeof(color_t) * g_buffer_size);
-    SCREEN_GOTO_TOPLEFT();
+    screen_flush_r(&g_screen);
 }
 
-void screen_end() {
-    free(g_screen_buffer);
-    SCREEN_CLEAR();
-    SCREEN_SHOW_CURSOR();
+void screen_repeat() {
+    screen_repeat_r(&g_screen);
 }
 
+void screen_end() {
+    screen_end_r(&g_screen);
+}
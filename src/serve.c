@@ -0,0 +1,437 @@
+#include "serve.h"
+#include "sink.h"
+#include "objects.h" // color_t
+#include "utils.h" // ut_secs_since
+#include <sys/socket.h> // socket, bind, listen, accept, send, recv
+#include <sys/un.h> // sockaddr_un
+#include <sys/epoll.h> // epoll_create1, epoll_ctl, epoll_wait
+#include <sys/stat.h> // stat, S_ISSOCK
+#include <netinet/in.h> // sockaddr_in, INADDR_LOOPBACK
+#include <arpa/inet.h> // htons, htonl
+#include <fcntl.h> // fcntl, O_NONBLOCK
+#include <unistd.h> // close, unlink
+#include <errno.h> // errno, EAGAIN
+#include <stdio.h> // fprintf, sprintf
+#include <stdlib.h> // malloc, realloc, free, strtoul
+#include <string.h> // memcpy, strlen, strcpy, strncmp
+#include <stdbool.h> // bool
+#include <stddef.h> // size_t
+#include <time.h> // clock_gettime
+
+// longest cursor move, "\033[<row>;<col>H"
+#define SERVE_MAX_MOVE_LEN 16
+// hides the cursor, clears the terminal and homes the cursor
+#define SERVE_KEY_PREFIX "\033[?25l\033[H\033[J"
+// what well-behaved clients get when the server goes away
+#define SERVE_BYE "\033[H\033[J\033[?25h"
+
+/* an encoded frame, shared by the queues of all clients it's sent to */
+typedef struct serve_frame {
+    // one per queue holding it, plus one while it's being fanned out
+    int refs;
+    size_t size;
+    size_t capacity;
+    // next unused frame in the server's pool
+    struct serve_frame* next_free;
+    char data[];
+} serve_frame_t;
+
+typedef struct serve_client {
+    int fd;
+    // where it is in the server's array of clients
+    size_t index;
+    // frames waiting to be sent, the first one already sent up to `offset`
+    serve_frame_t* queue[SERVE_QUEUE_LEN];
+    size_t head;
+    size_t n_queued;
+    size_t offset;
+    // set while its socket is full, until epoll says it's writable again
+    bool is_blocked;
+    // its next frame must be a keyframe
+    bool needs_key;
+} serve_client_t;
+
+typedef struct serve_server {
+    int listen_fd;
+    int epoll_fd;
+    // socket file to remove at the end, NULL for TCP
+    char* path;
+    serve_client_t** clients;
+    size_t n_clients;
+    size_t clients_capacity;
+    // the previous frame, which deltas are encoded against
+    color_t* prev;
+    int rows;
+    int cols;
+    // frames nobody holds, reused rather than freed
+    serve_frame_t* free_frames;
+    size_t frame_capacity;
+    // statistics reported at the end
+    size_t n_frames;
+    size_t n_deltas;
+    size_t n_keys;
+    size_t n_resyncs;
+    size_t n_connected;
+    size_t n_clients_max;
+    size_t n_bytes;
+    double serve_secs;
+} serve_server_t;
+
+//----------------------------------------------------------------------------------
+// Static functions
+//----------------------------------------------------------------------------------
+static inline bool serve__set_nonblocking(int fd) {
+    const int flags = fcntl(fd, F_GETFL, 0);
+    return (flags >= 0) && (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0);
+}
+
+static serve_frame_t* serve__frame_get(serve_server_t* server) {
+    serve_frame_t* frame = server->free_frames;
+    if (frame != NULL) {
+        server->free_frames = frame->next_free;
+    } else {
+        frame = malloc(sizeof(serve_frame_t) + server->frame_capacity);
+        frame->capacity = server->frame_capacity;
+    }
+    frame->refs = 1;
+    frame->size = 0;
+    return frame;
+}
+
+static void serve__frame_unref(serve_server_t* server, serve_frame_t* frame) {
+    if (--frame->refs > 0)
+        return;
+    // frames of an older screen size are too small to reuse
+    if (frame->capacity == server->frame_capacity) {
+        frame->next_free = server->free_frames;
+        server->free_frames = frame;
+    } else {
+        free(frame);
+    }
+}
+
+static void serve__free_pool(serve_server_t* server) {
+    while (server->free_frames != NULL) {
+        serve_frame_t* next = server->free_frames->next_free;
+        free(server->free_frames);
+        server->free_frames = next;
+    }
+}
+
+/**
+ * @brief Encodes a frame as terminal escape codes
+ *
+ * @param server Server holding the previous frame
+ * @param dest   Frame buffer to encode into
+ * @param frame  Frame to encode
+ * @param is_key Whether to draw the whole frame, otherwise only what changed
+ */
+static void serve__encode(serve_server_t* server, serve_frame_t* dest, const color_t* frame, bool is_key) {
+    char* end = dest->data;
+    if (is_key) {
+        memcpy(end, SERVE_KEY_PREFIX, strlen(SERVE_KEY_PREFIX));
+        end += strlen(SERVE_KEY_PREFIX);
+    }
+    for (int row = 0; row < server->rows; ++row) {
+        const color_t* curr = &frame[(size_t)row*server->cols];
+        const color_t* prev = (is_key) ? NULL : &server->prev[(size_t)row*server->cols];
+        int col = 0;
+        for (int start; (start = sink_next_run(curr, prev, server->cols, &col)) < server->cols;) {
+            end += sprintf(end, "\033[%d;%dH", row + 1, start + 1);
+            memcpy(end, &curr[start], col - start);
+            end += col - start;
+        }
+    }
+    dest->size = end - dest->data;
+}
+
+static void serve__client_push(serve_client_t* client, serve_frame_t* frame) {
+    frame->refs++;
+    client->queue[(client->head + client->n_queued) % SERVE_QUEUE_LEN] = frame;
+    client->n_queued++;
+}
+
+static void serve__client_pop(serve_server_t* server, serve_client_t* client) {
+    serve__frame_unref(server, client->queue[client->head]);
+    client->head = (client->head + 1) % SERVE_QUEUE_LEN;
+    client->n_queued--;
+    client->offset = 0;
+}
+
+/* removes a client that hung up or failed, the last one takes its place */
+static void serve__client_drop(serve_server_t* server, size_t iclient) {
+    serve_client_t* client = server->clients[iclient];
+    while (client->n_queued > 0)
+        serve__client_pop(server, client);
+    // closing it removes it from epoll too
+    close(client->fd);
+    free(client);
+    if (iclient < --server->n_clients) {
+        server->clients[iclient] = server->clients[server->n_clients];
+        server->clients[iclient]->index = iclient;
+    }
+}
+
+static void serve__client_watch(serve_server_t* server, serve_client_t* client, bool is_blocked) {
+    struct epoll_event event = {.events = EPOLLIN | ((is_blocked) ? EPOLLOUT : 0), .data.ptr = client};
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+    client->is_blocked = is_blocked;
+}
+
+/**
+ * @brief Sends a client as much of its queue as its socket takes without
+ *        blocking
+ *
+ * @return false if the client is gone
+ */
+static bool serve__client_flush(serve_server_t* server, serve_client_t* client) {
+    while (client->n_queued > 0) {
+        const serve_frame_t* frame = client->queue[client->head];
+        const ssize_t n_sent = send(client->fd, frame->data + client->offset, frame->size - client->offset,
+                                    MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n_sent < 0) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                return false;
+            // wait for epoll to tell it's writable
+            if (!client->is_blocked)
+                serve__client_watch(server, client, true);
+            return true;
+        }
+        server->n_bytes += n_sent;
+        client->offset += n_sent;
+        if (client->offset == frame->size)
+            serve__client_pop(server, client);
+    }
+    if (client->is_blocked)
+        serve__client_watch(server, client, false);
+    return true;
+}
+
+/**
+ * @brief Queues the latest frame for a client. A client that needs a
+ *        keyframe, or is too far behind, drops the frames it hasn't started
+ *        reading and gets the keyframe instead of the delta.
+ */
+static void serve__client_enqueue(serve_server_t* server, serve_client_t* client,
+                                  serve_frame_t* delta, serve_frame_t* key) {
+    if (!client->needs_key && (delta->size == 0))
+        return;
+    if (client->needs_key || (client->n_queued == SERVE_QUEUE_LEN)) {
+        if (!client->needs_key)
+            server->n_resyncs++;
+        // a frame it's halfway through is finished, so its escape codes stay whole
+        const size_t n_kept = (client->offset > 0) ? 1 : 0;
+        while (client->n_queued > n_kept) {
+            client->n_queued--;
+            serve__frame_unref(server, client->queue[(client->head + client->n_queued) % SERVE_QUEUE_LEN]);
+        }
+        serve__client_push(client, key);
+        client->needs_key = false;
+    } else {
+        serve__client_push(client, delta);
+    }
+}
+
+static void serve__accept(serve_server_t* server) {
+    for (;;) {
+        const int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0)
+            return;
+        if (!serve__set_nonblocking(fd)) {
+            close(fd);
+            continue;
+        }
+        serve_client_t* client = malloc(sizeof(serve_client_t));
+        client->fd = fd;
+        client->head = 0;
+        client->n_queued = 0;
+        client->offset = 0;
+        client->is_blocked = false;
+        client->needs_key = true;
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = client};
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            close(fd);
+            free(client);
+            continue;
+        }
+        if (server->n_clients == server->clients_capacity) {
+            server->clients_capacity = (server->clients_capacity == 0) ? 16 : 2*server->clients_capacity;
+            server->clients = realloc(server->clients, sizeof(serve_client_t*) * server->clients_capacity);
+        }
+        client->index = server->n_clients;
+        server->clients[server->n_clients++] = client;
+        server->n_connected++;
+        if (server->n_clients > server->n_clients_max)
+            server->n_clients_max = server->n_clients;
+    }
+}
+
+/* handles what happened on the sockets since the last frame, without waiting */
+static void serve__poll(serve_server_t* server) {
+    struct epoll_event events[SERVE_MAX_EVENTS];
+    int n_events;
+    do {
+        n_events = epoll_wait(server->epoll_fd, events, SERVE_MAX_EVENTS, 0);
+        for (int i = 0; i < n_events; ++i) {
+            serve_client_t* client = events[i].data.ptr;
+            if (client == NULL) {
+                serve__accept(server);
+                continue;
+            }
+            bool is_gone = (events[i].events & (EPOLLHUP | EPOLLERR)) != 0;
+            if (!is_gone && (events[i].events & EPOLLIN)) {
+                // clients have nothing to say - read it to notice when they hang up
+                char discard[256];
+                const ssize_t n_read = recv(client->fd, discard, sizeof(discard), MSG_DONTWAIT);
+                is_gone = (n_read == 0) || ((n_read < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK));
+            }
+            if (!is_gone && (events[i].events & EPOLLOUT))
+                is_gone = !serve__client_flush(server, client);
+            if (is_gone)
+                serve__client_drop(server, client->index);
+        }
+    } while (n_events == SERVE_MAX_EVENTS);
+}
+
+static void serve__sink_write(sink_t* sink, const color_t* frame, int rows, int cols) {
+    serve_server_t* server = sink->state;
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    serve__poll(server);
+    // a new screen size, starting with the first, sizes the buffers and everyone resyncs
+    const bool is_resized = (rows != server->rows) || (cols != server->cols);
+    if (is_resized) {
+        free(server->prev);
+        serve__free_pool(server);
+        server->rows = rows;
+        server->cols = cols;
+        server->prev = malloc(sizeof(color_t) * rows * cols);
+        // at most a cursor move per changed character and one to start each row
+        server->frame_capacity = strlen(SERVE_KEY_PREFIX) +
+                                 (size_t)rows*(cols + SERVE_MAX_MOVE_LEN*(cols/(SINK_MERGE_GAP + 1) + 1));
+        for (size_t i = 0; i < server->n_clients; ++i)
+            server->clients[i]->needs_key = true;
+    }
+    // encode once for everyone - the keyframe only if someone needs it
+    serve_frame_t* delta = serve__frame_get(server);
+    serve_frame_t* key = NULL;
+    bool is_key_needed = false;
+    for (size_t i = 0; (i < server->n_clients) && !is_key_needed; ++i)
+        is_key_needed = server->clients[i]->needs_key || (server->clients[i]->n_queued == SERVE_QUEUE_LEN);
+    if (!is_resized) {
+        serve__encode(server, delta, frame, false);
+        server->n_deltas += (delta->size > 0);
+    }
+    if (is_key_needed) {
+        key = serve__frame_get(server);
+        serve__encode(server, key, frame, true);
+        server->n_keys++;
+    }
+    // backwards, so that dropping a client moves one that's already done
+    for (size_t i = server->n_clients; i-- > 0;) {
+        serve_client_t* client = server->clients[i];
+        serve__client_enqueue(server, client, delta, key);
+        if (!client->is_blocked && !serve__client_flush(server, client))
+            serve__client_drop(server, i);
+    }
+    serve__frame_unref(server, delta);
+    if (key != NULL)
+        serve__frame_unref(server, key);
+    memcpy(server->prev, frame, sizeof(color_t) * rows * cols);
+    server->n_frames++;
+    server->serve_secs += ut_secs_since(&t0);
+}
+
+static void serve__sink_close(sink_t* sink) {
+    serve_server_t* server = sink->state;
+    while (server->n_clients > 0) {
+        serve_client_t* client = server->clients[server->n_clients - 1];
+        // restore the terminals of clients that aren't in the middle of a frame
+        if (client->offset == 0)
+            send(client->fd, SERVE_BYE, strlen(SERVE_BYE), MSG_NOSIGNAL | MSG_DONTWAIT);
+        serve__client_drop(server, server->n_clients - 1);
+    }
+    close(server->epoll_fd);
+    close(server->listen_fd);
+    if (server->path != NULL)
+        unlink(server->path);
+    if (server->n_frames > 0)
+        fprintf(stderr, "served %zu frames as %zu deltas and %zu keyframes (%zu resyncs) to %zu clients, "
+                "at most %zu at once, %zu bytes, %.1f us/frame to encode and send\n",
+                server->n_frames, server->n_deltas, server->n_keys, server->n_resyncs, server->n_connected,
+                server->n_clients_max, server->n_bytes, 1e6*server->serve_secs/server->n_frames);
+    serve__free_pool(server);
+    free(server->clients);
+    free(server->prev);
+    free(server->path);
+    free(server);
+}
+
+/* creates a listening socket for a path or "tcp:<port>", -1 on failure */
+static int serve__listen(const char* address) {
+    int fd;
+    if (strncmp(address, "tcp:", 4) == 0) {
+        char* end;
+        const unsigned long port = strtoul(address + 4, &end, 10);
+        if ((address[4] == '\0') || (*end != '\0') || (port > 65535))
+            return -1;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        const int yes = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port),
+                                   .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+        if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+    } else {
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        if (strlen(address) >= sizeof(addr.sun_path))
+            return -1;
+        strcpy(addr.sun_path, address);
+        // replace the socket of a server that didn't exit cleanly, but nothing else
+        struct stat st;
+        if ((stat(address, &st) == 0) && S_ISSOCK(st.st_mode))
+            unlink(address);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    if ((listen(fd, SOMAXCONN) < 0) || !serve__set_nonblocking(fd)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+//----------------------------------------------------------------------------------
+// External functions
+//----------------------------------------------------------------------------------
+sink_t* serve_sink_new(const char* address) {
+    const int listen_fd = serve__listen(address);
+    if (listen_fd < 0)
+        return NULL;
+    const int epoll_fd = epoll_create1(0);
+    // the listening socket is the only one without a client
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    if ((epoll_fd < 0) || (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) < 0)) {
+        if (epoll_fd >= 0)
+            close(epoll_fd);
+        close(listen_fd);
+        return NULL;
+    }
+    serve_server_t* server = calloc(1, sizeof(serve_server_t));
+    server->listen_fd = listen_fd;
+    server->epoll_fd = epoll_fd;
+    if (strncmp(address, "tcp:", 4) != 0) {
+        server->path = malloc(strlen(address) + 1);
+        strcpy(server->path, address);
+    }
+    return sink_new(serve__sink_write, serve__sink_close, server);
+}
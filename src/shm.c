@@ -0,0 +1,191 @@
+#include "shm.h"
+#include "sink.h"
+#include "objects.h" // color_t
+#include <sys/mman.h> // shm_open, mmap, munmap, shm_unlink
+#include <sys/stat.h> // fstat, struct stat
+#include <fcntl.h> // O_* constants
+#include <unistd.h> // ftruncate, close
+#include <stdlib.h> // malloc, free
+#include <string.h> // memcpy, strlen, strcpy
+#include <stdint.h> // uint64_t
+#include <stdbool.h> // bool
+#include <stddef.h> // size_t
+
+typedef struct shm_writer {
+    char* name;
+    int fd;
+    // the mapped segment, NULL until the first frame sizes it
+    unsigned char* segment;
+    size_t size;
+    shm_header_t* header;
+    size_t n_slots;
+    size_t slot_size;
+    uint64_t seq;
+} shm_writer_t;
+
+//----------------------------------------------------------------------------------
+// Static functions
+//----------------------------------------------------------------------------------
+static inline size_t shm__aligned_size(size_t size) {
+    return (size + SHM_ALIGNMENT - 1) / SHM_ALIGNMENT * SHM_ALIGNMENT;
+}
+
+static inline shm_slot_t* shm__slot(unsigned char* segment, size_t slot_size, size_t islot) {
+    return (shm_slot_t*) (segment + sizeof(shm_header_t) + islot*slot_size);
+}
+
+/* sizes and maps the segment for frames of `rows*cols` characters */
+static bool shm__map(shm_writer_t* writer, int rows, int cols) {
+    writer->slot_size = sizeof(shm_slot_t) + shm__aligned_size((size_t)rows*cols*sizeof(color_t));
+    writer->size = sizeof(shm_header_t) + writer->n_slots*writer->slot_size;
+    if (ftruncate(writer->fd, writer->size) < 0)
+        return false;
+    writer->segment = mmap(NULL, writer->size, PROT_READ | PROT_WRITE, MAP_SHARED, writer->fd, 0);
+    if (writer->segment == MAP_FAILED) {
+        writer->segment = NULL;
+        return false;
+    }
+    // it's new, so all slots are unlocked and empty
+    shm_header_t* header = (shm_header_t*) writer->segment;
+    header->version = SHM_VERSION;
+    header->rows = rows;
+    header->cols = cols;
+    header->n_slots = writer->n_slots;
+    header->slot_size = writer->slot_size;
+    header->seq = 0;
+    header->is_closed = 0;
+    // readers only look at a header with the magic number
+    __atomic_store_n(&header->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+    writer->header = header;
+    return true;
+}
+
+static void shm__sink_write(sink_t* sink, const color_t* frame, int rows, int cols) {
+    shm_writer_t* writer = sink->state;
+    if ((writer->segment == NULL) && !shm__map(writer, rows, cols))
+        return;
+    if ((rows != writer->header->rows) || (cols != writer->header->cols))
+        return;
+    const uint64_t seq = ++writer->seq;
+    shm_slot_t* slot = shm__slot(writer->segment, writer->slot_size, seq % writer->n_slots);
+    // odd lock while writing, the fence keeps the frame's stores after it
+    const uint64_t lock = slot->lock;
+    __atomic_store_n(&slot->lock, lock + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(slot + 1, frame, sizeof(color_t) * rows * cols);
+    slot->seq = seq;
+    __atomic_store_n(&slot->lock, lock + 2, __ATOMIC_RELEASE);
+    // publish it as the latest frame
+    __atomic_store_n(&writer->header->seq, seq, __ATOMIC_RELEASE);
+}
+
+static void shm__sink_close(sink_t* sink) {
+    shm_writer_t* writer = sink->state;
+    if (writer->segment != NULL) {
+        __atomic_store_n(&writer->header->is_closed, 1, __ATOMIC_RELEASE);
+        munmap(writer->segment, writer->size);
+    }
+    close(writer->fd);
+    // readers that mapped it keep their mapping
+    shm_unlink(writer->name);
+    free(writer->name);
+    free(writer);
+}
+
+//----------------------------------------------------------------------------------
+// External functions
+//----------------------------------------------------------------------------------
+sink_t* shm_sink_new(const char* name, size_t n_slots) {
+    if (n_slots == 0)
+        return NULL;
+    // a writer that didn't exit cleanly left its segment behind - truncating
+    // it would kill the readers still mapping it with SIGBUS, so unlink it and
+    // create another, which they notice with `shm_reader_is_replaced`
+    shm_unlink(name);
+    const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+        return NULL;
+    shm_writer_t* writer = malloc(sizeof(shm_writer_t));
+    // not strdup, so that the allocation is counted with ALLOC_STATS like the rest
+    writer->name = malloc(strlen(name) + 1);
+    strcpy(writer->name, name);
+    writer->fd = fd;
+    writer->segment = NULL;
+    writer->size = 0;
+    writer->header = NULL;
+    writer->n_slots = n_slots;
+    writer->slot_size = 0;
+    writer->seq = 0;
+    return sink_new(shm__sink_write, shm__sink_close, writer);
+}
+
+shm_reader_t* shm_reader_open(const char* name) {
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if ((fstat(fd, &st) < 0) || (st.st_size < (off_t)sizeof(shm_header_t))) {
+        close(fd);
+        return NULL;
+    }
+    void* segment = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (segment == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    const shm_header_t* header = segment;
+    if ((__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC) || (header->version != SHM_VERSION)) {
+        munmap(segment, st.st_size);
+        close(fd);
+        return NULL;
+    }
+    shm_reader_t* reader = malloc(sizeof(shm_reader_t));
+    reader->name = malloc(strlen(name) + 1);
+    strcpy(reader->name, name);
+    reader->fd = fd;
+    reader->size = st.st_size;
+    reader->dev = st.st_dev;
+    reader->ino = st.st_ino;
+    reader->header = header;
+    return reader;
+}
+
+bool shm_reader_is_replaced(shm_reader_t* reader) {
+    const int fd = shm_open(reader->name, O_RDONLY, 0);
+    // gone, or not created again yet
+    if (fd < 0)
+        return false;
+    struct stat st;
+    const bool is_replaced = (fstat(fd, &st) == 0) && ((st.st_dev != reader->dev) || (st.st_ino != reader->ino));
+    close(fd);
+    return is_replaced;
+}
+
+bool shm_read_begin(shm_reader_t* reader, shm_read_t* read) {
+    const shm_header_t* header = reader->header;
+    const uint64_t seq = __atomic_load_n(&header->seq, __ATOMIC_ACQUIRE);
+    if (seq == 0)
+        return false;
+    const shm_slot_t* slot = shm__slot((unsigned char*) header, header->slot_size, seq % header->n_slots);
+    const uint64_t lock = __atomic_load_n(&slot->lock, __ATOMIC_ACQUIRE);
+    if (lock & 1)
+        return false;
+    read->slot = slot;
+    read->lock = lock;
+    read->seq = slot->seq;
+    read->frame = (const color_t*) (slot + 1);
+    return true;
+}
+
+bool shm_read_end(shm_reader_t* reader, const shm_read_t* read) {
+    // keep the frame's loads before checking the lock again
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&read->slot->lock, __ATOMIC_RELAXED) == read->lock;
+}
+
+void shm_reader_close(shm_reader_t* reader) {
+    munmap((void*) reader->header, reader->size);
+    close(reader->fd);
+    free(reader->name);
+    free(reader);
+}
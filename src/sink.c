@@ -0,0 +1,318 @@
+#include "sink.h"
+#include "objects.h" // color_t
+#include "cast.h" // cast_sink_new
+#include "shm.h" // shm_sink_new
+#include "serve.h" // serve_sink_new
+#include <stdio.h> // FILE, fopen, fwrite
+#include <stdlib.h> // malloc, free, strtoul
+#include <string.h> // strcmp, strncmp, memcpy
+#include <stdbool.h> // bool
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+
+#ifndef _WIN32
+//----------------------------------------------------------------------------------
+// Linux POSIX terminal manipulation macros
+//----------------------------------------------------------------------------------
+#define SCREEN_CLEAR() printf("\033[H\033[J")
+#define SCREEN_GOTO_TOPLEFT() printf("\033[0;0H")
+#define SCREEN_GOTO(row, col) printf("\033[%d;%dH", (row) + 1, (col) + 1)
+#define SCREEN_HIDE_CURSOR() printf("\e[?25l")
+#define SCREEN_SHOW_CURSOR() printf("\e[?25h")
+#else
+//----------------------------------------------------------------------------------
+// Windows terminal manipulation macros
+//----------------------------------------------------------------------------------
+// Credits to @oogabooga:
+// https://cboard.cprogramming.com/c-programming/161186-undefined-reference.html
+#define SCREEN_CLEAR() do {                                  \
+    COORD top_left = {0, 0};                                 \
+    DWORD c_chars_written;                                   \
+    CONSOLE_SCREEN_BUFFER_INFO csbi;                         \
+    GetConsoleScreenBufferInfo(g_cons_out, &csbi);           \
+    DWORD dw_con_size = csbi.dwSize.X * csbi.dwSize.Y;       \
+    FillConsoleOutputCharacter(g_cons_out, ' ', dw_con_size, \
+            top_left, &c_chars_written);                     \
+    FillConsoleOutputAttribute(g_cons_out, csbi.wAttributes, \
+            dw_con_size, top_left, &c_chars_written);        \
+    SetConsoleCursorPosition(g_cons_out, top_left);          \
+} while(0)
+// Credits to @Jerry Coffin: https://stackoverflow.com/a/2732327
+#define SCREEN_GOTO_TOPLEFT() do {                           \
+    COORD pos = {0, 0};                                      \
+    HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);         \
+    SetConsoleCursorPosition(output, pos);                   \
+} while(0)
+#define SCREEN_GOTO(row, col) do {                           \
+    COORD pos = {(col), (row)};                              \
+    HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);         \
+    SetConsoleCursorPosition(output, pos);                   \
+} while(0)
+#define SCREEN_HIDE_CURSOR() ;
+#define SCREEN_SHOW_CURSOR() ;
+#endif
+//----------------------------------------------------------------------------------
+
+typedef struct sink_tty {
+    // of the frame on the terminal, to skip writing it again
+    uint64_t hash;
+    int rows;
+    int cols;
+} sink_tty_t;
+
+typedef struct sink_raw {
+    FILE* file;
+    bool is_stdout;
+} sink_raw_t;
+
+typedef struct sink_ring {
+    // `capacity` frames of `frame_size` characters, oldest overwritten first
+    color_t* frames;
+    size_t capacity;
+    size_t frame_size;
+    // frames written so far
+    size_t n_written;
+} sink_ring_t;
+
+//----------------------------------------------------------------------------------
+// Static functions
+//----------------------------------------------------------------------------------
+/* FNV-1a, 8 bytes at a time - frames are hashed, not kept, to tell them apart */
+static uint64_t sink__hash(const color_t* frame, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, &frame[i], sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 32;
+    }
+    for (; i < size; ++i)
+        hash = (hash ^ (unsigned char) frame[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+static void sink__tty_write(sink_t* sink, const color_t* frame, int rows, int cols) {
+    sink_tty_t* tty = sink->state;
+    // the terminal already shows it, so an idle scene costs no syscalls
+    const uint64_t hash = sink__hash(frame, (size_t)rows*cols);
+    if ((hash == tty->hash) && (rows == tty->rows) && (cols == tty->cols))
+        return;
+    const sink_rect_t* damage = &sink->damage;
+    if ((rows != tty->rows) || (cols != tty->cols)) {
+        fwrite(frame, sizeof(color_t), (size_t)rows*cols, stdout);
+    } else {
+        // only rewrite the damaged part of each row, the rest is on the terminal -
+        // the cursor is at the top left between frames and wraps after a whole
+        // row, so it's moved only where a row doesn't go on from the last one
+        int cursor_row = 0, cursor_col = 0;
+        for (int row = damage->row0; row <= damage->row1; ++row) {
+            const sink_span_t span = (sink->damage_rows != NULL) ? sink->damage_rows[row]
+                                                                  : (sink_span_t) {damage->col0, damage->col1};
+            if (span.col0 > span.col1)
+                continue;
+            if ((row != cursor_row) || (span.col0 != cursor_col))
+                SCREEN_GOTO(row, span.col0);
+            fwrite(&frame[(size_t)row*cols + span.col0], sizeof(color_t), span.col1 - span.col0 + 1, stdout);
+            cursor_row = (span.col1 == cols - 1) ? row + 1 : row;
+            cursor_col = (span.col1 == cols - 1) ? 0 : span.col1 + 1;
+        }
+    }
+    tty->hash = hash;
+    tty->rows = rows;
+    tty->cols = cols;
+    SCREEN_GOTO_TOPLEFT();
+}
+
+static void sink__tty_close(sink_t* sink) {
+    SCREEN_CLEAR();
+    SCREEN_SHOW_CURSOR();
+    // before anything else is reported on stderr, or clearing erases it
+    fflush(stdout);
+    free(sink->state);
+}
+
+static void sink__raw_write(sink_t* sink, const color_t* frame, int rows, int cols) {
+    sink_raw_t* raw = sink->state;
+    fwrite(frame, sizeof(color_t), (size_t)rows*cols, raw->file);
+}
+
+static void sink__raw_close(sink_t* sink) {
+    sink_raw_t* raw = sink->state;
+    if (raw->is_stdout)
+        fflush(raw->file);
+    else
+        fclose(raw->file);
+    free(raw);
+}
+
+static void sink__ring_write(sink_t* sink, const color_t* frame, int rows, int cols) {
+    sink_ring_t* ring = sink->state;
+    const size_t frame_size = (size_t)rows*cols;
+    // the first frame sizes the ring, a resized screen starts it over
+    if (frame_size != ring->frame_size) {
+        free(ring->frames);
+        ring->frames = malloc(sizeof(color_t) * ring->capacity * frame_size);
+        ring->frame_size = frame_size;
+        ring->n_written = 0;
+    }
+    memcpy(&ring->frames[(ring->n_written % ring->capacity) * frame_size], frame, sizeof(color_t) * frame_size);
+    ring->n_written++;
+}
+
+static void sink__ring_close(sink_t* sink) {
+    sink_ring_t* ring = sink->state;
+    free(ring->frames);
+    free(ring);
+}
+
+static void sink__null_write(sink_t* sink, const color_t* frame, int rows, int cols) {
+}
+
+static void sink__null_close(sink_t* sink) {
+}
+
+//----------------------------------------------------------------------------------
+// External functions
+//----------------------------------------------------------------------------------
+sink_t* sink_new(void (*write)(sink_t*, const color_t*, int, int), void (*close)(sink_t*), void* state) {
+    sink_t* new = malloc(sizeof(sink_t));
+    new->write = write;
+    new->close = close;
+    new->state = state;
+    return new;
+}
+
+sink_t* sink_tty_new() {
+    SCREEN_HIDE_CURSOR();
+    SCREEN_CLEAR();
+    sink_tty_t* tty = malloc(sizeof(sink_tty_t));
+    // no frame has that size, so the first one is always written
+    tty->hash = 0;
+    tty->rows = 0;
+    tty->cols = 0;
+    return sink_new(sink__tty_write, sink__tty_close, tty);
+}
+
+sink_t* sink_raw_new(const char* path) {
+    const bool is_stdout = (strcmp(path, "-") == 0);
+    FILE* file = (is_stdout) ? stdout : fopen(path, "wb");
+    if (file == NULL)
+        return NULL;
+    sink_raw_t* raw = malloc(sizeof(sink_raw_t));
+    raw->file = file;
+    raw->is_stdout = is_stdout;
+    return sink_new(sink__raw_write, sink__raw_close, raw);
+}
+
+sink_t* sink_ring_new(size_t n_frames) {
+    sink_ring_t* ring = malloc(sizeof(sink_ring_t));
+    ring->frames = NULL;
+    ring->capacity = n_frames;
+    ring->frame_size = 0;
+    ring->n_written = 0;
+    return sink_new(sink__ring_write, sink__ring_close, ring);
+}
+
+sink_t* sink_null_new() {
+    return sink_new(sink__null_write, sink__null_close, NULL);
+}
+
+sink_t* sink_from_spec(const char* spec) {
+    if (strcmp(spec, "tty") == 0)
+        return sink_tty_new();
+    if (strcmp(spec, "null") == 0)
+        return sink_null_new();
+    if ((strncmp(spec, "raw:", 4) == 0) && (spec[4] != '\0'))
+        return sink_raw_new(spec + 4);
+    if ((strncmp(spec, "rec:", 4) == 0) && (spec[4] != '\0'))
+        return cast_sink_new(spec + 4);
+    if ((strncmp(spec, "serve:", 6) == 0) && (spec[6] != '\0'))
+        return serve_sink_new(spec + 6);
+    if ((strncmp(spec, "shm:", 4) == 0) && (spec[4] != '\0')) {
+        // shm:<name>[:<n_slots>]
+        char name[256];
+        strncpy(name, spec + 4, sizeof(name) - 1);
+        name[sizeof(name) - 1] = '\0';
+        size_t n_slots = SHM_DEFAULT_SLOTS;
+        char* colon = strrchr(name, ':');
+        if (colon != NULL) {
+            char* end;
+            n_slots = strtoul(colon + 1, &end, 10);
+            if (*end != '\0')
+                return NULL;
+            *colon = '\0';
+        }
+        return shm_sink_new(name, n_slots);
+    }
+    if (strncmp(spec, "ring:", 5) == 0) {
+        char* end;
+        const unsigned long n_frames = strtoul(spec + 5, &end, 10);
+        if ((n_frames == 0) || (*end != '\0'))
+            return NULL;
+        return sink_ring_new(n_frames);
+    }
+    return NULL;
+}
+
+void sink_write(sink_t* sink, const color_t* frame, int rows, int cols) {
+    sink_write_damaged(sink, frame, rows, cols, (sink_rect_t) {0, 0, rows - 1, cols - 1});
+}
+
+void sink_write_damaged(sink_t* sink, const color_t* frame, int rows, int cols, sink_rect_t damage) {
+    sink->damage = damage;
+    sink->damage_rows = NULL;
+    sink->write(sink, frame, rows, cols);
+}
+
+void sink_write_damaged_rows(sink_t* sink, const color_t* frame, int rows, int cols,
+                             const sink_span_t* damage_rows) {
+    sink_rect_t damage = sink_rect_empty();
+    for (int row = 0; row < rows; ++row)
+        if (damage_rows[row].col0 <= damage_rows[row].col1)
+            damage = sink_rect_union(damage, (sink_rect_t) {row, damage_rows[row].col0, row, damage_rows[row].col1});
+    sink->damage = damage;
+    sink->damage_rows = damage_rows;
+    sink->write(sink, frame, rows, cols);
+}
+
+int sink_next_run(const color_t* curr, const color_t* prev, int cols, int* col) {
+    int start = *col;
+    if (prev != NULL)
+        while ((start < cols) && (curr[start] == prev[start]))
+            start++;
+    if (start == cols) {
+        *col = cols;
+        return cols;
+    }
+    // extend the run over short gaps of unchanged characters
+    int end = start + 1;
+    for (int i = end, gap = 0; (i < cols) && (gap <= SINK_MERGE_GAP); ++i) {
+        if ((prev == NULL) || (curr[i] != prev[i])) {
+            end = i + 1;
+            gap = 0;
+        } else {
+            gap++;
+        }
+    }
+    *col = end;
+    return start;
+}
+
+size_t sink_ring_count(sink_t* sink) {
+    sink_ring_t* ring = sink->state;
+    return (ring->n_written < ring->capacity) ? ring->n_written : ring->capacity;
+}
+
+const color_t* sink_ring_frame(sink_t* sink, size_t age) {
+    sink_ring_t* ring = sink->state;
+    if (age >= sink_ring_count(sink))
+        return NULL;
+    const size_t iframe = (ring->n_written - 1 - age) % ring->capacity;
+    return &ring->frames[iframe * ring->frame_size];
+}
+
+void sink_free(sink_t* sink) {
+    sink->close(sink);
+    free(sink);
+}
@@ -0,0 +1,395 @@
+#include "spatial.h"
+#include "objects.h"
+#include "utils.h" // UT_MIN, UT_MAX
+#include <stdlib.h> // malloc, realloc, free
+#include <stdbool.h> // bool
+#include <stddef.h> // size_t
+#include <assert.h> // assert
+
+#define SPATIAL_INITIAL_CAPACITY 16
+
+//----------------------------------------------------------------------------------------------------------
+// Static functions
+//----------------------------------------------------------------------------------------------------------
+static inline bool spatial__is_leaf(spatial_node_t* node) {
+    return node->left == SPATIAL_NULL_NODE;
+}
+
+static inline aabb_t spatial__union(aabb_t* a, aabb_t* b) {
+    return (aabb_t) {UT_MIN(a->x0, b->x0), UT_MIN(a->y0, b->y0), UT_MIN(a->z0, b->z0),
+                     UT_MAX(a->x1, b->x1), UT_MAX(a->y1, b->y1), UT_MAX(a->z1, b->z1)};
+}
+
+/* half the surface area of a box - the cost of visiting it */
+static inline float spatial__area(aabb_t* box) {
+    const float dx = box->x1 - box->x0, dy = box->y1 - box->y0, dz = box->z1 - box->z0;
+    return dx*dy + dy*dz + dz*dx;
+}
+
+static inline bool spatial__contains(aabb_t* outer, aabb_t* inner) {
+    return (outer->x0 <= inner->x0) && (outer->y0 <= inner->y0) && (outer->z0 <= inner->z0) &&
+           (inner->x1 <= outer->x1) && (inner->y1 <= outer->y1) && (inner->z1 <= outer->z1);
+}
+
+static inline bool spatial__overlap(aabb_t* a, aabb_t* b) {
+    return (a->x0 <= b->x1) && (b->x0 <= a->x1) &&
+           (a->y0 <= b->y1) && (b->y0 <= a->y1) &&
+           (a->z0 <= b->z1) && (b->z0 <= a->z1);
+}
+
+static inline aabb_t spatial__mesh_box(mesh_t* mesh) {
+    return (aabb_t) {UT_MIN(mesh->bounding_box.x0, mesh->bounding_box.x1),
+                     UT_MIN(mesh->bounding_box.y0, mesh->bounding_box.y1),
+                     UT_MIN(mesh->bounding_box.z0, mesh->bounding_box.z1),
+                     UT_MAX(mesh->bounding_box.x0, mesh->bounding_box.x1),
+                     UT_MAX(mesh->bounding_box.y0, mesh->bounding_box.y1),
+                     UT_MAX(mesh->bounding_box.z0, mesh->bounding_box.z1)};
+}
+
+static inline aabb_t spatial__fatten(aabb_t* box) {
+    const int mx = SPATIAL_FAT_MARGIN + SPATIAL_FAT_MARGIN_FRAC*(box->x1 - box->x0);
+    const int my = SPATIAL_FAT_MARGIN + SPATIAL_FAT_MARGIN_FRAC*(box->y1 - box->y0);
+    const int mz = SPATIAL_FAT_MARGIN + SPATIAL_FAT_MARGIN_FRAC*(box->z1 - box->z0);
+    return (aabb_t) {box->x0 - mx, box->y0 - my, box->z0 - mz,
+                     box->x1 + mx, box->y1 + my, box->z1 + mz};
+}
+
+/* whether the ray from `orig` along `dir` (t >= 0) crosses the box - slab test */
+static bool spatial__ray_hits_box(vec3_t* orig, vec3_t* dir, aabb_t* box) {
+    float tmin = 0, tmax = 1e30;
+    const float o[3] = {orig->x, orig->y, orig->z};
+    const float d[3] = {dir->x, dir->y, dir->z};
+    const float lo[3] = {box->x0, box->y0, box->z0};
+    const float hi[3] = {box->x1, box->y1, box->z1};
+    for (int i = 0; i < 3; ++i) {
+        if (d[i] == 0) {
+            // parallel to the slab so it must start between its planes
+            if ((o[i] < lo[i]) || (o[i] > hi[i]))
+                return false;
+            continue;
+        }
+        float t0 = (lo[i] - o[i])/d[i];
+        float t1 = (hi[i] - o[i])/d[i];
+        if (t0 > t1) {
+            const float tmp = t0;
+            t0 = t1;
+            t1 = tmp;
+        }
+        tmin = UT_MAX(tmin, t0);
+        tmax = UT_MIN(tmax, t1);
+        if (tmin > tmax)
+            return false;
+    }
+    return true;
+}
+
+static int spatial__alloc_node(spatial_t* index) {
+    if (index->free_list == SPATIAL_NULL_NODE) {
+        // out of nodes - double the pool and chain the new ones as free
+        const size_t old_capacity = index->capacity;
+        index->capacity *= 2;
+        index->nodes = realloc(index->nodes, sizeof(spatial_node_t) * index->capacity);
+        index->stack = realloc(index->stack, sizeof(int) * index->capacity);
+        index->stack_size = index->capacity;
+        for (size_t i = old_capacity; i < index->capacity; ++i) {
+            index->nodes[i].parent = (i + 1 < index->capacity) ? (int)i + 1 : SPATIAL_NULL_NODE;
+            index->nodes[i].height = -1;
+        }
+        index->free_list = old_capacity;
+    }
+    const int id = index->free_list;
+    spatial_node_t* node = &index->nodes[id];
+    index->free_list = node->parent;
+    node->parent = SPATIAL_NULL_NODE;
+    node->left = SPATIAL_NULL_NODE;
+    node->right = SPATIAL_NULL_NODE;
+    node->height = 0;
+    node->mesh = NULL;
+    index->n_nodes++;
+    return id;
+}
+
+static void spatial__free_node(spatial_t* index, int id) {
+    index->nodes[id].parent = index->free_list;
+    index->nodes[id].height = -1;
+    index->free_list = id;
+    index->n_nodes--;
+}
+
+/**
+ * @brief Performs a left or right rotation if node A is imbalanced
+ *
+ * @return The index of the node that took A's place
+ */
+static int spatial__balance(spatial_t* index, int ia) {
+   /*
+    *           A
+    *         /   \
+    *        B     C        if C is 2 levels taller than B, C goes up,
+    *             / \       A becomes its child and A adopts the shorter
+    *            F   G      of F, G (and vice versa if B is taller)
+    */
+    spatial_node_t* nodes = index->nodes;
+    spatial_node_t* a = &nodes[ia];
+    if (spatial__is_leaf(a) || (a->height < 2))
+        return ia;
+    const int ib = a->left, ic = a->right;
+    spatial_node_t* b = &nodes[ib];
+    spatial_node_t* c = &nodes[ic];
+    const int balance = c->height - b->height;
+    if ((balance > 1) || (balance < -1)) {
+        // `up` is the taller child that's rotated up, `other` the shorter one
+        const int iup = (balance > 1) ? ic : ib;
+        spatial_node_t* up = &nodes[iup];
+        const int if_ = up->left, ig = up->right;
+        spatial_node_t* f = &nodes[if_];
+        spatial_node_t* g = &nodes[ig];
+        // swap A and its taller child
+        up->left = ia;
+        up->parent = a->parent;
+        a->parent = iup;
+        if (up->parent != SPATIAL_NULL_NODE) {
+            if (nodes[up->parent].left == ia)
+                nodes[up->parent].left = iup;
+            else
+                nodes[up->parent].right = iup;
+        } else {
+            index->root = iup;
+        }
+        // the taller grandchild stays with the rotated node, the shorter goes to A
+        const int ikeep = (f->height > g->height) ? if_ : ig;
+        const int igive = (f->height > g->height) ? ig : if_;
+        up->right = ikeep;
+        if (balance > 1)
+            a->right = igive;
+        else
+            a->left = igive;
+        nodes[igive].parent = ia;
+        a->box = spatial__union(&nodes[a->left].box, &nodes[a->right].box);
+        a->height = 1 + UT_MAX(nodes[a->left].height, nodes[a->right].height);
+        up->box = spatial__union(&a->box, &nodes[ikeep].box);
+        up->height = 1 + UT_MAX(a->height, nodes[ikeep].height);
+        return iup;
+    }
+    return ia;
+}
+
+/* walk from a node to the root, re-balancing and refitting the boxes */
+static void spatial__refit_up(spatial_t* index, int id) {
+    while (id != SPATIAL_NULL_NODE) {
+        id = spatial__balance(index, id);
+        spatial_node_t* node = &index->nodes[id];
+        spatial_node_t* left = &index->nodes[node->left];
+        spatial_node_t* right = &index->nodes[node->right];
+        node->height = 1 + UT_MAX(left->height, right->height);
+        node->box = spatial__union(&left->box, &right->box);
+        id = node->parent;
+    }
+}
+
+static void spatial__insert_leaf(spatial_t* index, int leaf) {
+    if (index->root == SPATIAL_NULL_NODE) {
+        index->root = leaf;
+        index->nodes[leaf].parent = SPATIAL_NULL_NODE;
+        return;
+    }
+    // descend towards the sibling whose box grows the least by adding the leaf
+    aabb_t leaf_box = index->nodes[leaf].box;
+    int id = index->root;
+    while (!spatial__is_leaf(&index->nodes[id])) {
+        spatial_node_t* node = &index->nodes[id];
+        const float area = spatial__area(&node->box);
+        aabb_t combined_box = spatial__union(&node->box, &leaf_box);
+        const float combined_area = spatial__area(&combined_box);
+        // cost of pairing the leaf with this node
+        const float cost = 2*combined_area;
+        // minimum cost of pushing the leaf further down
+        const float inheritance_cost = 2*(combined_area - area);
+        float child_cost[2];
+        const int children[2] = {node->left, node->right};
+        for (int i = 0; i < 2; ++i) {
+            spatial_node_t* child = &index->nodes[children[i]];
+            aabb_t box = spatial__union(&leaf_box, &child->box);
+            child_cost[i] = spatial__is_leaf(child) ?
+                spatial__area(&box) + inheritance_cost :
+                spatial__area(&box) - spatial__area(&child->box) + inheritance_cost;
+        }
+        if ((cost < child_cost[0]) && (cost < child_cost[1]))
+            break;
+        id = (child_cost[0] < child_cost[1]) ? children[0] : children[1];
+    }
+    // new parent of the sibling and the leaf
+    const int sibling = id;
+    const int old_parent = index->nodes[sibling].parent;
+    const int new_parent = spatial__alloc_node(index);
+    spatial_node_t* nodes = index->nodes;
+    nodes[new_parent].parent = old_parent;
+    nodes[new_parent].box = spatial__union(&leaf_box, &nodes[sibling].box);
+    nodes[new_parent].height = nodes[sibling].height + 1;
+    nodes[new_parent].left = sibling;
+    nodes[new_parent].right = leaf;
+    nodes[sibling].parent = new_parent;
+    nodes[leaf].parent = new_parent;
+    if (old_parent != SPATIAL_NULL_NODE) {
+        if (nodes[old_parent].left == sibling)
+            nodes[old_parent].left = new_parent;
+        else
+            nodes[old_parent].right = new_parent;
+    } else {
+        index->root = new_parent;
+    }
+    spatial__refit_up(index, nodes[leaf].parent);
+}
+
+static void spatial__remove_leaf(spatial_t* index, int leaf) {
+    spatial_node_t* nodes = index->nodes;
+    if (leaf == index->root) {
+        index->root = SPATIAL_NULL_NODE;
+        return;
+    }
+    // the sibling takes the parent's place
+    const int parent = nodes[leaf].parent;
+    const int grandparent = nodes[parent].parent;
+    const int sibling = (nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+    if (grandparent != SPATIAL_NULL_NODE) {
+        if (nodes[grandparent].left == parent)
+            nodes[grandparent].left = sibling;
+        else
+            nodes[grandparent].right = sibling;
+        nodes[sibling].parent = grandparent;
+        spatial__free_node(index, parent);
+        spatial__refit_up(index, grandparent);
+    } else {
+        index->root = sibling;
+        nodes[sibling].parent = SPATIAL_NULL_NODE;
+        spatial__free_node(index, parent);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------
+// External functions
+//----------------------------------------------------------------------------------------------------------
+spatial_t* spatial_new() {
+    spatial_t* new = malloc(sizeof(spatial_t));
+    new->capacity = SPATIAL_INITIAL_CAPACITY;
+    new->n_nodes = 0;
+    new->root = SPATIAL_NULL_NODE;
+    new->nodes = malloc(sizeof(spatial_node_t) * new->capacity);
+    new->stack = malloc(sizeof(int) * new->capacity);
+    new->stack_size = new->capacity;
+    for (size_t i = 0; i < new->capacity; ++i) {
+        new->nodes[i].parent = (i + 1 < new->capacity) ? (int)i + 1 : SPATIAL_NULL_NODE;
+        new->nodes[i].height = -1;
+    }
+    new->free_list = 0;
+    return new;
+}
+
+int spatial_insert(spatial_t* index, mesh_t* mesh) {
+    assert(mesh->index == NULL);
+    const int proxy = spatial__alloc_node(index);
+    aabb_t box = spatial__mesh_box(mesh);
+    index->nodes[proxy].box = spatial__fatten(&box);
+    index->nodes[proxy].mesh = mesh;
+    spatial__insert_leaf(index, proxy);
+    mesh->index = index;
+    mesh->proxy = proxy;
+    return proxy;
+}
+
+bool spatial_update(spatial_t* index, int proxy) {
+    assert(spatial__is_leaf(&index->nodes[proxy]));
+    aabb_t box = spatial__mesh_box(index->nodes[proxy].mesh);
+    if (spatial__contains(&index->nodes[proxy].box, &box))
+        return false;
+    spatial__remove_leaf(index, proxy);
+    index->nodes[proxy].box = spatial__fatten(&box);
+    spatial__insert_leaf(index, proxy);
+    return true;
+}
+
+void spatial_remove(spatial_t* index, int proxy) {
+    assert(spatial__is_leaf(&index->nodes[proxy]));
+    index->nodes[proxy].mesh->index = NULL;
+    index->nodes[proxy].mesh->proxy = SPATIAL_NULL_NODE;
+    spatial__remove_leaf(index, proxy);
+    spatial__free_node(index, proxy);
+}
+
+size_t spatial_query_frustum(spatial_t* index, frustum_t* frustum, mesh_t** out, size_t max_out) {
+    size_t n_found = 0, top = 0;
+    if (index->root != SPATIAL_NULL_NODE)
+        index->stack[top++] = index->root;
+    while (top > 0) {
+        spatial_node_t* node = &index->nodes[index->stack[--top]];
+        aabb_t* b = &node->box;
+        if (obj_frustum_culls_box(frustum, b->x0, b->y0, b->z0, b->x1, b->y1, b->z1))
+            continue;
+        if (spatial__is_leaf(node)) {
+            if (n_found < max_out)
+                out[n_found] = node->mesh;
+            n_found++;
+        } else {
+            index->stack[top++] = node->left;
+            index->stack[top++] = node->right;
+        }
+    }
+    return n_found;
+}
+
+size_t spatial_query_box(spatial_t* index, aabb_t* box, mesh_t** out, size_t max_out) {
+    size_t n_found = 0, top = 0;
+    if (index->root != SPATIAL_NULL_NODE)
+        index->stack[top++] = index->root;
+    while (top > 0) {
+        spatial_node_t* node = &index->nodes[index->stack[--top]];
+        if (!spatial__overlap(&node->box, box))
+            continue;
+        if (spatial__is_leaf(node)) {
+            if (n_found < max_out)
+                out[n_found] = node->mesh;
+            n_found++;
+        } else {
+            index->stack[top++] = node->left;
+            index->stack[top++] = node->right;
+        }
+    }
+    return n_found;
+}
+
+size_t spatial_query_ray(spatial_t* index, ray_t* ray, mesh_t** out, size_t max_out) {
+    vec3_t orig = (vec3_t) {ray->orig->x, ray->orig->y, ray->orig->z};
+    vec3_t dir = (vec3_t) {ray->end->x - ray->orig->x,
+                           ray->end->y - ray->orig->y,
+                           ray->end->z - ray->orig->z};
+    size_t n_found = 0, top = 0;
+    if (index->root != SPATIAL_NULL_NODE)
+        index->stack[top++] = index->root;
+    while (top > 0) {
+        spatial_node_t* node = &index->nodes[index->stack[--top]];
+        if (!spatial__ray_hits_box(&orig, &dir, &node->box))
+            continue;
+        if (spatial__is_leaf(node)) {
+            if (n_found < max_out)
+                out[n_found] = node->mesh;
+            n_found++;
+        } else {
+            index->stack[top++] = node->left;
+            index->stack[top++] = node->right;
+        }
+    }
+    return n_found;
+}
+
+void spatial_free(spatial_t* index) {
+    // the meshes outlive the index, they mustn't update it any more
+    for (size_t i = 0; i < index->capacity; ++i) {
+        if ((index->nodes[i].height == 0) && (index->nodes[i].mesh != NULL)) {
+            index->nodes[i].mesh->index = NULL;
+            index->nodes[i].mesh->proxy = SPATIAL_NULL_NODE;
+        }
+    }
+    free(index->nodes);
+    free(index->stack);
+    free(index);
+}
@@ -1,5 +1,6 @@
 #include "utils.h"
 #include <stdbool.h>
+#include <time.h> // clock_gettime
 
 bool ut_is_decimal(char* string) {
     bool ret = false;
@@ -13,3 +14,126 @@ bool ut_is_decimal(char* string) {
     }
     return ret;
 }
+
+double ut_secs_since(const struct timespec* t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) + 1e-9*(t1.tv_nsec - t0->tv_nsec);
+}
+
+#ifdef UT_ALLOC_STATS
+// the wrappers call the real functions
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+#include <string.h> // strcmp, strrchr
+
+#define UT_ALLOC_MAX_SUBSYSTEMS 32
+
+typedef struct alloc_stats {
+    const char* name;
+    size_t n_allocs, n_frees;
+    size_t bytes_live, bytes_peak, bytes_total;
+} alloc_stats_t;
+
+/*
+ * Prepended to each block so `ut_free` knows what to subtract from whom.
+ * The union keeps the block after it aligned like malloc's.
+ */
+typedef union alloc_header {
+    struct {
+        size_t size;
+        size_t subsystem;
+    } info;
+    long double align;
+} alloc_header_t;
+
+/*
+ * Threads, e.g. the export workers, allocate at the same time, so the
+ * counters are only updated atomically and a subsystem claims its slot by
+ * setting its name once.
+ */
+static alloc_stats_t g_alloc_stats[UT_ALLOC_MAX_SUBSYSTEMS];
+static size_t g_n_allocs = 0;
+
+static size_t ut__subsystem_index(const char* name) {
+    // the last slot collects whatever doesn't fit
+    for (size_t i = 0; i < UT_ALLOC_MAX_SUBSYSTEMS - 1; ++i) {
+        const char* slot_name = __atomic_load_n(&g_alloc_stats[i].name, __ATOMIC_ACQUIRE);
+        if ((slot_name == NULL) &&
+            __atomic_compare_exchange_n(&g_alloc_stats[i].name, &slot_name, name, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return i;
+        // another thread may have just claimed it, and set `slot_name` to its name
+        if ((slot_name == name) || (strcmp(slot_name, name) == 0))
+            return i;
+    }
+    __atomic_store_n(&g_alloc_stats[UT_ALLOC_MAX_SUBSYSTEMS - 1].name, "others", __ATOMIC_RELEASE);
+    return UT_ALLOC_MAX_SUBSYSTEMS - 1;
+}
+
+static void* ut__track(alloc_header_t* header, size_t size, const char* subsystem) {
+    if (header == NULL)
+        return NULL;
+    const size_t i = ut__subsystem_index(subsystem);
+    alloc_stats_t* stats = &g_alloc_stats[i];
+    header->info.size = size;
+    header->info.subsystem = i;
+    __atomic_add_fetch(&stats->n_allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->bytes_total, size, __ATOMIC_RELAXED);
+    const size_t bytes_live = __atomic_add_fetch(&stats->bytes_live, size, __ATOMIC_RELAXED);
+    size_t bytes_peak = __atomic_load_n(&stats->bytes_peak, __ATOMIC_RELAXED);
+    while ((bytes_live > bytes_peak) &&
+           !__atomic_compare_exchange_n(&stats->bytes_peak, &bytes_peak, bytes_live, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    __atomic_add_fetch(&g_n_allocs, 1, __ATOMIC_RELAXED);
+    return header + 1;
+}
+
+static alloc_header_t* ut__untrack(void* ptr) {
+    alloc_header_t* header = (alloc_header_t*) ptr - 1;
+    alloc_stats_t* stats = &g_alloc_stats[header->info.subsystem];
+    __atomic_add_fetch(&stats->n_frees, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&stats->bytes_live, header->info.size, __ATOMIC_RELAXED);
+    return header;
+}
+
+void* ut_malloc(size_t size, const char* subsystem) {
+    return ut__track(malloc(sizeof(alloc_header_t) + size), size, subsystem);
+}
+
+void* ut_calloc(size_t n, size_t size, const char* subsystem) {
+    return ut__track(calloc(1, sizeof(alloc_header_t) + n*size), n*size, subsystem);
+}
+
+void* ut_realloc(void* ptr, size_t size, const char* subsystem) {
+    if (ptr == NULL)
+        return ut_malloc(size, subsystem);
+    // a reallocation counts as a free by the owner and an allocation by the caller
+    alloc_header_t* header = ut__untrack(ptr);
+    return ut__track(realloc(header, sizeof(alloc_header_t) + size), size, subsystem);
+}
+
+void ut_free(void* ptr) {
+    if (ptr != NULL)
+        free(ut__untrack(ptr));
+}
+
+size_t ut_alloc_count() {
+    return __atomic_load_n(&g_n_allocs, __ATOMIC_RELAXED);
+}
+
+void ut_alloc_report(FILE* stream, const char* title) {
+    fprintf(stream, "---- allocations: %s ----\n", title);
+    fprintf(stream, "%-24s %10s %10s %12s %12s %12s\n",
+            "subsystem", "allocs", "frees", "live bytes", "peak bytes", "total bytes");
+    for (size_t i = 0; (i < UT_ALLOC_MAX_SUBSYSTEMS) && (g_alloc_stats[i].name != NULL); ++i) {
+        const alloc_stats_t* stats = &g_alloc_stats[i];
+        const char* basename = strrchr(stats->name, '/');
+        fprintf(stream, "%-24s %10zu %10zu %12zu %12zu %12zu\n",
+                (basename != NULL) ? basename + 1 : stats->name,
+                stats->n_allocs, stats->n_frees, stats->bytes_live, stats->bytes_peak, stats->bytes_total);
+    }
+}
+#endif /* UT_ALLOC_STATS */
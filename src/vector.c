@@ -1,8 +1,9 @@
 #include "xtrig.h"
 #include "vector.h"
+#include "utils.h" // UT_MIN, UT_MAX
 #include <stdbool.h> // true/false
 #include <stdlib.h> // malloc
-#include <math.h> // round
+#include <math.h> // round, asin, atan2
 
 // square root tolerance distance when comparing vectors 
 #define SQRT_TOL 1e-2
@@ -62,8 +63,10 @@ void vec_vec3_rotate(vec3_t* src, float angle_x_rad, float angle_y_rad, float an
     src->z -= z0;
 
     float a = angle_x_rad, b = angle_y_rad, c = angle_z_rad;
-    float ca = fcos(a), cb = fcos(b), cc = fcos(c);
-    float sa = fsin(a), sb = fsin(b), sc = fsin(c);
+    float ca, cb, cc, sa, sb, sc;
+    fsincos(a, &sa, &ca);
+    fsincos(b, &sb, &cb);
+    fsincos(c, &sc, &cc);
     float matrix_rotx[3][3] = {
         {1, 0,  0  },
         {0, ca, -sa},
@@ -165,8 +168,10 @@ void vec_vec3i_rotate(vec3i_t* src, float angle_x_rad, float angle_y_rad, float
     rotated.z -= z0;
 
     const float a = angle_x_rad, b = angle_y_rad, c = angle_z_rad;
-    const float ca = fcos(a), cb = fcos(b), cc = fcos(c);
-    const float sa = fsin(a), sb = fsin(b), sc = fsin(c);
+    float ca, cb, cc, sa, sb, sc;
+    fsincos(a, &sa, &ca);
+    fsincos(b, &sb, &cb);
+    fsincos(c, &sc, &cc);
     const float matrix_rotx[3][3] = {
         {1, 0,  0  },
         {0, ca, -sa},
@@ -182,10 +187,11 @@ void vec_vec3i_rotate(vec3i_t* src, float angle_x_rad, float angle_y_rad, float
         {sc, cc,  0},
         {0,  0,   1},
     };
-    // x, y, z store the previous coordinates as computed by the previous operation
-    int x = rotated.x;
-    int y = rotated.y;
-    int z = rotated.z;
+    // x, y, z store the previous coordinates as computed by the previous operation,
+    // kept as float so only the result is rounded
+    float x = rotated.x;
+    float y = rotated.y;
+    float z = rotated.z;
     rotated.x = matrix_rotx[0][0]*x + matrix_rotx[0][1]*y + matrix_rotx[0][2]*z;
     rotated.y = matrix_rotx[1][0]*x + matrix_rotx[1][1]*y + matrix_rotx[1][2]*z;
     rotated.z = matrix_rotx[2][0]*x + matrix_rotx[2][1]*y + matrix_rotx[2][2]*z;
@@ -214,3 +220,239 @@ void vec_vec3i_rotate(vec3i_t* src, float angle_x_rad, float angle_y_rad, float
     src->y = round(rotated.y);
     src->z = round(rotated.z);
 }
+
+//-----------------------------------------------------------------------------------
+// Affine transforms
+//-----------------------------------------------------------------------------------
+void vec_mat34_identity(mat34_t* mat) {
+    for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 4; ++c)
+            mat->m[r][c] = (r == c) ? 1 : 0;
+}
+
+void vec_mat34_from_euler(mat34_t* mat, float angle_x_rad, float angle_y_rad, float angle_z_rad,
+                          float tx, float ty, float tz) {
+    // R = Rz*Ry*Rx with the same matrices as `vec_vec3i_rotate`
+    float ca, cb, cc, sa, sb, sc;
+    fsincos(angle_x_rad, &sa, &ca);
+    fsincos(angle_y_rad, &sb, &cb);
+    fsincos(angle_z_rad, &sc, &cc);
+    *mat = (mat34_t) {{
+        {cc*cb, cc*sb*sa - sc*ca, cc*sb*ca + sc*sa, tx},
+        {sc*cb, sc*sb*sa + cc*ca, sc*sb*ca - cc*sa, ty},
+        {-sb,   cb*sa,            cb*ca,            tz},
+    }};
+}
+
+void vec_mat34_to_euler(mat34_t* mat, float* angle_x_rad, float* angle_y_rad, float* angle_z_rad) {
+    // the bottom row of Rz*Ry*Rx is (-sin(b), cos(b)sin(a), cos(b)cos(a))
+    // and its first column (cos(c)cos(b), sin(c)cos(b), -sin(b))
+    const float sb = -mat->m[2][0];
+    *angle_y_rad = asin((sb > 1) ? 1 : (sb < -1) ? -1 : sb);
+    if ((sb > 1 - 1e-6) || (sb < -1 + 1e-6)) {
+        // gimbal lock - only a + c or a - c is defined so we set c to 0
+        *angle_x_rad = atan2(-mat->m[1][2], mat->m[1][1]);
+        *angle_z_rad = 0;
+    } else {
+        *angle_x_rad = atan2(mat->m[2][1], mat->m[2][2]);
+        *angle_z_rad = atan2(mat->m[1][0], mat->m[0][0]);
+    }
+}
+
+void vec_mat34_mul(mat34_t* dest, mat34_t* src1, mat34_t* src2) {
+    // [R1 | t1] * [R2 | t2] = [R1*R2 | R1*t2 + t1]
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            dest->m[r][c] = src1->m[r][0]*src2->m[0][c] +
+                            src1->m[r][1]*src2->m[1][c] +
+                            src1->m[r][2]*src2->m[2][c];
+        }
+        dest->m[r][3] += src1->m[r][3];
+    }
+}
+
+//-----------------------------------------------------------------------------------
+// Batch operations
+//-----------------------------------------------------------------------------------
+/*
+ * Each batch operation runs a vector loop over VEC_LANES points at a time and
+ * finishes the remainder with the scalar loop, which is also the reference
+ * implementation used on its own if no SIMD instruction set is enabled.
+ */
+#if defined(VEC_FIXED_POINT) || defined(VEC_SCALAR)
+// plain loops only
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define VEC_LANES 8
+typedef __m256 vfloat_t;
+#define VEC_LOAD(p)     _mm256_loadu_ps(p)
+#define VEC_STORE(p, a) _mm256_storeu_ps(p, a)
+#define VEC_SET1(a)     _mm256_set1_ps(a)
+#define VEC_ADD(a, b)   _mm256_add_ps(a, b)
+#define VEC_SUB(a, b)   _mm256_sub_ps(a, b)
+#define VEC_MUL(a, b)   _mm256_mul_ps(a, b)
+#define VEC_DIV(a, b)   _mm256_div_ps(a, b)
+#define VEC_MIN(a, b)   _mm256_min_ps(a, b)
+#define VEC_MAX(a, b)   _mm256_max_ps(a, b)
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define VEC_LANES 4
+typedef __m128 vfloat_t;
+#define VEC_LOAD(p)     _mm_loadu_ps(p)
+#define VEC_STORE(p, a) _mm_storeu_ps(p, a)
+#define VEC_SET1(a)     _mm_set1_ps(a)
+#define VEC_ADD(a, b)   _mm_add_ps(a, b)
+#define VEC_SUB(a, b)   _mm_sub_ps(a, b)
+#define VEC_MUL(a, b)   _mm_mul_ps(a, b)
+#define VEC_DIV(a, b)   _mm_div_ps(a, b)
+#define VEC_MIN(a, b)   _mm_min_ps(a, b)
+#define VEC_MAX(a, b)   _mm_max_ps(a, b)
+#endif
+
+vec3_soa_t* vec_soa_new(size_t n) {
+    vec3_soa_t* new = malloc(sizeof(vec3_soa_t));
+    new->x = malloc(sizeof(coord_t) * n);
+    new->y = malloc(sizeof(coord_t) * n);
+    new->z = malloc(sizeof(coord_t) * n);
+    new->n = n;
+    new->capacity = n;
+    return new;
+}
+
+void vec_soa_reserve(vec3_soa_t* soa, size_t capacity) {
+    if (capacity <= soa->capacity)
+        return;
+    soa->capacity = capacity;
+    soa->x = realloc(soa->x, sizeof(coord_t) * capacity);
+    soa->y = realloc(soa->y, sizeof(coord_t) * capacity);
+    soa->z = realloc(soa->z, sizeof(coord_t) * capacity);
+}
+
+void vec_soa_resize(vec3_soa_t* soa, size_t n) {
+    // grow geometrically so resizing every frame settles quickly
+    if (n > soa->capacity)
+        vec_soa_reserve(soa, (2*soa->capacity > n) ? 2*soa->capacity : n);
+    soa->n = n;
+}
+
+void vec_soa_free(vec3_soa_t* soa) {
+    free(soa->x);
+    free(soa->y);
+    free(soa->z);
+    free(soa);
+}
+
+void vec_batch_transform(vec3_soa_t* dest, mat34_t* mat, vec3_soa_t* src) {
+    coord_t m[3][4];
+    for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 4; ++c)
+            m[r][c] = COORD_FROM_FLOAT(mat->m[r][c]);
+    size_t i = 0;
+#ifdef VEC_LANES
+    const vfloat_t m00 = VEC_SET1(m[0][0]), m01 = VEC_SET1(m[0][1]), m02 = VEC_SET1(m[0][2]), m03 = VEC_SET1(m[0][3]);
+    const vfloat_t m10 = VEC_SET1(m[1][0]), m11 = VEC_SET1(m[1][1]), m12 = VEC_SET1(m[1][2]), m13 = VEC_SET1(m[1][3]);
+    const vfloat_t m20 = VEC_SET1(m[2][0]), m21 = VEC_SET1(m[2][1]), m22 = VEC_SET1(m[2][2]), m23 = VEC_SET1(m[2][3]);
+    for (; i + VEC_LANES <= src->n; i += VEC_LANES) {
+        const vfloat_t x = VEC_LOAD(src->x + i), y = VEC_LOAD(src->y + i), z = VEC_LOAD(src->z + i);
+        VEC_STORE(dest->x + i, VEC_ADD(VEC_ADD(VEC_ADD(VEC_MUL(m00, x), VEC_MUL(m01, y)), VEC_MUL(m02, z)), m03));
+        VEC_STORE(dest->y + i, VEC_ADD(VEC_ADD(VEC_ADD(VEC_MUL(m10, x), VEC_MUL(m11, y)), VEC_MUL(m12, z)), m13));
+        VEC_STORE(dest->z + i, VEC_ADD(VEC_ADD(VEC_ADD(VEC_MUL(m20, x), VEC_MUL(m21, y)), VEC_MUL(m22, z)), m23));
+    }
+#endif
+    for (; i < src->n; ++i) {
+        const coord_t x = src->x[i], y = src->y[i], z = src->z[i];
+        dest->x[i] = COORD_MUL(m[0][0], x) + COORD_MUL(m[0][1], y) + COORD_MUL(m[0][2], z) + m[0][3];
+        dest->y[i] = COORD_MUL(m[1][0], x) + COORD_MUL(m[1][1], y) + COORD_MUL(m[1][2], z) + m[1][3];
+        dest->z[i] = COORD_MUL(m[2][0], x) + COORD_MUL(m[2][1], y) + COORD_MUL(m[2][2], z) + m[2][3];
+    }
+}
+
+void vec_batch_dotprod(coord_t* dest, vec3_soa_t* src1, vec3_soa_t* src2) {
+    size_t i = 0;
+#ifdef VEC_LANES
+    for (; i + VEC_LANES <= src1->n; i += VEC_LANES) {
+        const vfloat_t xx = VEC_MUL(VEC_LOAD(src1->x + i), VEC_LOAD(src2->x + i));
+        const vfloat_t yy = VEC_MUL(VEC_LOAD(src1->y + i), VEC_LOAD(src2->y + i));
+        const vfloat_t zz = VEC_MUL(VEC_LOAD(src1->z + i), VEC_LOAD(src2->z + i));
+        VEC_STORE(dest + i, VEC_ADD(VEC_ADD(xx, yy), zz));
+    }
+#endif
+    for (; i < src1->n; ++i)
+        dest[i] = COORD_MUL(src1->x[i], src2->x[i]) + COORD_MUL(src1->y[i], src2->y[i]) +
+                  COORD_MUL(src1->z[i], src2->z[i]);
+}
+
+void vec_batch_crossprod(vec3_soa_t* dest, vec3_soa_t* src1, vec3_soa_t* src2) {
+    size_t i = 0;
+#ifdef VEC_LANES
+    for (; i + VEC_LANES <= src1->n; i += VEC_LANES) {
+        const vfloat_t x1 = VEC_LOAD(src1->x + i), y1 = VEC_LOAD(src1->y + i), z1 = VEC_LOAD(src1->z + i);
+        const vfloat_t x2 = VEC_LOAD(src2->x + i), y2 = VEC_LOAD(src2->y + i), z2 = VEC_LOAD(src2->z + i);
+        VEC_STORE(dest->x + i, VEC_SUB(VEC_MUL(y1, z2), VEC_MUL(z1, y2)));
+        VEC_STORE(dest->y + i, VEC_SUB(VEC_MUL(z1, x2), VEC_MUL(x1, z2)));
+        VEC_STORE(dest->z + i, VEC_SUB(VEC_MUL(x1, y2), VEC_MUL(y1, x2)));
+    }
+#endif
+    for (; i < src1->n; ++i) {
+        const coord_t x1 = src1->x[i], y1 = src1->y[i], z1 = src1->z[i];
+        const coord_t x2 = src2->x[i], y2 = src2->y[i], z2 = src2->z[i];
+        dest->x[i] = COORD_MUL(y1, z2) - COORD_MUL(z1, y2);
+        dest->y[i] = COORD_MUL(z1, x2) - COORD_MUL(x1, z2);
+        dest->z[i] = COORD_MUL(x1, y2) - COORD_MUL(y1, x2);
+    }
+}
+
+void vec_batch_bounds(vec3c_t* min, vec3c_t* max, vec3_soa_t* src) {
+    *min = *max = (vec3c_t) {src->x[0], src->y[0], src->z[0]};
+    size_t i = 1;
+#ifdef VEC_LANES
+    if (src->n >= VEC_LANES) {
+        vfloat_t xmin = VEC_LOAD(src->x), ymin = VEC_LOAD(src->y), zmin = VEC_LOAD(src->z);
+        vfloat_t xmax = xmin, ymax = ymin, zmax = zmin;
+        for (i = VEC_LANES; i + VEC_LANES <= src->n; i += VEC_LANES) {
+            const vfloat_t x = VEC_LOAD(src->x + i), y = VEC_LOAD(src->y + i), z = VEC_LOAD(src->z + i);
+            xmin = VEC_MIN(xmin, x); ymin = VEC_MIN(ymin, y); zmin = VEC_MIN(zmin, z);
+            xmax = VEC_MAX(xmax, x); ymax = VEC_MAX(ymax, y); zmax = VEC_MAX(zmax, z);
+        }
+        // reduce the lanes
+        float lanes[6][VEC_LANES];
+        VEC_STORE(lanes[0], xmin); VEC_STORE(lanes[1], ymin); VEC_STORE(lanes[2], zmin);
+        VEC_STORE(lanes[3], xmax); VEC_STORE(lanes[4], ymax); VEC_STORE(lanes[5], zmax);
+        for (int k = 0; k < VEC_LANES; ++k) {
+            min->x = UT_MIN(min->x, lanes[0][k]); min->y = UT_MIN(min->y, lanes[1][k]); min->z = UT_MIN(min->z, lanes[2][k]);
+            max->x = UT_MAX(max->x, lanes[3][k]); max->y = UT_MAX(max->y, lanes[4][k]); max->z = UT_MAX(max->z, lanes[5][k]);
+        }
+    }
+#endif
+    for (; i < src->n; ++i) {
+        min->x = UT_MIN(min->x, src->x[i]); min->y = UT_MIN(min->y, src->y[i]); min->z = UT_MIN(min->z, src->z[i]);
+        max->x = UT_MAX(max->x, src->x[i]); max->y = UT_MAX(max->y, src->y[i]); max->z = UT_MAX(max->z, src->z[i]);
+    }
+}
+
+void vec_batch_persp_divide(vec3_soa_t* dest, vec3_soa_t* src, float scale) {
+    const coord_t s = COORD_FROM_FLOAT(scale);
+    size_t i = 0;
+#ifdef VEC_LANES
+    const vfloat_t vs = VEC_SET1(s);
+    for (; i + VEC_LANES <= src->n; i += VEC_LANES) {
+        const vfloat_t z = VEC_LOAD(src->z + i);
+        VEC_STORE(dest->x + i, VEC_DIV(VEC_MUL(vs, VEC_LOAD(src->x + i)), z));
+        VEC_STORE(dest->y + i, VEC_DIV(VEC_MUL(vs, VEC_LOAD(src->y + i)), z));
+        VEC_STORE(dest->z + i, z);
+    }
+#endif
+    for (; i < src->n; ++i) {
+        const coord_t z = src->z[i];
+#ifdef VEC_FIXED_POINT
+        // integer division by zero traps, unlike float's which gives inf
+        if (z == 0) {
+            dest->x[i] = dest->y[i] = dest->z[i] = 0;
+            continue;
+        }
+#endif
+        dest->x[i] = COORD_DIV(COORD_MUL(s, src->x[i]), z);
+        dest->y[i] = COORD_DIV(COORD_MUL(s, src->y[i]), z);
+        dest->z[i] = z;
+    }
+}
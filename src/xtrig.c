@@ -1,33 +1,86 @@
 #include "xtrig.h"
+#include <stdint.h> // uint32_t
+#include <string.h> // memcpy
 
-double sine_lut[LUT_SIZE];
+// adding and removing it rounds floats below 2^22 to the nearest integer
+#define XTRIG_ROUND 12582912.0f
+// pi/2 split in parts whose products with a quadrant number below 2^22 are exact
+#define XTRIG_HALF_PI_HI  1.5703125f
+#define XTRIG_HALF_PI_MID 4.837512969970703125e-4f
+#define XTRIG_HALF_PI_LO  7.54978995489188216e-8f
+// minimax polynomials of sin and cos over [-pi/4, pi/4]
+#define XTRIG_SIN_1 -1.6666654611e-1f
+#define XTRIG_SIN_2  8.3321608736e-3f
+#define XTRIG_SIN_3 -1.9515295891e-4f
+#define XTRIG_COS_1  4.166664568298827e-2f
+#define XTRIG_COS_2 -1.388731625493765e-3f
+#define XTRIG_COS_3  2.443315711809948e-5f
+
+float sine_lut[LUT_SIZE + 1];
 
 void ftrig_init_lut() {
-    for (int i = 0; i < LUT_SIZE; i++) 
+    for (int i = 0; i <= LUT_SIZE; i++)
         sine_lut[i] = sin(i * LUT_BIN_SIZE);
 }
 
-/** Get the index of an angle in the LUT */
-static int get_lookup_index(double rad) {
-    return (int) round(rad / LUT_BIN_SIZE);
+/**
+ * Splits an angle into a LUT index in [0, LUT_SIZE) and the fraction between
+ * that bin and the next one. Flooring before masking wraps negative angles too.
+ */
+static inline int get_lookup_index(double rad, float* frac) {
+    const double pos = rad * (1.0 / LUT_BIN_SIZE);
+    const double bin = floor(pos);
+    *frac = (float) (pos - bin);
+    return (int) ((long long) bin & (LUT_SIZE - 1));
+}
+
+static inline float lerp_lut(int i, float frac) {
+    return sine_lut[i] + frac * (sine_lut[i + 1] - sine_lut[i]);
 }
 
 double fsin(double rad) {
-    // use the period and symmetry to compute based off [0, pi/2]
-    rad = fmod(rad, 2*M_PI);
-    if (rad < 0) rad += 2*M_PI;
-    if (rad <= HALF_PI) {
-        return sine_lut[get_lookup_index(rad)];
-    } else if (rad <= M_PI) {
-        return sine_lut[get_lookup_index(M_PI - rad)];
-    } else if (rad <= 3*HALF_PI) {
-        return -sine_lut[get_lookup_index(rad - M_PI)];
-    } else {
-        return -sine_lut[get_lookup_index(2*M_PI - rad)];
-    }
+    float frac;
+    const int i = get_lookup_index(rad, &frac);
+    return lerp_lut(i, frac);
 }
 
 double fcos(double rad) {
-    return fsin(HALF_PI - rad);
+    float frac;
+    // cos(x) = sin(x + pi/2) - a quarter of the table ahead
+    const int i = (get_lookup_index(rad, &frac) + LUT_SIZE / 4) & (LUT_SIZE - 1);
+    return lerp_lut(i, frac);
 }
 
+void fsincos(double rad, float* sine, float* cosine) {
+    float frac;
+    const int i = get_lookup_index(rad, &frac);
+    const int j = (i + LUT_SIZE / 4) & (LUT_SIZE - 1);
+    *sine = lerp_lut(i, frac);
+    *cosine = lerp_lut(j, frac);
+}
+
+void fsincos_array(const float* rads, float* sines, float* cosines, size_t n) {
+    // every step is a float or int32 operation of its own lane - no lookups,
+    // calls or branches - so that the loop vectorises
+    for (size_t k = 0; k < n; ++k) {
+        // round to the nearest quarter turn, whose low bits are then the low
+        // bits of the sum's mantissa - no conversion that could overflow
+        const float shifted = rads[k] * (float) (2.0 / M_PI) + XTRIG_ROUND;
+        const float quarter = shifted - XTRIG_ROUND;
+        uint32_t bits;
+        memcpy(&bits, &shifted, sizeof(bits));
+        const float r = ((rads[k] - quarter * XTRIG_HALF_PI_HI) - quarter * XTRIG_HALF_PI_MID) -
+                        quarter * XTRIG_HALF_PI_LO;
+        const float r2 = r * r;
+        const float sin_r = r + r * r2 * (XTRIG_SIN_1 + r2 * (XTRIG_SIN_2 + r2 * XTRIG_SIN_3));
+        const float cos_r = 1.0f - 0.5f * r2 + r2 * r2 * (XTRIG_COS_1 + r2 * (XTRIG_COS_2 + r2 * XTRIG_COS_3));
+        // sin(r + q*pi/2) and cos(r + q*pi/2) by quadrant, selected by
+        // arithmetic rather than branches
+        const int q = bits & 3;
+        const float is_odd = (float) (q & 1);
+        const float sine = sin_r + is_odd * (cos_r - sin_r);
+        const float cosine = cos_r + is_odd * (sin_r - cos_r);
+        sines[k] = (float) (1 - (q & 2)) * sine;
+        cosines[k] = (float) (1 - ((q + 1) & 2)) * cosine;
+    }
+}